@@ -0,0 +1,99 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// The framereplay tool, which plays saved screenshots into a frame ring (see framering.h) as though they
+// were being captured, for testing the processes that search the ring.  It is not part of the DLL: build
+// it with the portable engine files as described in "How to compile.txt".
+//
+// Usage: framereplay <ring name> <frames per second> [*Loops<n>] <image file>...
+//
+// The images (PNG or BMP) are published in turn, over and over, or n times through if *Loops is given.
+// The ring is created with 4 slots, large enough for the largest image.
+
+#include "framering.h"
+#include "imagedecode.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAY_SLOTS 4
+
+
+
+int main(int argc, char **argv)
+{
+	if (argc < 4)
+	{
+		fprintf(stderr, "Usage: framereplay <ring name> <frames per second> [*Loops<n>] <image file>...\n");
+		return 2;
+	}
+	int fps = atoi(argv[2]), loops = 0, first = 3;
+	if (fps < 1 || fps > 1000)
+	{
+		fprintf(stderr, "framereplay: frames per second must be 1 to 1000\n");
+		return 2;
+	}
+	if (!strncmp(argv[3], "*Loops", 6) || !strncmp(argv[3], "*loops", 6))
+	{
+		loops = atoi(argv[3] + 6);
+		++first;
+	}
+	int count = argc - first, i, max_width = 0, max_height = 0;
+	if (count < 1)
+	{
+		fprintf(stderr, "framereplay: no images given\n");
+		return 2;
+	}
+	DecodedImage *image = (DecodedImage *)malloc(count * sizeof(DecodedImage));
+	if (!image)
+		return 1;
+	for (i = 0; i < count; ++i)
+	{
+		if (!ImageDecodeFile(argv[first + i], image[i]))
+		{
+			fprintf(stderr, "framereplay: %s is not a PNG or BMP file that can be decoded\n", argv[first + i]);
+			return 1;
+		}
+		if (max_width < image[i].width)
+			max_width = image[i].width;
+		if (max_height < image[i].height)
+			max_height = image[i].height;
+	}
+	FrameRing *ring = FrameRingCreate(argv[1], REPLAY_SLOTS, max_width, max_height);
+	if (!ring)
+	{
+		fprintf(stderr, "framereplay: could not create frame ring %s\n", argv[1]);
+		return 1;
+	}
+	int published = 0, skipped = 0;
+	for (int loop = 0; !loops || loop < loops; ++loop)
+		for (i = 0; i < count; ++i)
+		{
+			SearchImage frame = {image[i].pixel, image[i].width, image[i].height, image[i].width};
+			if (FrameRingPublish(*ring, frame, 0, 0, image[i].is_16bit))
+				++published;
+			else
+				++skipped; // Every frame is pinned, so consumers are falling behind: drop this one.
+			ThreadSleep(1000 / fps);
+		}
+	printf("%s: %d frames published, %d skipped\n", argv[1], published, skipped);
+	FrameRingClose(ring);
+	for (i = 0; i < count; ++i)
+		ImageDecodeFree(image[i]);
+	free(image);
+	return 0;
+}
@@ -0,0 +1,268 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// No stdafx.h here: see framering.h.
+// The producer and the consumers agree through two counters per slot, each changed only atomically (and
+// so with a full barrier).  To reuse a slot, the producer first zeroes its sequence and only then checks
+// that it has no readers, putting the sequence back if it has.  A consumer first counts itself as a reader
+// and only then checks that the slot still holds the frame it wants, uncounting itself if not.  Whichever
+// of the two goes second sees what the other did, so a pinned frame is never overwritten.
+
+#include "framering.h"
+#include "platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct FrameRing
+{
+	volatile int ref_count; // One for being open, plus one per pin (see FrameRingPin()).
+	PlatformSharedMemory *memory;
+	FrameRingHeader *header;
+	unsigned char *slots;
+	size_t slot_size;
+	int slot_count, max_width, max_height; // As checked in the header, which later writes to it can't change.
+	int next_slot;          // Producer only: where to look first for a slot to reuse.
+};
+
+
+
+static size_t SlotSize(int aMaxWidth, int aMaxHeight)
+{
+	// Rows of AlignedStride() pixels are whole multiples of FRAME_RING_ALIGN, so the next slot is aligned too.
+	return FRAME_RING_ALIGN + (size_t)AlignedStride(aMaxWidth, sizeof(PIXEL32)) * aMaxHeight * sizeof(PIXEL32);
+}
+
+
+
+static inline FrameRingSlot &Slot(FrameRing &aRing, int aIndex)
+{
+	return *(FrameRingSlot *)(aRing.slots + aIndex * aRing.slot_size);
+}
+
+
+
+static inline int AtomicRead(volatile int *aTarget)
+{
+	return AtomicCompareExchange(aTarget, 0, 0); // Stores only the zero that is already there, if any.
+}
+
+
+
+static inline void AtomicWrite(volatile int *aTarget, int aValue)
+{
+	for (int old = *aTarget; AtomicCompareExchange(aTarget, aValue, old) != old; old = *aTarget);
+}
+
+
+
+static FrameRing *RingAttach(const char *aName, size_t aSize, bool aCreate)
+// Maps the named ring and checks its header.  If aCreate and the ring is new, the caller must fill in
+// the header.  Returns NULL on failure.
+{
+	FrameRing *ring = (FrameRing *)malloc(sizeof(FrameRing));
+	if (!ring)
+		return NULL;
+	size_t size = aSize;
+	if (   !(ring->memory = SharedMemoryOpen(aName, size, aCreate))   )
+	{
+		free(ring);
+		return NULL;
+	}
+	ring->header = (FrameRingHeader *)SharedMemoryData(ring->memory);
+	ring->slots = (unsigned char *)ring->header + FRAME_RING_ALIGN;
+	FrameRingHeader &header = *ring->header;
+	if (header.magic) // Not new: it must be a ring, of a size that fits.
+	{
+		if (header.magic != FRAME_RING_MAGIC || header.version != FRAME_RING_VERSION
+			|| header.slot_count < 1 || header.slot_count > FRAME_RING_MAX_SLOTS
+			|| header.max_width < 1 || header.max_height < 1 || header.max_width > 0x7FFF || header.max_height > 0x7FFF
+			|| FRAME_RING_ALIGN + header.slot_count * SlotSize(header.max_width, header.max_height) > size)
+		{
+			SharedMemoryClose(ring->memory);
+			free(ring);
+			return NULL;
+		}
+		ring->slot_size = SlotSize(header.max_width, header.max_height);
+		ring->slot_count = header.slot_count;
+		ring->max_width = header.max_width;
+		ring->max_height = header.max_height;
+	}
+	else if (!aCreate)
+	{
+		SharedMemoryClose(ring->memory);
+		free(ring);
+		return NULL;
+	}
+	ring->ref_count = 1;
+	ring->next_slot = 0;
+	return ring;
+}
+
+
+
+FrameRing *FrameRingCreate(const char *aName, int aSlotCount, int aMaxWidth, int aMaxHeight)
+// For the producer: creates the named ring with room for aSlotCount frames of up to aMaxWidth x aMaxHeight
+// pixels, or opens it if it already exists with at least that much room (such as when the producer is
+// restarted while consumers still have it open).  Returns NULL on failure.  Caller must FrameRingClose()
+// the result.
+{
+	if (aSlotCount < 2 || aSlotCount > FRAME_RING_MAX_SLOTS || aMaxWidth < 1 || aMaxHeight < 1
+		|| aMaxWidth > 0x7FFF || aMaxHeight > 0x7FFF)
+		return NULL;
+	FrameRing *ring = RingAttach(aName, FRAME_RING_ALIGN + aSlotCount * SlotSize(aMaxWidth, aMaxHeight), true);
+	if (!ring)
+		return NULL;
+	FrameRingHeader &header = *ring->header;
+	if (header.magic)
+	{
+		if (header.slot_count < aSlotCount || header.max_width < aMaxWidth || header.max_height < aMaxHeight)
+		{
+			FrameRingClose(ring);
+			return NULL;
+		}
+		return ring;
+	}
+	// New, and so all zero: no frames yet.  The magic number goes last so that consumers ignore the ring
+	// until the rest of the header is there.
+	header.version = FRAME_RING_VERSION;
+	header.slot_count = aSlotCount;
+	header.max_width = aMaxWidth;
+	header.max_height = aMaxHeight;
+	ring->slot_size = SlotSize(aMaxWidth, aMaxHeight);
+	ring->slot_count = aSlotCount;
+	ring->max_width = aMaxWidth;
+	ring->max_height = aMaxHeight;
+	AtomicWrite((volatile int *)&header.magic, (int)FRAME_RING_MAGIC);
+	return ring;
+}
+
+
+
+FrameRing *FrameRingOpen(const char *aName)
+// For consumers: opens a ring the producer has already created.  Returns NULL on failure.
+// Caller must FrameRingClose() the result.
+{
+	return RingAttach(aName, 0, false);
+}
+
+
+
+void FrameRingClose(FrameRing *aRing)
+// The ring stays mapped until every frame pinned through aRing has been unpinned.  NULL is allowed.
+{
+	if (!aRing || AtomicDecrement(&aRing->ref_count))
+		return;
+	SharedMemoryClose(aRing->memory);
+	free(aRing);
+}
+
+
+
+int FrameRingPublish(FrameRing &aRing, const SearchImage &aImage, int aLeft, int aTop, bool aIs16Bit)
+// For the producer: copies aImage into the slot of the oldest frame that isn't pinned, and makes it the
+// newest frame.  Returns its number, or 0 if the image is too large or every frame is pinned.
+{
+	FrameRingHeader &header = *aRing.header;
+	if (aImage.width < 1 || aImage.height < 1 || aImage.width > header.max_width || aImage.height > header.max_height)
+		return 0;
+	int i, index = 0;
+	for (i = 0; i < header.slot_count; ++i)
+	{
+		index = (aRing.next_slot + i) % header.slot_count;
+		FrameRingSlot &slot = Slot(aRing, index);
+		int old = AtomicRead(&slot.sequence);
+		AtomicWrite(&slot.sequence, 0);
+		if (!AtomicRead(&slot.readers))
+			break;
+		AtomicWrite(&slot.sequence, old); // Pinned, so leave it be.
+	}
+	if (i == header.slot_count)
+		return 0;
+	aRing.next_slot = index + 1;
+
+	FrameRingSlot &slot = Slot(aRing, index);
+	int stride = AlignedStride(aImage.width, sizeof(PIXEL32));
+	PIXEL32 *pixel = (PIXEL32 *)((unsigned char *)&slot + FRAME_RING_ALIGN);
+	const PIXEL32 *row = aImage.pixels;
+	for (int y = 0; y < aImage.height; ++y, row += aImage.stride, pixel += stride)
+		memcpy(pixel, row, aImage.width * sizeof(PIXEL32));
+	slot.width = aImage.width;
+	slot.height = aImage.height;
+	slot.stride = stride;
+	slot.left = aLeft;
+	slot.top = aTop;
+	slot.is_16bit = aIs16Bit;
+	int sequence = header.latest == 0x7FFFFFFF ? 1 : header.latest + 1;
+	AtomicWrite(&slot.sequence, sequence);
+	AtomicWrite(&header.latest, sequence);
+	return sequence;
+}
+
+
+
+int FrameRingLatest(FrameRing &aRing)
+// Returns the number of the newest frame, or 0 if none has been published yet.
+{
+	return AtomicRead(&aRing.header->latest);
+}
+
+
+
+int FrameRingPin(FrameRing &aRing, int aSequence, SearchImage &aImage, int &aLeft, int &aTop, bool &aIs16Bit)
+// Pins frame number aSequence (or the newest, if aSequence is 0) so that the producer leaves it alone,
+// and sets aImage to its pixels in the shared memory.  Returns the slot it is in, which the caller must
+// pass to FrameRingUnpin() when done, or -1 if the frame has already been replaced (or never existed) or
+// its size doesn't fit the ring.
+{
+	if (!aSequence && !(aSequence = FrameRingLatest(aRing)))
+		return -1;
+	for (int index = 0; index < aRing.slot_count; ++index)
+	{
+		FrameRingSlot &slot = Slot(aRing, index);
+		if (slot.sequence != aSequence) // Only a hint: checked again once pinned.
+			continue;
+		AtomicIncrement(&slot.readers);
+		if (AtomicRead(&slot.sequence) != aSequence)
+		{
+			AtomicDecrement(&slot.readers);
+			return -1;
+		}
+		// The slot is written by another process, so it must not be trusted to stay within the mapping:
+		int width = slot.width, height = slot.height, stride = slot.stride;
+		if (   width < 1 || width > aRing.max_width || height < 1 || height > aRing.max_height
+			|| stride < width || stride > AlignedStride(aRing.max_width, sizeof(PIXEL32))   )
+		{
+			AtomicDecrement(&slot.readers);
+			return -1;
+		}
+		SearchImage image = {(const PIXEL32 *)((unsigned char *)&slot + FRAME_RING_ALIGN), width, height, stride};
+		aImage = image;
+		aLeft = slot.left;
+		aTop = slot.top;
+		aIs16Bit = slot.is_16bit != 0;
+		AtomicIncrement(&aRing.ref_count);
+		return index;
+	}
+	return -1;
+}
+
+
+
+void FrameRingUnpin(FrameRing &aRing, int aSlot)
+{
+	AtomicDecrement(&Slot(aRing, aSlot).readers);
+	FrameRingClose(&aRing);
+}
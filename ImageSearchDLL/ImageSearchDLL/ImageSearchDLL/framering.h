@@ -0,0 +1,69 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// Frame rings: a few frames kept in named shared memory, so that one process (the producer) can capture
+// the screen and any number of others search the same frames in place, instead of each capturing its own.
+// Frames are numbered in the order they were published.  A consumer pins the frame it is searching, and
+// the producer never overwrites a pinned frame.  Like search.h, this does not depend on <windows.h>.
+//
+// Pins are counted in the shared memory, so a consumer that ends (or crashes) with a frame pinned leaves
+// that slot's count raised for good: the producer then never reuses the slot, and carries on with one
+// fewer until the ring is created afresh.  On POSIX systems that means after the name has been removed,
+// since the memory outlives the processes using it.
+
+#ifndef framering_h
+#define framering_h
+
+#include "search.h"
+
+#define FRAME_RING_MAGIC 0x474E5246 // "FRNG"
+#define FRAME_RING_VERSION 2
+#define FRAME_RING_MAX_SLOTS 64
+
+struct FrameRingHeader
+// At the start of the shared memory.
+{
+	unsigned int magic, version;
+	int slot_count, max_width, max_height;
+	volatile int latest;  // Number of the newest frame, or 0 before the first one.
+	int reserved[2];
+};
+
+struct FrameRingSlot
+// The header is followed by slot_count of these, each FRAME_RING_ALIGN bytes long, and each followed by
+// room for max_height rows of AlignedStride(max_width) pixels.
+{
+	volatile int sequence; // Number of the frame held, or 0 while it is being written (or before the first).
+	volatile int readers;  // Number of pins on the frame, from all processes.
+	int width, height;     // Pixels are stored top row first.
+	int stride;            // In pixels: AlignedStride(width), so that each row starts on a cache line.
+	int left, top;         // Screen coordinates of the upper-left pixel.
+	int is_16bit;
+};
+
+#define FRAME_RING_ALIGN SEARCH_ALIGN // Each slot and its pixels start on a multiple of this.
+
+struct FrameRing; // Defined in framering.cpp.
+
+FrameRing *FrameRingCreate(const char *aName, int aSlotCount, int aMaxWidth, int aMaxHeight);
+FrameRing *FrameRingOpen(const char *aName);
+void FrameRingClose(FrameRing *aRing);
+int FrameRingPublish(FrameRing &aRing, const SearchImage &aImage, int aLeft, int aTop, bool aIs16Bit);
+int FrameRingLatest(FrameRing &aRing);
+int FrameRingPin(FrameRing &aRing, int aSequence, SearchImage &aImage, int &aLeft, int &aTop, bool &aIs16Bit);
+void FrameRingUnpin(FrameRing &aRing, int aSlot);
+
+#endif
@@ -0,0 +1,842 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// No stdafx.h here: see imagedecode.h.
+// PNG: every color type and bit depth, interlaced or not, with transparency from an alpha channel or a
+// tRNS chunk.  The zlib stream is inflated here too, so nothing outside the C library is needed.
+// Ancillary chunks other than tRNS (gamma, color profiles and so on) are ignored, as are the CRCs.
+// BMP: uncompressed 1, 4, 8, 16, 24 and 32 bits per pixel, with or without bit field masks.  As with
+// LoadImage(), any alpha in a BMP is ignored.  RLE-compressed BMPs are left to LoadPicture().
+
+#include "imagedecode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DECODE_MAX_SIDE 32768         // Larger images are left to LoadPicture(), which is welcome to try.
+#define DECODE_MAX_PIXELS (1 << 26)
+
+
+
+///////////
+// Inflate
+///////////
+
+#define HUFFMAN_FAST_BITS 9 // Codes up to this long are decoded by a single table lookup.
+
+struct Huffman
+{
+	unsigned short fast[1 << HUFFMAN_FAST_BITS]; // (length << 9) | symbol, indexed by the next bits of input, or 0 if the code is longer.
+	unsigned short count[16];  // Number of codes of each length.
+	unsigned short symbol[288]; // Symbols in canonical order: by code length, then by value.
+};
+
+struct InflateState
+{
+	const unsigned char *in, *in_end;
+	unsigned long long bit_buf; // Bits not yet consumed, the next one lowest.
+	int bit_count;
+	int pad;                    // Number of zero bytes added to bit_buf after the input ran out.
+	unsigned char *out, *out_pos, *out_end;
+};
+
+static const unsigned short sLengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51
+	, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const unsigned char sLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4
+	, 5, 5, 5, 5, 0};
+static const unsigned short sDistBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513
+	, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const unsigned char sDistExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10
+	, 11, 11, 12, 12, 13, 13};
+
+
+
+static inline void Refill(InflateState &s)
+// Tops bit_buf up to at least 57 bits, with zeros past the end of the input (which a valid stream never reaches).
+{
+	while (s.bit_count <= 56)
+	{
+		if (s.in < s.in_end)
+			s.bit_buf |= (unsigned long long)*s.in++ << s.bit_count;
+		else
+			++s.pad;
+		s.bit_count += 8;
+	}
+}
+
+
+
+static inline unsigned int GetBits(InflateState &s, int aCount)
+// aCount may be up to 32.
+{
+	Refill(s);
+	unsigned int bits = (unsigned int)(s.bit_buf & ((1ULL << aCount) - 1));
+	s.bit_buf >>= aCount;
+	s.bit_count -= aCount;
+	return bits;
+}
+
+
+
+static bool HuffmanBuild(Huffman &h, const unsigned char *aLength, int aCount)
+// aLength holds the code length of each of aCount symbols, zero for those that don't occur.  Returns false
+// if the lengths describe more codes than there is room for.  Fewer is allowed: deflate uses a single
+// one-bit code when there is only one distance, and the missing code is then simply never decoded.
+{
+	int len, i;
+	memset(h.count, 0, sizeof(h.count));
+	for (i = 0; i < aCount; ++i)
+		++h.count[aLength[i]];
+	h.count[0] = 0;
+	int left = 1;
+	for (len = 1; len < 16; ++len)
+	{
+		left = (left << 1) - h.count[len];
+		if (left < 0)
+			return false;
+	}
+	unsigned short offset[16];
+	offset[1] = 0;
+	for (len = 1; len < 15; ++len)
+		offset[len + 1] = offset[len] + h.count[len];
+	for (i = 0; i < aCount; ++i)
+		if (aLength[i])
+			h.symbol[offset[aLength[i]]++] = (unsigned short)i;
+
+	// Deflate sends each code's first bit first, so the table is indexed by the reversed code, and every
+	// index whose low bits are that code (whatever bits follow it) gets the same entry.
+	memset(h.fast, 0, sizeof(h.fast));
+	int code = 0, index = 0;
+	for (len = 1; len <= HUFFMAN_FAST_BITS; ++len, code <<= 1)
+	{
+		for (i = 0; i < h.count[len]; ++i, ++code)
+		{
+			int reversed = 0;
+			for (int bit = 0; bit < len; ++bit)
+				reversed |= ((code >> bit) & 1) << (len - 1 - bit);
+			unsigned short entry = (unsigned short)((len << 9) | h.symbol[index++]);
+			for (int r = reversed; r < (1 << HUFFMAN_FAST_BITS); r += 1 << len)
+				h.fast[r] = entry;
+		}
+	}
+	return true;
+}
+
+
+
+static int HuffmanDecode(InflateState &s, const Huffman &h)
+// Returns the next symbol, or -1 if the input isn't a code of h.
+{
+	Refill(s);
+	unsigned int entry = h.fast[s.bit_buf & ((1 << HUFFMAN_FAST_BITS) - 1)];
+	if (entry)
+	{
+		s.bit_buf >>= entry >> 9;
+		s.bit_count -= entry >> 9;
+		return entry & 0x1FF;
+	}
+	// A code longer than the table covers: walk the canonical code one bit at a time.
+	int code = 0, first = 0, index = 0;
+	for (int len = 1; len < 16; ++len)
+	{
+		code |= (int)(s.bit_buf & 1);
+		s.bit_buf >>= 1;
+		--s.bit_count;
+		int count = h.count[len];
+		if (code - first < count)
+			return h.symbol[index + code - first];
+		index += count;
+		first = (first + count) << 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+
+
+static bool InflateCodes(InflateState &s, const Huffman &aLit, const Huffman &aDist)
+// Decodes one compressed block.
+{
+	for (;;)
+	{
+		int symbol = HuffmanDecode(s, aLit);
+		if (s.pad > 8) // Ran off the end of the input.
+			return false;
+		if (symbol < 256)
+		{
+			if (symbol < 0 || s.out_pos == s.out_end)
+				return false;
+			*s.out_pos++ = (unsigned char)symbol;
+			continue;
+		}
+		if (symbol == 256)
+			return true;
+		if ((symbol -= 257) >= 29)
+			return false;
+		int length = sLengthBase[symbol] + GetBits(s, sLengthExtra[symbol]);
+		if ((symbol = HuffmanDecode(s, aDist)) < 0 || symbol >= 30)
+			return false;
+		size_t distance = sDistBase[symbol] + GetBits(s, sDistExtra[symbol]);
+		if (distance > (size_t)(s.out_pos - s.out) || length > s.out_end - s.out_pos)
+			return false;
+		const unsigned char *from = s.out_pos - distance;
+		unsigned char *to = s.out_pos;
+		s.out_pos += length;
+		if (distance >= 8 && length >= 8)
+		{
+			// Copy in steps that can't read what they write: a short distance repeats the last few bytes.
+			while (length >= 8)
+			{
+				memcpy(to, from, 8);
+				to += 8, from += 8, length -= 8;
+			}
+		}
+		while (length--)
+			*to++ = *from++;
+	}
+}
+
+
+
+static bool InflateStored(InflateState &s)
+// Copies one stored (uncompressed) block.
+{
+	GetBits(s, s.bit_count & 7); // Skip to the next byte boundary.
+	unsigned int length = GetBits(s, 16);
+	if ((length ^ 0xFFFF) != GetBits(s, 16) || length > (size_t)(s.out_end - s.out_pos))
+		return false;
+	// Whole bytes already in bit_buf come first, except for any padding.
+	while (length && s.bit_count - 8 * s.pad >= 8)
+	{
+		*s.out_pos++ = (unsigned char)GetBits(s, 8);
+		--length;
+	}
+	if (length > (size_t)(s.in_end - s.in))
+		return false;
+	memcpy(s.out_pos, s.in, length);
+	s.out_pos += length;
+	s.in += length;
+	return true;
+}
+
+
+
+static bool Inflate(const unsigned char *aIn, size_t aInSize, unsigned char *aOut, size_t aOutSize)
+// Decompresses the zlib stream aIn, which must produce exactly aOutSize bytes.  The checksum isn't verified.
+{
+	if (aInSize < 2 || (aIn[0] & 0x0F) != 8 || (aIn[0] >> 4) > 7 || (aIn[1] & 0x20) // Deflate, 32K window, no dictionary.
+		|| ((aIn[0] << 8) | aIn[1]) % 31)
+		return false;
+	InflateState s;
+	s.in = aIn + 2;
+	s.in_end = aIn + aInSize;
+	s.bit_buf = 0;
+	s.bit_count = 0;
+	s.pad = 0;
+	s.out = s.out_pos = aOut;
+	s.out_end = aOut + aOutSize;
+
+	Huffman *lit = (Huffman *)malloc(2 * sizeof(Huffman)), *dist = lit + 1;
+	if (!lit)
+		return false;
+	unsigned char length[288 + 32];
+	bool last, ok;
+	do
+	{
+		last = GetBits(s, 1) != 0;
+		switch (GetBits(s, 2))
+		{
+		case 0:
+			ok = InflateStored(s);
+			break;
+		case 1: // Fixed codes.
+			memset(length, 8, 144);
+			memset(length + 144, 9, 112);
+			memset(length + 256, 7, 24);
+			memset(length + 280, 8, 8);
+			memset(length + 288, 5, 30);
+			ok = HuffmanBuild(*lit, length, 288) && HuffmanBuild(*dist, length + 288, 30) && InflateCodes(s, *lit, *dist);
+			break;
+		case 2: // Dynamic codes, preceded by the code lengths, themselves Huffman coded.
+		{
+			static const unsigned char order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+			int lit_count = GetBits(s, 5) + 257, dist_count = GetBits(s, 5) + 1, code_count = GetBits(s, 4) + 4, i;
+			memset(length, 0, 19);
+			for (i = 0; i < code_count; ++i)
+				length[order[i]] = (unsigned char)GetBits(s, 3);
+			if (   !(ok = lit_count <= 286 && dist_count <= 30 && HuffmanBuild(*lit, length, 19))   )
+				break;
+			for (i = 0; i < lit_count + dist_count && ok; )
+			{
+				int symbol = HuffmanDecode(s, *lit), repeat;
+				unsigned char value = 0;
+				if (symbol < 0)
+					ok = false;
+				else if (symbol < 16)
+					length[i++] = (unsigned char)symbol;
+				else
+				{
+					if (symbol == 16)
+					{
+						if (!i)
+						{
+							ok = false;
+							break;
+						}
+						value = length[i - 1];
+						repeat = 3 + GetBits(s, 2);
+					}
+					else if (symbol == 17)
+						repeat = 3 + GetBits(s, 3);
+					else
+						repeat = 11 + GetBits(s, 7);
+					if (i + repeat > lit_count + dist_count)
+						ok = false;
+					else
+						while (repeat--)
+							length[i++] = value;
+				}
+			}
+			ok = ok && s.pad <= 8 && length[256] // The end-of-block code must exist.
+				&& HuffmanBuild(*lit, length, lit_count) && HuffmanBuild(*dist, length + lit_count, dist_count)
+				&& InflateCodes(s, *lit, *dist);
+			break;
+		}
+		default:
+			ok = false;
+		}
+	} while (ok && !last);
+	free(lit);
+	return ok && s.out_pos == s.out_end;
+}
+
+
+
+///////
+// PNG
+///////
+
+static inline unsigned int ReadBE32(const unsigned char *p)
+{
+	return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+
+
+static inline int Paeth(int a, int b, int c)
+{
+	int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+
+
+static bool Unfilter(unsigned char *aRow, const unsigned char *aPrev, size_t aRowBytes, int aBpp)
+// Undoes the filter named by aRow[-1] in place.  aPrev is the unfiltered row above, or all zeros for
+// the first.  aBpp is the number of bytes per pixel, rounded up to 1.
+{
+	size_t i;
+	switch (aRow[-1])
+	{
+	case 0:
+		break;
+	case 1: // Sub
+		for (i = aBpp; i < aRowBytes; ++i)
+			aRow[i] = (unsigned char)(aRow[i] + aRow[i - aBpp]);
+		break;
+	case 2: // Up
+		for (i = 0; i < aRowBytes; ++i)
+			aRow[i] = (unsigned char)(aRow[i] + aPrev[i]);
+		break;
+	case 3: // Average
+		for (i = 0; i < (size_t)aBpp; ++i)
+			aRow[i] = (unsigned char)(aRow[i] + (aPrev[i] >> 1));
+		for (; i < aRowBytes; ++i)
+			aRow[i] = (unsigned char)(aRow[i] + ((aRow[i - aBpp] + aPrev[i]) >> 1));
+		break;
+	case 4: // Paeth
+		for (i = 0; i < (size_t)aBpp; ++i)
+			aRow[i] = (unsigned char)(aRow[i] + aPrev[i]);
+		for (; i < aRowBytes; ++i)
+			aRow[i] = (unsigned char)(aRow[i] + Paeth(aRow[i - aBpp], aPrev[i], aPrev[i - aBpp]));
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+
+
+struct PngInfo
+{
+	int width, height, depth, color_type, channels;
+	unsigned int palette[256]; // 0xAARRGGBB.
+	int palette_count;
+	bool has_trans_key;        // A tRNS chunk for color type 0 or 2: pixels with these raw samples are transparent.
+	unsigned int trans_key[3];
+};
+
+
+
+static inline void StorePixel(DecodedImage &aImage, size_t aIndex, unsigned int r, unsigned int g, unsigned int b
+	, unsigned int a)
+// Stores one pixel, blended over black as GDI+ did (so that *TransBlack still finds fully transparent ones).
+{
+	if (a == 255)
+		aImage.pixel[aIndex] = (r << 16) | (g << 8) | b;
+	else if (a)
+		aImage.pixel[aIndex] = (((r * a + 127) / 255) << 16) | (((g * a + 127) / 255) << 8) | ((b * a + 127) / 255);
+	else
+	{
+		aImage.pixel[aIndex] = 0;
+		aImage.mask[aIndex] = 1;
+	}
+}
+
+
+
+static bool PngStoreRow(const PngInfo &aInfo, const unsigned char *aRow, int aCount, DecodedImage &aImage
+	, size_t aIndex, int aStep)
+// Converts aCount unfiltered pixels of aRow to pixel[aIndex], pixel[aIndex + aStep], etc.
+{
+	int depth = aInfo.depth, x;
+	unsigned int r, g, b, a = 255;
+	if (depth == 8 && aInfo.color_type == 6) // The usual cases first.
+	{
+		for (x = 0; x < aCount; ++x, aRow += 4, aIndex += aStep)
+			StorePixel(aImage, aIndex, aRow[0], aRow[1], aRow[2], aRow[3]);
+		return true;
+	}
+	if (depth == 8 && aInfo.color_type == 2 && !aInfo.has_trans_key)
+	{
+		for (x = 0; x < aCount; ++x, aRow += 3, aIndex += aStep)
+			aImage.pixel[aIndex] = ((PIXEL32)aRow[0] << 16) | ((PIXEL32)aRow[1] << 8) | aRow[2];
+		return true;
+	}
+	unsigned int sample_max = (1 << depth) - 1;
+	for (x = 0; x < aCount; ++x, aIndex += aStep)
+	{
+		unsigned int sample[4];
+		for (int c = 0; c < aInfo.channels; ++c)
+		{
+			int i = x * aInfo.channels + c;
+			if (depth == 8)
+				sample[c] = aRow[i];
+			else if (depth == 16)
+				sample[c] = (aRow[2*i] << 8) | aRow[2*i + 1];
+			else
+				sample[c] = (aRow[(i * depth) >> 3] >> (8 - depth - ((i * depth) & 7))) & sample_max;
+		}
+		switch (aInfo.color_type)
+		{
+		case 3:
+			if ((int)sample[0] >= aInfo.palette_count)
+				return false;
+			StorePixel(aImage, aIndex, (aInfo.palette[sample[0]] >> 16) & 0xFF, (aInfo.palette[sample[0]] >> 8) & 0xFF
+				, aInfo.palette[sample[0]] & 0xFF, aInfo.palette[sample[0]] >> 24);
+			continue;
+		case 0:
+		case 4:
+			a = aInfo.color_type == 4 ? sample[1] : (aInfo.has_trans_key && sample[0] == aInfo.trans_key[0] ? 0 : sample_max);
+			r = g = b = sample[0];
+			break;
+		default: // 2 and 6.
+			a = aInfo.color_type == 6 ? sample[3] : (aInfo.has_trans_key && sample[0] == aInfo.trans_key[0]
+				&& sample[1] == aInfo.trans_key[1] && sample[2] == aInfo.trans_key[2] ? 0 : sample_max);
+			r = sample[0], g = sample[1], b = sample[2];
+		}
+		if (depth == 16)
+		{
+			r >>= 8, g >>= 8, b >>= 8;
+			// Alpha is rounded instead, and kept non-zero if it was: only fully transparent pixels are masked.
+			if (a && !(a = (a * 255 + 32767) / 65535))
+				a = 1;
+		}
+		else if (depth < 8) // Gray only: scale 0..sample_max up to 0..255.
+			r = g = b = r * 255 / sample_max, a = a ? 255 : 0;
+		StorePixel(aImage, aIndex, r, g, b, a);
+	}
+	return true;
+}
+
+
+
+static bool DecodePng(const unsigned char *aData, size_t aSize, DecodedImage &aImage)
+{
+	PngInfo info;
+	info.width = info.height = info.depth = info.color_type = info.channels = 0;
+	info.palette_count = 0;
+	info.has_trans_key = false;
+	bool interlaced = false, has_alpha = false;
+	const unsigned char *idat = NULL;
+	size_t idat_size = 0;
+	int idat_chunks = 0;
+
+	// Find the header, palette, transparency and image data.
+	size_t pos;
+	for (pos = 8; pos + 12 <= aSize; )
+	{
+		size_t length = ReadBE32(aData + pos);
+		const unsigned char *type = aData + pos + 4, *data = aData + pos + 8;
+		if (length > aSize - pos - 12)
+			return false;
+		pos += length + 12;
+		if (!memcmp(type, "IHDR", 4))
+		{
+			if (length < 13)
+				return false;
+			info.width = (int)ReadBE32(data);
+			info.height = (int)ReadBE32(data + 4);
+			info.depth = data[8];
+			info.color_type = data[9];
+			interlaced = data[12] == 1;
+			static const int channels[7] = {1, 0, 3, 1, 2, 0, 4};
+			if (info.width < 1 || info.width > DECODE_MAX_SIDE || info.height < 1 || info.height > DECODE_MAX_SIDE
+				|| (size_t)info.width * info.height > DECODE_MAX_PIXELS || info.color_type > 6
+				|| !(info.channels = channels[info.color_type]) || data[10] || data[11] || data[12] > 1)
+				return false;
+			switch (info.depth)
+			{
+			case 1: case 2: case 4: if (info.color_type != 0 && info.color_type != 3) return false; break;
+			case 8: break;
+			case 16: if (info.color_type == 3) return false; break;
+			default: return false;
+			}
+			has_alpha = info.color_type == 4 || info.color_type == 6;
+		}
+		else if (!info.width) // IHDR must come first.
+			return false;
+		else if (!memcmp(type, "PLTE", 4))
+		{
+			info.palette_count = (int)(length / 3) > 256 ? 256 : (int)(length / 3);
+			for (int i = 0; i < info.palette_count; ++i)
+				info.palette[i] = 0xFF000000 | ((unsigned int)data[3*i] << 16) | ((unsigned int)data[3*i + 1] << 8) | data[3*i + 2];
+		}
+		else if (!memcmp(type, "tRNS", 4))
+		{
+			if (info.color_type == 3)
+			{
+				for (size_t i = 0; i < length && i < (size_t)info.palette_count; ++i)
+					info.palette[i] = (info.palette[i] & 0x00FFFFFF) | ((unsigned int)data[i] << 24);
+				has_alpha = true;
+			}
+			else if (!has_alpha && length >= (size_t)(info.channels * 2))
+			{
+				for (int c = 0; c < info.channels; ++c)
+					info.trans_key[c] = (data[2*c] << 8) | data[2*c + 1];
+				has_alpha = info.has_trans_key = true;
+			}
+		}
+		else if (!memcmp(type, "IDAT", 4))
+		{
+			if (!idat_chunks++)
+				idat = data;
+			idat_size += length;
+		}
+		else if (!memcmp(type, "IEND", 4))
+			break;
+	}
+	if (!idat_chunks || (info.color_type == 3 && !info.palette_count))
+		return false;
+
+	// IDAT chunks are usually one block; if not, join them.
+	unsigned char *joined = NULL;
+	if (idat_chunks > 1)
+	{
+		if (   !(joined = (unsigned char *)malloc(idat_size))   )
+			return false;
+		size_t joined_size = 0;
+		for (pos = 8; pos + 12 <= aSize && joined_size < idat_size; )
+		{
+			size_t length = ReadBE32(aData + pos);
+			if (!memcmp(aData + pos + 4, "IDAT", 4))
+			{
+				memcpy(joined + joined_size, aData + pos + 8, length);
+				joined_size += length;
+			}
+			pos += length + 12;
+		}
+		idat = joined;
+	}
+
+	// The seven passes of Adam7, or the whole image as a single pass.
+	static const int adam7[7][4] = {{0, 0, 8, 8}, {4, 0, 8, 8}, {0, 4, 4, 8}, {2, 0, 4, 4}, {0, 2, 2, 4}, {1, 0, 2, 2}
+		, {0, 1, 1, 2}};
+	static const int single[1][4] = {{0, 0, 1, 1}};
+	const int (*pass)[4] = interlaced ? adam7 : single;
+	int pass_count = interlaced ? 7 : 1, p;
+	int bits_per_pixel = info.channels * info.depth, bpp = bits_per_pixel < 8 ? 1 : bits_per_pixel / 8;
+	size_t raw_size = 0, max_row_bytes = ((size_t)info.width * bits_per_pixel + 7) / 8;
+	for (p = 0; p < pass_count; ++p)
+	{
+		size_t w = (info.width - pass[p][0] + pass[p][2] - 1) / pass[p][2], h = (info.height - pass[p][1] + pass[p][3] - 1) / pass[p][3];
+		if (w && h)
+			raw_size += h * (1 + (w * bits_per_pixel + 7) / 8);
+	}
+
+	bool ok = false;
+	unsigned char *raw = (unsigned char *)malloc(raw_size + max_row_bytes); // The extra is a row of zeros for "the row above" the first.
+	aImage.width = info.width;
+	aImage.height = info.height;
+	aImage.is_16bit = false;
+	aImage.pixel = (PIXEL32 *)malloc((size_t)info.width * info.height * sizeof(PIXEL32));
+	aImage.mask = has_alpha ? (PIXEL32 *)calloc((size_t)info.width * info.height, sizeof(PIXEL32)) : NULL;
+	if (raw && aImage.pixel && (aImage.mask || !has_alpha) && Inflate(idat, idat_size, raw, raw_size))
+	{
+		unsigned char *zero_row = raw + raw_size, *row = raw;
+		memset(zero_row, 0, max_row_bytes);
+		for (ok = true, p = 0; p < pass_count && ok; ++p)
+		{
+			int w = (info.width - pass[p][0] + pass[p][2] - 1) / pass[p][2], h = (info.height - pass[p][1] + pass[p][3] - 1) / pass[p][3];
+			if (!w || !h)
+				continue;
+			size_t row_bytes = ((size_t)w * bits_per_pixel + 7) / 8;
+			const unsigned char *prev = zero_row;
+			for (int y = 0; y < h && ok; ++y, prev = row + 1, row += row_bytes + 1)
+				ok = Unfilter(row + 1, prev, row_bytes, bpp)
+					&& PngStoreRow(info, row + 1, w, aImage, (size_t)(pass[p][1] + y * pass[p][3]) * info.width + pass[p][0]
+						, pass[p][2]);
+		}
+	}
+	free(raw);
+	free(joined);
+	if (!ok)
+	{
+		ImageDecodeFree(aImage);
+		return false;
+	}
+	if (aImage.mask) // Drop the mask if nothing turned out to be transparent.
+	{
+		size_t i, count = (size_t)info.width * info.height;
+		for (i = 0; i < count && !aImage.mask[i]; ++i);
+		if (i == count)
+		{
+			free(aImage.mask);
+			aImage.mask = NULL;
+		}
+	}
+	return true;
+}
+
+
+
+///////
+// BMP
+///////
+
+static inline unsigned int ReadLE32(const unsigned char *p)
+{
+	return p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+
+
+static inline unsigned int ReadLE16(const unsigned char *p)
+{
+	return p[0] | ((unsigned int)p[1] << 8);
+}
+
+
+
+struct BitField
+{
+	unsigned int mask;
+	int shift, bits;
+};
+
+
+
+static void BitFieldInit(BitField &aField, unsigned int aMask)
+{
+	aField.mask = aMask;
+	aField.shift = aField.bits = 0;
+	if (aMask)
+	{
+		for (; !(aMask & 1); aMask >>= 1)
+			++aField.shift;
+		for (; aMask & 1; aMask >>= 1)
+			++aField.bits;
+	}
+}
+
+
+
+static inline unsigned int BitFieldGet(const BitField &aField, unsigned int aPixel)
+// Returns the field's value scaled to 8 bits, by dropping or appending low bits as GetDIBits() does.
+{
+	unsigned int value = (aPixel & aField.mask) >> aField.shift;
+	return aField.bits >= 8 ? value >> (aField.bits - 8) : value << (8 - aField.bits);
+}
+
+
+
+static bool DecodeBmp(const unsigned char *aData, size_t aSize, DecodedImage &aImage)
+{
+	if (aSize < 26)
+		return false;
+	size_t bits_offset = ReadLE32(aData + 10), header_size = ReadLE32(aData + 14), palette_offset = 14 + header_size;
+	int width, height, bit_count, palette_count, palette_entry_size;
+	unsigned int compression;
+	if (header_size == 12) // BITMAPCOREHEADER
+	{
+		width = (int)ReadLE16(aData + 18);
+		height = (int)ReadLE16(aData + 20);
+		bit_count = (int)ReadLE16(aData + 24);
+		compression = 0;
+		palette_count = bit_count <= 8 ? 1 << bit_count : 0;
+		palette_entry_size = 3;
+	}
+	else if (header_size >= 40 && aSize >= 54) // BITMAPINFOHEADER, or a later version of it.
+	{
+		width = (int)ReadLE32(aData + 18);
+		height = (int)ReadLE32(aData + 22);
+		bit_count = (int)ReadLE16(aData + 28);
+		compression = ReadLE32(aData + 30);
+		palette_count = (int)ReadLE32(aData + 46);
+		if (bit_count <= 8 && (!palette_count || palette_count > (1 << bit_count)))
+			palette_count = 1 << bit_count;
+		palette_entry_size = 4;
+		if (header_size == 40 && (compression == 3 || compression == 6))
+			palette_offset += compression == 3 ? 12 : 16; // The masks follow the header instead of being part of it.
+	}
+	else
+		return false;
+	bool top_down = height < 0;
+	if (top_down)
+		height = -height;
+	if (width < 1 || width > DECODE_MAX_SIDE || height < 1 || height > DECODE_MAX_SIDE
+		|| (size_t)width * height > DECODE_MAX_PIXELS)
+		return false;
+
+	// Which bit field masks apply: BI_RGB has fixed ones, BI_BITFIELDS and BI_ALPHABITFIELDS give their own.
+	BitField field[3];
+	switch (bit_count)
+	{
+	case 1: case 4: case 8:
+		if (compression != 0 || palette_offset + (size_t)palette_count * palette_entry_size > aSize)
+			return false;
+		break;
+	case 24:
+		if (compression != 0)
+			return false;
+		// Fall through.
+	case 16: case 32:
+		if (compression == 0)
+		{
+			unsigned int rgb_bits = bit_count == 16 ? 5 : 8;
+			BitFieldInit(field[0], ((1 << rgb_bits) - 1) << (2 * rgb_bits));
+			BitFieldInit(field[1], ((1 << rgb_bits) - 1) << rgb_bits);
+			BitFieldInit(field[2], (1 << rgb_bits) - 1);
+		}
+		else if ((compression == 3 || compression == 6) && aSize >= 66)
+			for (int c = 0; c < 3; ++c)
+				BitFieldInit(field[c], ReadLE32(aData + 54 + 4*c));
+		else
+			return false;
+		break;
+	default:
+		return false;
+	}
+	size_t stride = (((size_t)width * bit_count + 31) / 32) * 4;
+	if (bits_offset > aSize || stride * height > aSize - bits_offset)
+		return false;
+
+	aImage.width = width;
+	aImage.height = height;
+	aImage.is_16bit = bit_count == 16;
+	aImage.mask = NULL;
+	if (   !(aImage.pixel = (PIXEL32 *)malloc((size_t)width * height * sizeof(PIXEL32)))   )
+		return false;
+	PIXEL32 palette[256];
+	for (int i = 0; i < palette_count && bit_count <= 8; ++i)
+	{
+		const unsigned char *entry = aData + palette_offset + (size_t)i * palette_entry_size; // Blue, green, red.
+		palette[i] = ((PIXEL32)entry[2] << 16) | ((PIXEL32)entry[1] << 8) | entry[0];
+	}
+	for (int y = 0; y < height; ++y)
+	{
+		const unsigned char *src = aData + bits_offset + stride * (top_down ? y : height - 1 - y);
+		PIXEL32 *dst = aImage.pixel + (size_t)y * width;
+		int x;
+		switch (bit_count)
+		{
+		case 24:
+			for (x = 0; x < width; ++x, src += 3)
+				dst[x] = ((PIXEL32)src[2] << 16) | ((PIXEL32)src[1] << 8) | src[0];
+			break;
+		case 16:
+		case 32:
+			for (x = 0; x < width; ++x, src += bit_count / 8)
+			{
+				unsigned int value = bit_count == 16 ? ReadLE16(src) : ReadLE32(src);
+				dst[x] = (BitFieldGet(field[0], value) << 16) | (BitFieldGet(field[1], value) << 8) | BitFieldGet(field[2], value);
+			}
+			break;
+		default: // 1, 4 or 8.
+			for (x = 0; x < width; ++x)
+			{
+				int index = (src[(x * bit_count) >> 3] >> (8 - bit_count - ((x * bit_count) & 7))) & ((1 << bit_count) - 1);
+				dst[x] = index < palette_count ? palette[index] : 0;
+			}
+		}
+	}
+	return true;
+}
+
+
+
+bool ImageDecodeMemory(const unsigned char *aData, size_t aSize, DecodedImage &aImage)
+{
+	aImage.pixel = aImage.mask = NULL;
+	if (aSize >= 8 && !memcmp(aData, "\x89PNG\r\n\x1A\n", 8))
+		return DecodePng(aData, aSize, aImage);
+	if (aSize >= 2 && aData[0] == 'B' && aData[1] == 'M')
+		return DecodeBmp(aData, aSize, aImage);
+	return false;
+}
+
+
+
+bool ImageDecodeFile(const char *aFile, DecodedImage &aImage)
+// Only the signature is read from a file of any other type.
+{
+	aImage.pixel = aImage.mask = NULL;
+	FILE *fp = fopen(aFile, "rb");
+	if (!fp)
+		return false;
+	unsigned char signature[8];
+	unsigned char *data = NULL;
+	long size;
+	bool ok = fread(signature, 1, 8, fp) == 8
+		&& (!memcmp(signature, "\x89PNG\r\n\x1A\n", 8) || (signature[0] == 'B' && signature[1] == 'M'))
+		&& !fseek(fp, 0, SEEK_END) && (size = ftell(fp)) > 0 && !fseek(fp, 0, SEEK_SET)
+		&& (data = (unsigned char *)malloc(size)) && fread(data, 1, size, fp) == (size_t)size;
+	fclose(fp);
+	if (ok)
+		ok = ImageDecodeMemory(data, size, aImage);
+	free(data);
+	return ok;
+}
+
+
+
+void ImageDecodeFree(DecodedImage &aImage)
+{
+	free(aImage.pixel);
+	free(aImage.mask);
+	aImage.pixel = aImage.mask = NULL;
+}
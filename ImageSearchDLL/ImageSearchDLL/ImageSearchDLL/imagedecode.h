@@ -0,0 +1,42 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// A built-in decoder for the PNG and BMP files that images to search for are nearly always kept in, so
+// that loading them needs neither GDI+ nor OleLoadPicture() nor a round trip through an HBITMAP and
+// GetDIBits().  Like search.h, this does not depend on <windows.h>.
+
+#ifndef imagedecode_h
+#define imagedecode_h
+
+#include "search.h"
+
+struct DecodedImage
+{
+	int width, height;
+	PIXEL32 *pixel; // width*height pixels, top row first, in the same 0x00RRGGBB layout as getbits() produces.
+	PIXEL32 *mask;  // NULL if every pixel is opaque.  Otherwise width*height pixels laid out like an icon's
+	                // AND-mask for NeedleCreate(): non-zero where the image is fully transparent.
+	bool is_16bit;  // The file stores 16 bits per pixel, so it should be compared with SEARCH_COLOR_MASK_16BIT.
+};
+
+// Both return false, without allocating anything, if the data isn't a PNG or BMP this decoder supports
+// (the caller can then fall back to LoadPicture()) or is corrupt.  On success, the caller must
+// ImageDecodeFree() the result.
+bool ImageDecodeFile(const char *aFile, DecodedImage &aImage);
+bool ImageDecodeMemory(const unsigned char *aData, size_t aSize, DecodedImage &aImage);
+void ImageDecodeFree(DecodedImage &aImage);
+
+#endif
@@ -0,0 +1,102 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// The imagepack tool, which makes a needle pack (see needlepack.h) from PNG and BMP files.  It is not part
+// of the DLL: build it with the portable engine files as described in "How to compile.txt".
+//
+// Usage: imagepack <pack file> [*TransRRGGBB | *TransNone] <image file>...
+//
+// Each needle is named after its image file as given, without the extension, and its id within the pack
+// is its position in the list, starting at 0.  A *Trans option makes the given color transparent in the
+// images after it, as it does in ImageSearch(); transparent PNG pixels are always transparent.
+
+#include "needlepack.h"
+#include "imagedecode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "Usage: imagepack <pack file> [*TransRRGGBB | *TransNone] <image file>...\n");
+		return 2;
+	}
+	SearchNeedle **needle = (SearchNeedle **)malloc(argc * sizeof(SearchNeedle *));
+	char **name = (char **)malloc(argc * sizeof(char *));
+	if (!needle || !name)
+		return 1;
+	PIXEL32 trans_color = SEARCH_NO_TRANS;
+	int count = 0, i, pixel_total = 0;
+	for (i = 2; i < argc; ++i)
+	{
+		const char *arg = argv[i];
+		if (*arg == '*')
+		{
+			if (!strncmp(arg + 1, "Trans", 5) || !strncmp(arg + 1, "trans", 5))
+				trans_color = strcmp(arg + 6, "None") && strcmp(arg + 6, "none")
+					? (PIXEL32)strtoul(arg + 6, NULL, 16) : SEARCH_NO_TRANS;
+			else
+			{
+				fprintf(stderr, "imagepack: unknown option %s\n", arg);
+				return 2;
+			}
+			continue;
+		}
+		DecodedImage image;
+		if (!ImageDecodeFile(arg, image))
+		{
+			fprintf(stderr, "imagepack: %s is not a PNG or BMP file that can be decoded\n", arg);
+			return 1;
+		}
+		SearchImage pixels = {image.pixel, image.width, image.height, image.width};
+		SearchImage mask = {image.mask, image.width, image.height, image.width};
+		// Packed needles always use the full color mask; see LoadNeedle() for 16-bit screens.
+		needle[count] = NeedleCreate(pixels, image.mask ? &mask : NULL, trans_color, SEARCH_COLOR_MASK);
+		ImageDecodeFree(image);
+		if (!needle[count] || !(name[count] = (char *)malloc(strlen(arg) + 1)))
+			return 1;
+		strcpy(name[count], arg);
+		char *ext = strrchr(name[count], '.');
+		if (ext && !strpbrk(ext, "/\\")) // A dot in a directory name isn't an extension.
+			*ext = '\0';
+		pixel_total += image.width * image.height;
+		++count;
+	}
+	if (!count)
+	{
+		fprintf(stderr, "imagepack: no images given\n");
+		return 2;
+	}
+	bool ok = PackWrite(argv[1], name, needle, count);
+	if (ok)
+		printf("%s: %d images, %d pixels\n", argv[1], count, pixel_total);
+	else
+		fprintf(stderr, "imagepack: could not write %s (or two images have the same name)\n", argv[1]);
+	for (i = 0; i < count; ++i)
+	{
+		if (ok)
+			printf("%5d %s\n", i, name[i]);
+		NeedleRelease(needle[i]);
+		free(name[i]);
+	}
+	free(needle);
+	free(name);
+	return ok ? 0 : 1;
+}
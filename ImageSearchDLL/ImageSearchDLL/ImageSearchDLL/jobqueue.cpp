@@ -0,0 +1,293 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+
+// No stdafx.h here: see jobqueue.h.
+#include "jobqueue.h"
+#include "platform.h"
+#include <stddef.h>
+
+#define JOB_MAX_THREADS 16
+
+struct Job
+{
+	int id;                   // 0 if this slot is free.
+	int status;
+	volatile int cancel;      // Set by JobCancel(): the job is skipped, or asked to give up if already running.
+	bool released;            // JobRelease() was called before the job finished, so free it once it does.
+	JobRunFunc run;
+	JobFreeFunc free_func;
+	void *param;
+	int result;
+	PlatformSemaphore *done;  // Posted when the job finishes.  Created along with the slot's first job and kept.
+	int waiters;              // Threads in JobWait() on done.  The slot isn't reused until they have all left it.
+};
+
+static PlatformMutex *volatile sLock = NULL; // Guards everything below.
+static PlatformSemaphore *sWork = NULL;      // Posted once for each job put in the queue.
+static Job sJob[JOB_MAX];
+static int sQueue[JOB_MAX];                  // Indexes into sJob of the jobs waiting to run, oldest first.
+static int sQueueHead = 0, sQueueCount = 0;
+static int sNextId = 1;
+static int sThreads = 1;                     // Desired number of background threads.
+static int sWorkerCount = 0;                 // Number started so far.  They are never ended.
+
+
+
+static PlatformMutex *JobLock()
+// Returns the lock, creating it on first use, or NULL if it can't be created.
+{
+	PlatformMutex *lock = (PlatformMutex *)AtomicCompareExchangePointer((void *volatile *)&sLock, NULL, NULL);
+	if (!lock && (lock = MutexCreate()))
+	{
+		PlatformMutex *existing = (PlatformMutex *)AtomicCompareExchangePointer((void *volatile *)&sLock, lock, NULL);
+		if (existing) // Another thread got there first.
+		{
+			MutexDestroy(lock);
+			lock = existing;
+		}
+	}
+	return lock;
+}
+
+
+
+static Job *FindJob(int aJob)
+// Must be called with the lock held.  Returns NULL if there is no such job.
+{
+	if (aJob < 1)
+		return NULL;
+	for (int i = 0; i < JOB_MAX; ++i)
+		if (sJob[i].id == aJob)
+			return &sJob[i];
+	return NULL;
+}
+
+
+
+static void FreeJob(Job &aJob)
+// Must be called with the lock held.
+{
+	if (aJob.free_func)
+		aJob.free_func(aJob.param);
+	aJob.id = 0;
+}
+
+
+
+static void FinishJob(Job &aJob, int aStatus)
+// Must be called with the lock held.
+{
+	aJob.status = aStatus;
+	if (aJob.released)
+		FreeJob(aJob);
+	// Posted even for a released job, since another thread may be in JobWait() for it: it wakes and finds
+	// the job gone.  JobSubmit() takes back what is left posted once no thread is waiting on the slot.
+	SemaphorePost(aJob.done, 1);
+}
+
+
+
+static void WorkerThread(void *aLock)
+{
+	PlatformMutex *lock = (PlatformMutex *)aLock;
+	for (;;)
+	{
+		SemaphoreWait(sWork);
+		MutexLock(lock);
+		Job &job = sJob[sQueue[sQueueHead]];
+		sQueueHead = (sQueueHead + 1) % JOB_MAX;
+		--sQueueCount;
+		if (job.cancel)
+		{
+			FinishJob(job, JOB_CANCELLED);
+			MutexUnlock(lock);
+			continue;
+		}
+		job.status = JOB_RUNNING;
+		MutexUnlock(lock);
+		int result = job.run(job.param, &job.cancel); // Nothing else touches the slot while it's running.
+		MutexLock(lock);
+		job.result = result;
+		FinishJob(job, job.cancel ? JOB_CANCELLED : JOB_DONE);
+		MutexUnlock(lock);
+	}
+}
+
+
+
+void JobSetThreads(int aCount)
+// aCount is the number of background threads that run jobs, so at most that many run at once.  The default
+// is 1, which runs jobs one at a time in the order they were submitted.  0 means one per CPU.
+// Threads already started are kept even if aCount is lowered.
+{
+	PlatformMutex *lock = JobLock();
+	if (!lock)
+		return;
+	if (aCount < 1)
+		aCount = CpuCount();
+	if (aCount > JOB_MAX_THREADS)
+		aCount = JOB_MAX_THREADS;
+	MutexLock(lock);
+	sThreads = aCount;
+	MutexUnlock(lock);
+}
+
+
+
+int JobSubmit(JobRunFunc aRun, JobFreeFunc aFree, void *aParam)
+// Queues aRun(aParam, cancel) to be run on a background thread.  aFree(aParam) (if not NULL) is called once
+// the job has been released and has finished, but not if this fails, in which case aParam still belongs to
+// the caller.  Returns the job's id, which is always positive, 0 if JOB_MAX jobs already exist (the queue
+// is full, counting released jobs that a JobWait() is still returning from), or -1 on failure.  The caller
+// must eventually JobRelease() the id.
+{
+	PlatformMutex *lock = JobLock();
+	if (!lock)
+		return -1;
+	MutexLock(lock);
+	int id = -1, i;
+	for (i = 0; i < JOB_MAX && (sJob[i].id || sJob[i].waiters); ++i);
+	if (i == JOB_MAX)
+	{
+		id = 0;
+		goto end;
+	}
+	if (!sWork && !(sWork = SemaphoreCreate(0)))
+		goto end;
+	if (!sJob[i].done && !(sJob[i].done = SemaphoreCreate(0)))
+		goto end;
+	while (SemaphoreWaitTimeout(sJob[i].done, 0)); // Left posted by the slot's last job, and no one waits on it.
+	if (!sWorkerCount && !ModulePin()) // The workers run until the process ends.
+		goto end;
+	while (sWorkerCount < sThreads && ThreadStart(WorkerThread, lock))
+		++sWorkerCount;
+	if (!sWorkerCount)
+		goto end;
+
+	id = sNextId;
+	sNextId = sNextId == 0x7FFFFFFF ? 1 : sNextId + 1;
+	sJob[i].id = id;
+	sJob[i].status = JOB_QUEUED;
+	sJob[i].cancel = 0;
+	sJob[i].released = false;
+	sJob[i].run = aRun;
+	sJob[i].free_func = aFree;
+	sJob[i].param = aParam;
+	sJob[i].result = 0;
+	sQueue[(sQueueHead + sQueueCount++) % JOB_MAX] = i;
+	SemaphorePost(sWork, 1);
+end:
+	MutexUnlock(lock);
+	return id;
+}
+
+
+
+int JobWait(int aJob, int aTimeout)
+// Waits up to aTimeout milliseconds (0 to just check, negative for as long as it takes) for a job to finish.
+// Returns its status: JOB_DONE or JOB_CANCELLED if it has finished.
+{
+	PlatformMutex *lock = JobLock();
+	if (!lock)
+		return JOB_UNKNOWN;
+	MutexLock(lock);
+	Job *job = FindJob(aJob);
+	int status = job ? job->status : JOB_UNKNOWN;
+	if ((status == JOB_QUEUED || status == JOB_RUNNING) && aTimeout)
+	{
+		Job &slot = *job; // Kept by JobSubmit() for this job, even once it is released, until waiters is 0.
+		++slot.waiters;
+		MutexUnlock(lock);
+		if (SemaphoreWaitTimeout(slot.done, aTimeout))
+			SemaphorePost(slot.done, 1); // Leave it posted for anyone else waiting for the same job.
+		MutexLock(lock);
+		--slot.waiters;
+		job = FindJob(aJob);
+		status = job ? job->status : JOB_UNKNOWN;
+	}
+	MutexUnlock(lock);
+	return status;
+}
+
+
+
+void *JobResult(int aJob, int &aResult)
+// Returns the aParam given to JobSubmit() for a job that is JOB_DONE, and sets aResult to what it returned,
+// or returns NULL if the job hasn't finished or was cancelled.  aParam remains valid until JobRelease().
+{
+	PlatformMutex *lock = JobLock();
+	if (!lock)
+		return NULL;
+	MutexLock(lock);
+	Job *job = FindJob(aJob);
+	void *param = NULL;
+	if (job && job->status == JOB_DONE)
+	{
+		param = job->param;
+		aResult = job->result;
+	}
+	MutexUnlock(lock);
+	return param;
+}
+
+
+
+int JobCancel(int aJob)
+// Cancels a job that hasn't finished, or all of them if aJob is 0.  A queued job is never run, and a running
+// one is asked to give up early; either way it finishes as JOB_CANCELLED.
+// Returns the number of jobs cancelled.
+{
+	PlatformMutex *lock = JobLock();
+	if (!lock)
+		return 0;
+	MutexLock(lock);
+	int cancelled = 0;
+	for (int i = 0; i < JOB_MAX; ++i)
+	{
+		Job &job = sJob[i];
+		if (job.id && (!aJob || job.id == aJob) && (job.status == JOB_QUEUED || job.status == JOB_RUNNING))
+		{
+			job.cancel = 1;
+			++cancelled;
+		}
+	}
+	MutexUnlock(lock);
+	return cancelled;
+}
+
+
+
+void JobRelease(int aJob)
+// Frees a job and its id.  If it hasn't finished, it is cancelled and freed once it does.
+{
+	PlatformMutex *lock = JobLock();
+	if (!lock)
+		return;
+	MutexLock(lock);
+	Job *job = FindJob(aJob);
+	if (job)
+	{
+		if (job->status == JOB_QUEUED || job->status == JOB_RUNNING)
+		{
+			job->cancel = 1;
+			job->released = true;
+		}
+		else
+			FreeJob(*job);
+	}
+	MutexUnlock(lock);
+}
@@ -0,0 +1,44 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// A bounded queue of jobs run in order by background threads, so that a caller that can't afford to block
+// (such as a single-threaded AutoIt script) can start a search, carry on with other work, and collect the
+// result later.  Like threadpool.h, this does not depend on <windows.h>.
+
+#ifndef jobqueue_h
+#define jobqueue_h
+
+#define JOB_MAX 64 // Most jobs that can exist at once, counting finished ones that haven't been released.
+
+// What JobWait() returns:
+#define JOB_UNKNOWN -1  // No such job, or it has been released.
+#define JOB_QUEUED 0
+#define JOB_RUNNING 1
+#define JOB_DONE 2
+#define JOB_CANCELLED 3 // Cancelled before it could finish, so it has no result.
+
+// Runs a job and returns its result.  Long jobs should give up early once *aCancel is non-zero.
+typedef int (*JobRunFunc)(void *aParam, volatile int *aCancel);
+typedef void (*JobFreeFunc)(void *aParam);
+
+void JobSetThreads(int aCount);
+int JobSubmit(JobRunFunc aRun, JobFreeFunc aFree, void *aParam);
+int JobWait(int aJob, int aTimeout);
+void *JobResult(int aJob, int &aResult);
+int JobCancel(int aJob);
+void JobRelease(int aJob);
+
+#endif
@@ -0,0 +1,360 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// No stdafx.h here: see needlecache.h.
+#include "needlecache.h"
+#include "platform.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define stricmp_portable _stricmp
+#else
+#include <strings.h>
+#define stricmp_portable strcasecmp
+#endif
+
+#define NEEDLE_CACHE_BUCKETS 1024 // Power of two.
+
+struct CacheEntry
+{
+	CacheEntry *hash_next;            // Next entry in the same bucket.
+	CacheEntry *lru_prev, *lru_next;  // Most recently used entries are at the head of the list.
+	unsigned int hash;
+	FileStamp stamp;
+	SearchNeedle *needle;
+	char *options; // Points into the same block as file.
+	char file[1];  // Variable length: the file name, its terminator, then the options.
+};
+
+static CacheEntry *sBucket[NEEDLE_CACHE_BUCKETS];
+static CacheEntry *sLruHead = NULL, *sLruTail = NULL;
+static int sEntryCount = 0;
+static int sCapacity = NEEDLE_CACHE_DEFAULT_CAPACITY;
+
+struct RegionEntry
+{
+	RegionEntry *next; // Most recently used entries are first.
+	FileStamp stamp;
+	SearchRegion *region;
+	char key[1];       // Variable length.
+};
+
+static RegionEntry *sRegionHead = NULL;
+static int sRegionCount = 0;
+static PlatformMutex *volatile sLock = NULL; // Guards all of the above: searches may run on several threads.
+
+
+
+bool FileStampGet(const char *aFile, FileStamp &aStamp)
+// Returns false if the file doesn't exist.
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(aFile, &st))
+		return false;
+#else
+	struct stat st;
+	if (stat(aFile, &st))
+		return false;
+#endif
+	aStamp.mtime = (long long)st.st_mtime;
+	aStamp.size = (long long)st.st_size;
+	return true;
+}
+
+
+
+static PlatformMutex *CacheLock()
+// Returns the lock, creating it on first use, or NULL if it can't be created (in which case the cache is
+// not used at all).
+{
+	PlatformMutex *lock = (PlatformMutex *)AtomicCompareExchangePointer((void *volatile *)&sLock, NULL, NULL);
+	if (!lock && (lock = MutexCreate()))
+	{
+		PlatformMutex *existing = (PlatformMutex *)AtomicCompareExchangePointer((void *volatile *)&sLock, lock, NULL);
+		if (existing) // Another thread got there first.
+		{
+			MutexDestroy(lock);
+			lock = existing;
+		}
+	}
+	return lock;
+}
+
+
+
+static unsigned int HashKey(const char *aFile, const char *aOptions)
+// FNV-1a.  File names are hashed case-insensitively because that is how Windows treats them.
+{
+	unsigned int hash = 2166136261U;
+	for (const char *cp = aFile; *cp; ++cp)
+		hash = (hash ^ (unsigned char)(*cp >= 'A' && *cp <= 'Z' ? *cp + ('a' - 'A') : *cp)) * 16777619U;
+	hash = (hash ^ '|') * 16777619U;
+	for (const char *cp = aOptions; *cp; ++cp)
+		hash = (hash ^ (unsigned char)*cp) * 16777619U;
+	return hash;
+}
+
+
+
+static CacheEntry *FindEntry(const char *aFile, const char *aOptions, unsigned int aHash)
+{
+	for (CacheEntry *entry = sBucket[aHash & (NEEDLE_CACHE_BUCKETS - 1)]; entry; entry = entry->hash_next)
+		if (entry->hash == aHash && !stricmp_portable(entry->file, aFile) && !strcmp(entry->options, aOptions))
+			return entry;
+	return NULL;
+}
+
+
+
+static void LruUnlink(CacheEntry *aEntry)
+{
+	if (aEntry->lru_prev)
+		aEntry->lru_prev->lru_next = aEntry->lru_next;
+	else
+		sLruHead = aEntry->lru_next;
+	if (aEntry->lru_next)
+		aEntry->lru_next->lru_prev = aEntry->lru_prev;
+	else
+		sLruTail = aEntry->lru_prev;
+}
+
+
+
+static void LruPushFront(CacheEntry *aEntry)
+{
+	aEntry->lru_prev = NULL;
+	aEntry->lru_next = sLruHead;
+	if (sLruHead)
+		sLruHead->lru_prev = aEntry;
+	else
+		sLruTail = aEntry;
+	sLruHead = aEntry;
+}
+
+
+
+static void RemoveEntry(CacheEntry *aEntry)
+{
+	CacheEntry **link = &sBucket[aEntry->hash & (NEEDLE_CACHE_BUCKETS - 1)];
+	while (*link != aEntry)
+		link = &(*link)->hash_next;
+	*link = aEntry->hash_next;
+	LruUnlink(aEntry);
+	NeedleRelease(aEntry->needle); // Any search still using the needle holds its own reference.
+	free(aEntry);
+	--sEntryCount;
+}
+
+
+
+SearchNeedle *NeedleCacheLookup(const char *aFile, const char *aOptions, const FileStamp &aStamp)
+{
+	PlatformMutex *lock = CacheLock();
+	if (!lock)
+		return NULL;
+	MutexLock(lock);
+	SearchNeedle *needle = NULL;
+	CacheEntry *entry = FindEntry(aFile, aOptions, HashKey(aFile, aOptions));
+	if (entry)
+	{
+		if (entry->stamp.mtime != aStamp.mtime || entry->stamp.size != aStamp.size) // File was changed on disk.
+			RemoveEntry(entry);
+		else
+		{
+			LruUnlink(entry);
+			LruPushFront(entry);
+			NeedleAddRef(needle = entry->needle);
+		}
+	}
+	MutexUnlock(lock);
+	return needle;
+}
+
+
+
+static void InsertEntry(const char *aFile, const char *aOptions, const FileStamp &aStamp, SearchNeedle *aNeedle)
+// Must be called with the lock held.
+{
+	if (sCapacity < 1)
+		return;
+	unsigned int hash = HashKey(aFile, aOptions);
+	CacheEntry *entry = FindEntry(aFile, aOptions, hash);
+	if (entry)
+		RemoveEntry(entry);
+	while (sEntryCount >= sCapacity)
+		RemoveEntry(sLruTail);
+
+	size_t file_length = strlen(aFile);
+	if (   !(entry = (CacheEntry *)malloc(sizeof(CacheEntry) + file_length + strlen(aOptions) + 1))   )
+		return;
+	strcpy(entry->file, aFile);
+	entry->options = entry->file + file_length + 1;
+	strcpy(entry->options, aOptions);
+	entry->hash = hash;
+	entry->stamp = aStamp;
+	NeedleAddRef(aNeedle);
+	entry->needle = aNeedle;
+	CacheEntry *&bucket = sBucket[hash & (NEEDLE_CACHE_BUCKETS - 1)];
+	entry->hash_next = bucket;
+	bucket = entry;
+	LruPushFront(entry);
+	++sEntryCount;
+}
+
+
+
+void NeedleCacheInsert(const char *aFile, const char *aOptions, const FileStamp &aStamp, SearchNeedle *aNeedle)
+// Failure to allocate is ignored since the cache is only an optimization.
+{
+	PlatformMutex *lock = CacheLock();
+	if (!lock)
+		return;
+	MutexLock(lock);
+	InsertEntry(aFile, aOptions, aStamp, aNeedle);
+	MutexUnlock(lock);
+}
+
+
+
+int NeedleCacheEvict(const char *aFile)
+// Removes every cached version of aFile, or the entire cache if aFile is NULL or blank (including the
+// cached regions).  Returns the number of entries removed.
+{
+	PlatformMutex *lock = CacheLock();
+	if (!lock)
+		return 0;
+	MutexLock(lock);
+	int removed = 0;
+	if (!aFile || !*aFile)
+	{
+		while (sRegionHead)
+		{
+			RegionEntry *entry = sRegionHead;
+			sRegionHead = entry->next;
+			RegionRelease(entry->region);
+			free(entry);
+			++removed;
+		}
+		sRegionCount = 0;
+	}
+	for (CacheEntry *entry = sLruHead, *next; entry; entry = next)
+	{
+		next = entry->lru_next;
+		if (!aFile || !*aFile || !stricmp_portable(entry->file, aFile))
+		{
+			RemoveEntry(entry);
+			++removed;
+		}
+	}
+	MutexUnlock(lock);
+	return removed;
+}
+
+
+
+void NeedleCacheSetCapacity(int aMaxEntries)
+// Zero disables the cache.
+{
+	PlatformMutex *lock = CacheLock();
+	if (!lock)
+		return;
+	MutexLock(lock);
+	sCapacity = aMaxEntries < 0 ? 0 : aMaxEntries;
+	while (sEntryCount > sCapacity)
+		RemoveEntry(sLruTail);
+	MutexUnlock(lock);
+}
+
+
+
+SearchRegion *RegionCacheLookup(const char *aKey, const FileStamp &aStamp)
+// Returns a region the caller must RegionRelease(), or NULL if not cached or the mask file has changed.
+{
+	PlatformMutex *lock = CacheLock();
+	if (!lock)
+		return NULL;
+	MutexLock(lock);
+	SearchRegion *region = NULL;
+	for (RegionEntry **link = &sRegionHead, *entry; (entry = *link) != NULL; link = &entry->next)
+	{
+		if (strcmp(entry->key, aKey))
+			continue;
+		*link = entry->next;
+		if (entry->stamp.mtime != aStamp.mtime || entry->stamp.size != aStamp.size) // Mask was changed on disk.
+		{
+			RegionRelease(entry->region);
+			free(entry);
+			--sRegionCount;
+			break;
+		}
+		entry->next = sRegionHead; // Move it to the front.
+		sRegionHead = entry;
+		RegionAddRef(region = entry->region);
+		break;
+	}
+	MutexUnlock(lock);
+	return region;
+}
+
+
+
+void RegionCacheInsert(const char *aKey, const FileStamp &aStamp, SearchRegion *aRegion)
+// Adds its own reference to aRegion, replacing any region cached under the same key, or else the least
+// recently used one if the cache is full.  Failure to allocate is ignored since the cache is only an
+// optimization.
+{
+	RegionEntry *entry = (RegionEntry *)malloc(sizeof(RegionEntry) + strlen(aKey));
+	if (!entry)
+		return;
+	strcpy(entry->key, aKey);
+	entry->stamp = aStamp;
+	RegionAddRef(entry->region = aRegion);
+	PlatformMutex *lock = CacheLock();
+	if (!lock)
+	{
+		RegionRelease(aRegion);
+		free(entry);
+		return;
+	}
+	MutexLock(lock);
+	for (RegionEntry **link = &sRegionHead, *existing; (existing = *link) != NULL; link = &existing->next)
+	{
+		if (strcmp(existing->key, aKey))
+			continue;
+		*link = existing->next; // Also loaded by another thread meanwhile, or changed on disk: replace it.
+		RegionRelease(existing->region);
+		free(existing);
+		--sRegionCount;
+		break;
+	}
+	entry->next = sRegionHead;
+	sRegionHead = entry;
+	if (++sRegionCount > REGION_CACHE_CAPACITY)
+	{
+		RegionEntry **link = &sRegionHead;
+		while ((*link)->next)
+			link = &(*link)->next;
+		RegionRelease((*link)->region);
+		free(*link);
+		*link = NULL;
+		--sRegionCount;
+	}
+	MutexUnlock(lock);
+}
@@ -0,0 +1,51 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// A process-wide LRU cache of decoded needles, so that searching for the same image file again skips
+// LoadPicture(), getbits() and NeedleCreate().  A much smaller one holds regions of interest.  Like
+// search.h, this does not depend on <windows.h>.
+
+#ifndef needlecache_h
+#define needlecache_h
+
+#include "search.h"
+
+#define NEEDLE_CACHE_DEFAULT_CAPACITY 512
+
+struct FileStamp
+// Identifies one version of a file's contents.  An entry is discarded when its file's stamp changes.
+{
+	long long mtime;
+	long long size;
+};
+
+bool FileStampGet(const char *aFile, FileStamp &aStamp);
+
+// aFile is the image's path and aOptions distinguishes different ways of loading the same file
+// (size, icon number, trans-color, etc.).  Lookup returns a needle the caller must NeedleRelease(),
+// or NULL if not cached or the file has changed since.  Insert adds its own reference to aNeedle.
+SearchNeedle *NeedleCacheLookup(const char *aFile, const char *aOptions, const FileStamp &aStamp);
+void NeedleCacheInsert(const char *aFile, const char *aOptions, const FileStamp &aStamp, SearchNeedle *aNeedle);
+int NeedleCacheEvict(const char *aFile);
+void NeedleCacheSetCapacity(int aMaxEntries);
+
+// Regions of interest are cached the same way, keyed on the text that describes them (see ParseImageSpec()),
+// so that each is turned into spans only once.  aStamp is that of the mask file, or all zero for a polygon.
+#define REGION_CACHE_CAPACITY 16
+SearchRegion *RegionCacheLookup(const char *aKey, const FileStamp &aStamp);
+void RegionCacheInsert(const char *aKey, const FileStamp &aStamp, SearchRegion *aRegion);
+
+#endif
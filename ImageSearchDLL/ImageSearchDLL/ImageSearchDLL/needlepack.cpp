@@ -0,0 +1,377 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// No stdafx.h here: see needlepack.h.
+#include "needlepack.h"
+#include "search_kernels.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define stricmp_portable _stricmp
+#else
+#include <strings.h>
+#define stricmp_portable strcasecmp
+#endif
+
+#define PACK_MAX_NEEDLES 0x10000 // A needle's id is its pack's number times this, plus its position in the pack.
+
+struct NeedlePack
+{
+	volatile int ref_count; // One for being open, plus one for each reference to any of its needles.
+	const unsigned char *data; // The mapped file.
+	size_t size;
+	const PackEntry *entry;
+	const unsigned int *by_name;
+	int needle_count;
+	SearchNeedle *needle;   // needle_count of them, whose pixels point into data.
+	char file[1];           // Variable length.
+};
+
+static NeedlePack *sPack[PACK_MAX_OPEN]; // Indexed by pack number minus one.
+static PlatformMutex *volatile sLock = NULL; // Guards the above.
+
+
+
+static PlatformMutex *PackLock()
+// Returns the lock, creating it on first use, or NULL if it can't be created.
+{
+	PlatformMutex *lock = (PlatformMutex *)AtomicCompareExchangePointer((void *volatile *)&sLock, NULL, NULL);
+	if (!lock && (lock = MutexCreate()))
+	{
+		PlatformMutex *existing = (PlatformMutex *)AtomicCompareExchangePointer((void *volatile *)&sLock, lock, NULL);
+		if (existing) // Another thread got there first.
+		{
+			MutexDestroy(lock);
+			lock = existing;
+		}
+	}
+	return lock;
+}
+
+
+
+static bool PackValidate(const unsigned char *aData, size_t aSize)
+// Checks that everything the header and entries refer to lies within the file, so that a corrupt or
+// truncated pack is rejected rather than read past its end, and that each color mask is one the search
+// kernels support.
+{
+	const PackHeader &header = *(const PackHeader *)aData;
+	if (aSize < sizeof(PackHeader) || header.magic != PACK_MAGIC || header.version != PACK_VERSION
+		|| !header.needle_count || header.needle_count > PACK_MAX_NEEDLES
+		|| (aSize - sizeof(PackHeader)) / sizeof(PackEntry) < header.needle_count
+		|| header.by_name % sizeof(unsigned int) || header.by_name > aSize
+		|| (aSize - header.by_name) / sizeof(unsigned int) < header.needle_count)
+		return false;
+	const PackEntry *entry = (const PackEntry *)(aData + sizeof(PackHeader));
+	const unsigned int *by_name = (const unsigned int *)(aData + header.by_name);
+	for (unsigned int i = 0; i < header.needle_count; ++i)
+	{
+		const PackEntry &e = entry[i];
+		if (by_name[i] >= header.needle_count
+			|| e.name >= aSize || !memchr(aData + e.name, '\0', aSize - e.name)
+			|| e.width < 1 || e.height < 1 || e.width > 0x7FFF || e.height > 0x7FFF
+			|| e.value % PACK_ALIGN || e.value > aSize
+			|| (aSize - e.value) / (2 * sizeof(PIXEL32)) < (size_t)e.width * e.height
+			|| e.sample_count < 1 || e.sample_count > SEARCH_SAMPLES
+			|| (e.color_mask != SEARCH_COLOR_MASK && e.color_mask != SEARCH_COLOR_MASK_16BIT))
+			return false;
+		for (int s = 0; s < e.sample_count; ++s)
+			if (e.sample[s] < 0 || e.sample[s] >= e.width * e.height)
+				return false;
+	}
+	return true;
+}
+
+
+
+int PackOpen(const char *aFile)
+// Maps aFile and makes its needles available to PackFind() and PackNeedle().  Opening a pack that is
+// already open returns its existing number.  Returns 0 on failure: the file doesn't exist, isn't a valid
+// pack, or PACK_MAX_OPEN packs are already open.
+{
+	PlatformMutex *lock = PackLock();
+	if (!lock)
+		return 0;
+	int slot, free_slot = -1;
+	MutexLock(lock);
+	for (slot = 0; slot < PACK_MAX_OPEN; ++slot)
+	{
+		if (sPack[slot] && !stricmp_portable(sPack[slot]->file, aFile))
+		{
+			MutexUnlock(lock);
+			return slot + 1;
+		}
+		if (!sPack[slot] && free_slot < 0)
+			free_slot = slot;
+	}
+	MutexUnlock(lock);
+	if (free_slot < 0)
+		return 0;
+
+	// Map and check it without holding the lock, since that is where any disk access happens.
+	size_t size;
+	const unsigned char *data = (const unsigned char *)FileMapOpen(aFile, size);
+	if (!data)
+		return 0;
+	NeedlePack *pack = NULL;
+	if (!PackValidate(data, size)
+		|| !(pack = (NeedlePack *)malloc(sizeof(NeedlePack) + strlen(aFile))))
+	{
+		FileMapClose(data, size);
+		return 0;
+	}
+	pack->needle_count = (int)((const PackHeader *)data)->needle_count;
+	if (   !(pack->needle = (SearchNeedle *)malloc(pack->needle_count * sizeof(SearchNeedle)))   )
+	{
+		free(pack);
+		FileMapClose(data, size);
+		return 0;
+	}
+	pack->ref_count = 1;
+	pack->data = data;
+	pack->size = size;
+	pack->entry = (const PackEntry *)(data + sizeof(PackHeader));
+	pack->by_name = (const unsigned int *)(data + ((const PackHeader *)data)->by_name);
+	strcpy(pack->file, aFile);
+	for (int i = 0; i < pack->needle_count; ++i)
+	{
+		const PackEntry &e = pack->entry[i];
+		SearchNeedle &needle = pack->needle[i];
+		needle.ref_count = 1; // Not used: see NeedleAddRef().
+		needle.width = e.width;
+		needle.height = e.height;
+		needle.color_mask = e.color_mask;
+		needle.value = (PIXEL32 *)(data + e.value);
+		needle.care = needle.value + e.width * e.height;
+		needle.sample_count = e.sample_count;
+		memcpy(needle.sample, e.sample, sizeof(needle.sample));
+		needle.spectrum = NULL;
+		needle.pack = pack;
+	}
+
+	MutexLock(lock);
+	free_slot = -1;
+	for (slot = 0; slot < PACK_MAX_OPEN; ++slot)
+	{
+		if (sPack[slot] && !stricmp_portable(sPack[slot]->file, aFile))
+			break; // Another thread opened the same file meanwhile, so share its slot.
+		if (!sPack[slot] && free_slot < 0)
+			free_slot = slot;
+	}
+	if (slot == PACK_MAX_OPEN && free_slot >= 0)
+	{
+		sPack[free_slot] = pack;
+		pack = NULL;
+		slot = free_slot;
+	}
+	MutexUnlock(lock);
+	PackRelease(pack); // Not needed after all, or others were opened meanwhile.  NULL is allowed.
+	return slot == PACK_MAX_OPEN ? 0 : slot + 1;
+}
+
+
+
+bool PackClose(int aPack)
+// Makes the pack's needles unavailable to later searches.  It stays mapped until the searches that are
+// still using any of them have finished.  Returns false if aPack isn't open.
+{
+	PlatformMutex *lock = PackLock();
+	if (!lock || aPack < 1 || aPack > PACK_MAX_OPEN)
+		return false;
+	MutexLock(lock);
+	NeedlePack *pack = sPack[aPack - 1];
+	sPack[aPack - 1] = NULL;
+	MutexUnlock(lock);
+	PackRelease(pack);
+	return pack != NULL;
+}
+
+
+
+void PackAddRef(NeedlePack *aPack)
+{
+	AtomicIncrement(&aPack->ref_count);
+}
+
+
+
+void PackRelease(NeedlePack *aPack)
+// Unmaps the pack when its last reference is released.  NULL is allowed.
+{
+	if (!aPack || AtomicDecrement(&aPack->ref_count))
+		return;
+	for (int i = 0; i < aPack->needle_count; ++i)
+		SpectrumFree(aPack->needle[i].spectrum);
+	free(aPack->needle);
+	FileMapClose(aPack->data, aPack->size);
+	free(aPack);
+}
+
+
+
+int PackFind(const char *aName)
+// Returns the id of the needle named aName (case-insensitive) in any open pack, or 0 if there is none.
+// Packs with lower numbers are looked in first.
+{
+	PlatformMutex *lock = PackLock();
+	if (!lock)
+		return 0;
+	int id = 0;
+	MutexLock(lock);
+	for (int slot = 0; slot < PACK_MAX_OPEN && !id; ++slot)
+	{
+		NeedlePack *pack = sPack[slot];
+		if (!pack)
+			continue;
+		int low = 0, high = pack->needle_count - 1;
+		while (low <= high)
+		{
+			int mid = (low + high) / 2, index = (int)pack->by_name[mid];
+			int result = stricmp_portable(aName, (const char *)pack->data + pack->entry[index].name);
+			if (!result)
+			{
+				id = (slot + 1) * PACK_MAX_NEEDLES + index;
+				break;
+			}
+			if (result < 0)
+				high = mid - 1;
+			else
+				low = mid + 1;
+		}
+	}
+	MutexUnlock(lock);
+	return id;
+}
+
+
+
+SearchNeedle *PackNeedle(int aId)
+// Returns the needle with the given id, or NULL if its pack isn't open (or it has no such needle).
+// Caller must NeedleRelease() the result.
+{
+	PlatformMutex *lock = PackLock();
+	int slot = aId / PACK_MAX_NEEDLES - 1, index = aId % PACK_MAX_NEEDLES;
+	if (!lock || slot < 0 || slot >= PACK_MAX_OPEN)
+		return NULL;
+	SearchNeedle *needle = NULL;
+	MutexLock(lock);
+	NeedlePack *pack = sPack[slot];
+	if (pack && index < pack->needle_count)
+	{
+		needle = &pack->needle[index];
+		PackAddRef(pack);
+	}
+	MutexUnlock(lock);
+	return needle;
+}
+
+
+
+struct PackName
+{
+	const char *name;
+	unsigned int index;
+};
+
+static int ComparePackName(const void *a, const void *b)
+{
+	return stricmp_portable(((const PackName *)a)->name, ((const PackName *)b)->name);
+}
+
+
+
+bool PackWrite(const char *aFile, const char *const *aName, SearchNeedle *const *aNeedle, int aCount)
+// Writes a pack of the given needles, whose ids will be their positions in aNeedle.  Used by the imagepack
+// tool.  Returns false on failure, including when two needles have the same name.
+{
+	if (aCount < 1 || aCount > PACK_MAX_NEEDLES)
+		return false;
+	PackName *sorted = (PackName *)malloc(aCount * sizeof(PackName));
+	PackEntry *entry = (PackEntry *)calloc(aCount, sizeof(PackEntry));
+	PackHeader header;
+	size_t offset;
+	FILE *fp = NULL;
+	bool ok = false;
+	int i;
+	if (!sorted || !entry)
+		goto end;
+
+	for (i = 0; i < aCount; ++i)
+	{
+		sorted[i].name = aName[i];
+		sorted[i].index = (unsigned int)i;
+	}
+	qsort(sorted, aCount, sizeof(PackName), ComparePackName);
+	for (i = 1; i < aCount; ++i)
+		if (!ComparePackName(&sorted[i - 1], &sorted[i]))
+			goto end;
+
+	// Lay the file out: header, entries, the by-name index, names, then each needle's pixels.
+	memset(&header, 0, sizeof(header));
+	header.magic = PACK_MAGIC;
+	header.version = PACK_VERSION;
+	header.needle_count = (unsigned int)aCount;
+	header.by_name = (unsigned int)(sizeof(PackHeader) + aCount * sizeof(PackEntry));
+	offset = header.by_name + aCount * sizeof(unsigned int);
+	for (i = 0; i < aCount; ++i)
+	{
+		entry[i].name = (unsigned int)offset;
+		offset += strlen(aName[i]) + 1;
+	}
+	for (i = 0; i < aCount; ++i)
+	{
+		const SearchNeedle &needle = *aNeedle[i];
+		offset = (offset + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN;
+		if (offset > 0xFFFFFFFF)
+			goto end;
+		entry[i].width = needle.width;
+		entry[i].height = needle.height;
+		entry[i].color_mask = needle.color_mask;
+		entry[i].value = (unsigned int)offset;
+		entry[i].sample_count = needle.sample_count;
+		memcpy(entry[i].sample, needle.sample, sizeof(entry[i].sample));
+		offset += 2 * needle.width * needle.height * sizeof(PIXEL32);
+	}
+
+	if (   !(fp = fopen(aFile, "wb"))   )
+		goto end;
+	ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(entry, sizeof(PackEntry), aCount, fp) == (size_t)aCount;
+	for (i = 0; i < aCount && ok; ++i)
+		ok = fwrite(&sorted[i].index, sizeof(unsigned int), 1, fp) == 1;
+	for (i = 0; i < aCount && ok; ++i)
+		ok = fwrite(aName[i], strlen(aName[i]) + 1, 1, fp) == 1;
+	for (i = 0; i < aCount && ok; ++i)
+	{
+		static const char zero[PACK_ALIGN] = {0};
+		long padding = (long)(entry[i].value - ftell(fp));
+		size_t pixel_count = (size_t)aNeedle[i]->width * aNeedle[i]->height;
+		ok = (!padding || fwrite(zero, padding, 1, fp) == 1)
+			&& fwrite(aNeedle[i]->value, sizeof(PIXEL32), pixel_count, fp) == pixel_count
+			&& fwrite(aNeedle[i]->care, sizeof(PIXEL32), pixel_count, fp) == pixel_count;
+	}
+	if (fclose(fp))
+		ok = false;
+	if (!ok)
+		remove(aFile);
+
+end:
+	free(sorted);
+	free(entry);
+	return ok;
+}
@@ -0,0 +1,63 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// Needle packs: a single file, made ahead of time by the imagepack tool, that holds many needles already
+// decoded and masked, along with their sample pixels and names.  A pack is memory-mapped rather than read,
+// so opening one costs next to nothing and processes that open the same pack share its pages.  Like
+// search.h, this does not depend on <windows.h>.
+
+#ifndef needlepack_h
+#define needlepack_h
+
+#include "search.h"
+
+// The file layout.  All numbers are little-endian and all offsets are from the start of the file.
+#define PACK_MAGIC 0x4B505349 // "ISPK"
+#define PACK_VERSION 1
+#define PACK_ALIGN 64         // Pixel data starts on a multiple of this, as a cache line and for aligned vector loads.
+
+struct PackHeader
+{
+	unsigned int magic, version;
+	unsigned int needle_count;
+	unsigned int by_name;     // Offset of needle_count entry numbers, ordered by name (case-insensitive).
+	unsigned int reserved[4];
+};
+
+struct PackEntry
+// One per needle, following the header in the order they were given to the tool.  A needle's id is its
+// position in that order.
+{
+	unsigned int name;  // Offset of its name: the image's file name as given to the tool, without its extension.
+	int width, height;
+	PIXEL32 color_mask;
+	unsigned int value; // Offset of width*height values, then width*height care pixels, as in SearchNeedle.
+	int sample_count;
+	int sample[SEARCH_SAMPLES];
+};
+
+#define PACK_MAX_OPEN 64 // Pack numbers run from 1 to this.
+
+int PackOpen(const char *aFile); // Returns the pack's number, or 0 on failure.
+bool PackClose(int aPack);
+void PackAddRef(NeedlePack *aPack);
+void PackRelease(NeedlePack *aPack);
+int PackFind(const char *aName);
+SearchNeedle *PackNeedle(int aId);
+
+bool PackWrite(const char *aFile, const char *const *aName, SearchNeedle *const *aNeedle, int aCount);
+
+#endif
@@ -0,0 +1,501 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// No stdafx.h here: see platform.h.
+#include "platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0501 // GetModuleHandleEx(), as in stdafx.h.
+#endif
+#include <windows.h>
+#include <process.h> // _beginthreadex(), which unlike CreateThread() sets up the CRT for the new thread.
+#include <malloc.h>  // _aligned_malloc().
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+
+#ifdef _WIN32
+
+struct PlatformMutex
+{
+	CRITICAL_SECTION cs;
+};
+
+PlatformMutex *MutexCreate()
+{
+	PlatformMutex *mutex = (PlatformMutex *)malloc(sizeof(PlatformMutex));
+	if (mutex)
+		InitializeCriticalSection(&mutex->cs);
+	return mutex;
+}
+
+void MutexDestroy(PlatformMutex *aMutex)
+{
+	if (!aMutex)
+		return;
+	DeleteCriticalSection(&aMutex->cs);
+	free(aMutex);
+}
+
+void MutexLock(PlatformMutex *aMutex) {EnterCriticalSection(&aMutex->cs);}
+bool MutexTryLock(PlatformMutex *aMutex) {return TryEnterCriticalSection(&aMutex->cs) != FALSE;}
+void MutexUnlock(PlatformMutex *aMutex) {LeaveCriticalSection(&aMutex->cs);}
+
+
+
+PlatformSemaphore *SemaphoreCreate(int aInitialCount)
+{
+	return (PlatformSemaphore *)CreateSemaphore(NULL, aInitialCount, 0x7FFFFFFF, NULL);
+}
+
+void SemaphoreDestroy(PlatformSemaphore *aSemaphore)
+{
+	if (aSemaphore)
+		CloseHandle((HANDLE)aSemaphore);
+}
+
+void SemaphorePost(PlatformSemaphore *aSemaphore, int aCount) {ReleaseSemaphore((HANDLE)aSemaphore, aCount, NULL);}
+void SemaphoreWait(PlatformSemaphore *aSemaphore) {WaitForSingleObject((HANDLE)aSemaphore, INFINITE);}
+bool SemaphoreWaitTimeout(PlatformSemaphore *aSemaphore, int aMilliseconds)
+{
+	return WaitForSingleObject((HANDLE)aSemaphore, aMilliseconds < 0 ? INFINITE : (DWORD)aMilliseconds) == WAIT_OBJECT_0;
+}
+
+
+
+struct ThreadStartInfo
+{
+	ThreadFunc func;
+	void *param;
+};
+
+static unsigned __stdcall ThreadEntry(void *aInfo)
+{
+	ThreadStartInfo info = *(ThreadStartInfo *)aInfo;
+	free(aInfo);
+	info.func(info.param);
+	return 0;
+}
+
+bool ThreadStart(ThreadFunc aFunc, void *aParam)
+{
+	ThreadStartInfo *info = (ThreadStartInfo *)malloc(sizeof(ThreadStartInfo));
+	if (!info)
+		return false;
+	info->func = aFunc;
+	info->param = aParam;
+	uintptr_t thread = _beginthreadex(NULL, 0, ThreadEntry, info, 0, NULL);
+	if (!thread)
+	{
+		free(info);
+		return false;
+	}
+	CloseHandle((HANDLE)thread);
+	return true;
+}
+
+void ThreadSleep(int aMilliseconds) {Sleep(aMilliseconds);}
+
+bool ModulePin()
+{
+	static volatile int pinned = 0;
+	if (pinned)
+		return true;
+	HMODULE module; // The pin is never undone, so there is nothing to free.
+	if (!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN
+		, (LPCSTR)&ModulePin, &module))
+		return false;
+	pinned = 1;
+	return true;
+}
+
+
+
+int AtomicIncrement(volatile int *aTarget) {return InterlockedIncrement((volatile LONG *)aTarget);}
+int AtomicDecrement(volatile int *aTarget) {return InterlockedDecrement((volatile LONG *)aTarget);}
+int AtomicCompareExchange(volatile int *aTarget, int aExchange, int aComparand)
+{
+	return InterlockedCompareExchange((volatile LONG *)aTarget, aExchange, aComparand);
+}
+void *AtomicCompareExchangePointer(void *volatile *aTarget, void *aExchange, void *aComparand)
+{
+	return InterlockedCompareExchangePointer(aTarget, aExchange, aComparand);
+}
+
+
+
+int CpuCount()
+{
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return (int)si.dwNumberOfProcessors;
+}
+
+
+
+void *AlignedAlloc(size_t aSize, size_t aAlignment)
+{
+	return _aligned_malloc(aSize, aAlignment);
+}
+
+
+
+void AlignedFree(void *aMemory)
+{
+	_aligned_free(aMemory);
+}
+
+
+
+const void *FileMapOpen(const char *aFile, size_t &aSize)
+{
+	HANDLE file = CreateFileA(aFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+	LARGE_INTEGER size;
+	void *data = NULL;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0 && (unsigned long long)size.QuadPart <= (size_t)-1)
+	{
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping)
+		{
+			data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping); // The view keeps the mapping alive.
+		}
+		aSize = (size_t)size.QuadPart;
+	}
+	CloseHandle(file);
+	return data;
+}
+
+void FileMapClose(const void *aData, size_t aSize)
+{
+	if (aData)
+		UnmapViewOfFile(aData);
+}
+
+
+
+struct PlatformSharedMemory
+{
+	HANDLE mapping;
+	void *data;
+};
+
+PlatformSharedMemory *SharedMemoryOpen(const char *aName, size_t &aSize, bool aCreate)
+{
+	PlatformSharedMemory *memory = (PlatformSharedMemory *)malloc(sizeof(PlatformSharedMemory));
+	if (!memory)
+		return NULL;
+	memory->mapping = aCreate
+		? CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)aSize >> 32)
+			, (DWORD)aSize, aName)
+		: OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, aName);
+	MEMORY_BASIC_INFORMATION info;
+	if (memory->mapping && (memory->data = MapViewOfFile(memory->mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0))
+		&& VirtualQuery(memory->data, &info, sizeof(info)))
+	{
+		aSize = info.RegionSize;
+		return memory;
+	}
+	if (memory->mapping)
+	{
+		if (memory->data)
+			UnmapViewOfFile(memory->data);
+		CloseHandle(memory->mapping);
+	}
+	free(memory);
+	return NULL;
+}
+
+void *SharedMemoryData(PlatformSharedMemory *aMemory) {return aMemory->data;}
+
+void SharedMemoryClose(PlatformSharedMemory *aMemory)
+{
+	if (!aMemory)
+		return;
+	UnmapViewOfFile(aMemory->data);
+	CloseHandle(aMemory->mapping);
+	free(aMemory);
+}
+
+#else // POSIX
+
+struct PlatformMutex
+{
+	pthread_mutex_t mutex;
+};
+
+PlatformMutex *MutexCreate()
+{
+	PlatformMutex *mutex = (PlatformMutex *)malloc(sizeof(PlatformMutex));
+	if (mutex && pthread_mutex_init(&mutex->mutex, NULL))
+	{
+		free(mutex);
+		return NULL;
+	}
+	return mutex;
+}
+
+void MutexDestroy(PlatformMutex *aMutex)
+{
+	if (!aMutex)
+		return;
+	pthread_mutex_destroy(&aMutex->mutex);
+	free(aMutex);
+}
+
+void MutexLock(PlatformMutex *aMutex) {pthread_mutex_lock(&aMutex->mutex);}
+bool MutexTryLock(PlatformMutex *aMutex) {return pthread_mutex_trylock(&aMutex->mutex) == 0;}
+void MutexUnlock(PlatformMutex *aMutex) {pthread_mutex_unlock(&aMutex->mutex);}
+
+
+
+struct PlatformSemaphore
+{
+	sem_t sem;
+};
+
+PlatformSemaphore *SemaphoreCreate(int aInitialCount)
+{
+	PlatformSemaphore *semaphore = (PlatformSemaphore *)malloc(sizeof(PlatformSemaphore));
+	if (semaphore && sem_init(&semaphore->sem, 0, aInitialCount))
+	{
+		free(semaphore);
+		return NULL;
+	}
+	return semaphore;
+}
+
+void SemaphoreDestroy(PlatformSemaphore *aSemaphore)
+{
+	if (!aSemaphore)
+		return;
+	sem_destroy(&aSemaphore->sem);
+	free(aSemaphore);
+}
+
+void SemaphorePost(PlatformSemaphore *aSemaphore, int aCount)
+{
+	while (aCount-- > 0)
+		sem_post(&aSemaphore->sem);
+}
+
+void SemaphoreWait(PlatformSemaphore *aSemaphore)
+{
+	while (sem_wait(&aSemaphore->sem)) // Retry if interrupted by a signal.
+		;
+}
+
+bool SemaphoreWaitTimeout(PlatformSemaphore *aSemaphore, int aMilliseconds)
+{
+	if (aMilliseconds < 0)
+	{
+		SemaphoreWait(aSemaphore);
+		return true;
+	}
+	if (!aMilliseconds)
+		return sem_trywait(&aSemaphore->sem) == 0;
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline); // sem_timedwait() only takes a deadline on this clock.
+	deadline.tv_sec += aMilliseconds / 1000;
+	deadline.tv_nsec += (aMilliseconds % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		++deadline.tv_sec;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	int result;
+	while ((result = sem_timedwait(&aSemaphore->sem, &deadline)) && errno == EINTR)
+		;
+	return result == 0;
+}
+
+
+
+struct ThreadStartInfo
+{
+	ThreadFunc func;
+	void *param;
+};
+
+static void *ThreadEntry(void *aInfo)
+{
+	ThreadStartInfo info = *(ThreadStartInfo *)aInfo;
+	free(aInfo);
+	info.func(info.param);
+	return NULL;
+}
+
+bool ThreadStart(ThreadFunc aFunc, void *aParam)
+{
+	ThreadStartInfo *info = (ThreadStartInfo *)malloc(sizeof(ThreadStartInfo));
+	if (!info)
+		return false;
+	info->func = aFunc;
+	info->param = aParam;
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, ThreadEntry, info))
+	{
+		free(info);
+		return false;
+	}
+	pthread_detach(thread);
+	return true;
+}
+
+void ThreadSleep(int aMilliseconds)
+{
+	struct timespec ts = {aMilliseconds / 1000, (aMilliseconds % 1000) * 1000000L};
+	while (nanosleep(&ts, &ts) && errno == EINTR);
+}
+
+bool ModulePin()
+{
+	return true; // The POSIX builds are programs, not libraries that are unloaded.
+}
+
+
+
+int AtomicIncrement(volatile int *aTarget) {return __sync_add_and_fetch(aTarget, 1);}
+int AtomicDecrement(volatile int *aTarget) {return __sync_sub_and_fetch(aTarget, 1);}
+int AtomicCompareExchange(volatile int *aTarget, int aExchange, int aComparand)
+{
+	return __sync_val_compare_and_swap(aTarget, aComparand, aExchange);
+}
+void *AtomicCompareExchangePointer(void *volatile *aTarget, void *aExchange, void *aComparand)
+{
+	return __sync_val_compare_and_swap(aTarget, aComparand, aExchange);
+}
+
+
+
+int CpuCount()
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count < 1 ? 1 : (int)count;
+}
+
+
+
+void *AlignedAlloc(size_t aSize, size_t aAlignment)
+{
+	void *memory;
+	if (aAlignment < sizeof(void *)) // The least posix_memalign() accepts.
+		aAlignment = sizeof(void *);
+	return posix_memalign(&memory, aAlignment, aSize ? aSize : 1) ? NULL : memory;
+}
+
+
+
+void AlignedFree(void *aMemory)
+{
+	free(aMemory);
+}
+
+
+
+const void *FileMapOpen(const char *aFile, size_t &aSize)
+{
+	int fd = open(aFile, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	void *data = NULL;
+	if (!fstat(fd, &st) && st.st_size > 0)
+	{
+		data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED)
+			data = NULL;
+		aSize = (size_t)st.st_size;
+	}
+	close(fd); // The mapping stays valid.
+	return data;
+}
+
+void FileMapClose(const void *aData, size_t aSize)
+{
+	if (aData)
+		munmap((void *)aData, aSize);
+}
+
+
+
+struct PlatformSharedMemory
+{
+	void *data;
+	size_t size;
+};
+
+PlatformSharedMemory *SharedMemoryOpen(const char *aName, size_t &aSize, bool aCreate)
+{
+	char name[256];
+	if (strlen(aName) + 2 > sizeof(name))
+		return NULL;
+	name[0] = '/'; // Required by shm_open().
+	strcpy(name + (*aName == '/' ? 0 : 1), aName);
+	PlatformSharedMemory *memory = (PlatformSharedMemory *)malloc(sizeof(PlatformSharedMemory));
+	if (!memory)
+		return NULL;
+	memory->data = NULL;
+	int fd = shm_open(name, O_RDWR | (aCreate ? O_CREAT : 0), 0600);
+	struct stat st;
+	if (fd >= 0 && !fstat(fd, &st))
+	{
+		if (!st.st_size && aCreate && !ftruncate(fd, (off_t)aSize)) // New, so give it its size.
+			st.st_size = (off_t)aSize;
+		if (st.st_size > 0)
+		{
+			memory->size = (size_t)st.st_size;
+			memory->data = mmap(NULL, memory->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (memory->data == MAP_FAILED)
+				memory->data = NULL;
+		}
+	}
+	if (fd >= 0)
+		close(fd); // The mapping stays valid.
+	if (!memory->data)
+	{
+		free(memory);
+		return NULL;
+	}
+	aSize = memory->size;
+	return memory;
+}
+
+void *SharedMemoryData(PlatformSharedMemory *aMemory) {return aMemory->data;}
+
+void SharedMemoryClose(PlatformSharedMemory *aMemory)
+{
+	if (!aMemory)
+		return;
+	munmap(aMemory->data, aMemory->size);
+	free(aMemory);
+}
+
+#endif
@@ -0,0 +1,79 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// The few OS services the search engine needs (threads, locks, atomics, aligned memory, mapped files,
+// shared memory), wrapped so that the engine itself stays free of <windows.h>.  platform.cpp implements
+// them with Win32 or with POSIX threads.
+
+#ifndef platform_h
+#define platform_h
+
+#include <stddef.h>
+
+struct PlatformMutex;
+struct PlatformSemaphore;
+
+PlatformMutex *MutexCreate(); // Returns NULL on failure.
+void MutexDestroy(PlatformMutex *aMutex);
+void MutexLock(PlatformMutex *aMutex);
+bool MutexTryLock(PlatformMutex *aMutex);
+void MutexUnlock(PlatformMutex *aMutex);
+
+PlatformSemaphore *SemaphoreCreate(int aInitialCount); // Returns NULL on failure.
+void SemaphoreDestroy(PlatformSemaphore *aSemaphore);
+void SemaphorePost(PlatformSemaphore *aSemaphore, int aCount);
+void SemaphoreWait(PlatformSemaphore *aSemaphore);
+bool SemaphoreWaitTimeout(PlatformSemaphore *aSemaphore, int aMilliseconds); // Negative waits forever.  False on timeout.
+
+typedef void (*ThreadFunc)(void *aParam);
+bool ThreadStart(ThreadFunc aFunc, void *aParam); // The thread is detached: nothing waits for it to end.
+void ThreadSleep(int aMilliseconds);
+
+// Keeps the DLL this code is built into loaded until the process ends, so that a caller that loads and
+// unloads it around each call can't unmap it under a thread started by ThreadStart().  Must be called
+// before the first such thread is started.  Returns false on failure.
+bool ModulePin();
+
+// All of these are full memory barriers.  Each returns the new value, except AtomicCompareExchange(),
+// which returns the value that *aTarget had (it is set to aExchange only if that was aComparand).
+int AtomicIncrement(volatile int *aTarget);
+int AtomicDecrement(volatile int *aTarget);
+int AtomicCompareExchange(volatile int *aTarget, int aExchange, int aComparand);
+void *AtomicCompareExchangePointer(void *volatile *aTarget, void *aExchange, void *aComparand);
+
+int CpuCount();
+
+// aAlignment must be a power of two.  Returns NULL on failure.  Memory from AlignedAlloc() must be freed
+// by AlignedFree() (NULL is allowed), never by free().
+void *AlignedAlloc(size_t aSize, size_t aAlignment);
+void AlignedFree(void *aMemory);
+
+// Maps a whole file read-only, so that processes mapping the same file share its pages.  Returns NULL on
+// failure, including for an empty file.
+const void *FileMapOpen(const char *aFile, size_t &aSize);
+void FileMapClose(const void *aData, size_t aSize);
+
+// A named block of memory that other processes can map too.  Open creates the block with aSize bytes,
+// all zero, if aCreate is true and no block of that name exists yet; otherwise aSize is ignored.  Either
+// way, aSize is set to the size of the block, which may be rounded up to a whole page.  Returns NULL on
+// failure.  On POSIX systems the block outlives the processes using it, so that a restarted producer
+// finds the same one.
+struct PlatformSharedMemory;
+PlatformSharedMemory *SharedMemoryOpen(const char *aName, size_t &aSize, bool aCreate);
+void *SharedMemoryData(PlatformSharedMemory *aMemory);
+void SharedMemoryClose(PlatformSharedMemory *aMemory);
+
+#endif
@@ -0,0 +1,840 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// No stdafx.h here: see search.h.
+#include "search_kernels.h"
+#include "needlepack.h"
+#include "platform.h"
+#include "threadpool.h"
+#include <stdlib.h>
+#include <limits.h>
+
+
+struct SampleCandidate
+{
+	PIXEL32 value;
+	int index;      // Into the needle's value[] and care[].
+	int frequency;  // Number of the needle's opaque pixels with the same value.
+	int contrast;   // Sum of the differences between the components of value and the needle's most common color.
+};
+
+
+
+static int CompareSampleValue(const void *a, const void *b)
+{
+	PIXEL32 va = ((const SampleCandidate *)a)->value, vb = ((const SampleCandidate *)b)->value;
+	if (va != vb)
+		return va < vb ? -1 : 1;
+	return ((const SampleCandidate *)a)->index - ((const SampleCandidate *)b)->index;
+}
+
+
+
+static int CompareSampleRank(const void *a, const void *b)
+// Rarest first, then those that stand out most from the needle's background, then in scan order.
+{
+	const SampleCandidate &ca = *(const SampleCandidate *)a, &cb = *(const SampleCandidate *)b;
+	if (ca.frequency != cb.frequency)
+		return ca.frequency - cb.frequency;
+	if (ca.contrast != cb.contrast)
+		return cb.contrast - ca.contrast;
+	return ca.index - cb.index;
+}
+
+
+
+static void PickSamples(SearchNeedle &aNeedle)
+// Chooses the needle's sample pixels.  The row kernels used to prefilter on the needle's first pixel,
+// which is often part of a background that covers much of the screen (or is transparent, which doesn't
+// filter at all), so that nearly every position got a full comparison.  The pixels whose colors are
+// rarest within the needle are much less likely to be common on the screen too.  Ties go to the pixels
+// that differ most from the needle's most common color, which also makes them hard to match with a
+// variation.  Each sample after the first has a color not already sampled, so that each can reject
+// positions the others let through.
+{
+	aNeedle.sample_count = 1;
+	aNeedle.sample[0] = 0;
+	int pixel_count = aNeedle.width * aNeedle.height, opaque_count = 0, i, j;
+	SampleCandidate *candidate = (SampleCandidate *)malloc(pixel_count * sizeof(SampleCandidate));
+	if (!candidate) // Not fatal: fall back to the first opaque pixel alone.
+	{
+		for (i = 0; i < pixel_count && !aNeedle.care[i]; ++i);
+		aNeedle.sample[0] = i < pixel_count ? i : 0;
+		return;
+	}
+	for (i = 0; i < pixel_count; ++i)
+	{
+		if (!aNeedle.care[i])
+			continue;
+		candidate[opaque_count].value = aNeedle.value[i];
+		candidate[opaque_count].index = i;
+		++opaque_count;
+	}
+	if (!opaque_count)
+	{
+		free(candidate);
+		return;
+	}
+
+	// Count each color, and find the most common one:
+	qsort(candidate, opaque_count, sizeof(SampleCandidate), CompareSampleValue);
+	PIXEL32 common = candidate[0].value;
+	int common_count = 0;
+	for (i = 0; i < opaque_count; i = j)
+	{
+		for (j = i + 1; j < opaque_count && candidate[j].value == candidate[i].value; ++j);
+		for (int k = i; k < j; ++k)
+			candidate[k].frequency = j - i;
+		if (j - i > common_count)
+		{
+			common = candidate[i].value;
+			common_count = j - i;
+		}
+	}
+	for (i = 0; i < opaque_count; ++i)
+	{
+		int contrast = 0;
+		for (int shift = 0; shift < 24; shift += 8)
+		{
+			int d = (int)((candidate[i].value >> shift) & 0xFF) - (int)((common >> shift) & 0xFF);
+			contrast += d < 0 ? -d : d;
+		}
+		candidate[i].contrast = contrast;
+	}
+
+	qsort(candidate, opaque_count, sizeof(SampleCandidate), CompareSampleRank);
+	aNeedle.sample[0] = candidate[0].index;
+	for (i = 1; i < opaque_count && aNeedle.sample_count < SEARCH_SAMPLES; ++i)
+	{
+		for (j = 0; j < aNeedle.sample_count && aNeedle.value[aNeedle.sample[j]] != candidate[i].value; ++j);
+		if (j == aNeedle.sample_count)
+			aNeedle.sample[aNeedle.sample_count++] = candidate[i].index;
+	}
+	free(candidate);
+}
+
+
+
+SearchNeedle *NeedleCreate(const SearchImage &aImage, const SearchImage *aMask, PIXEL32 aTransColor
+	, PIXEL32 aColorMask)
+// Copies aImage into a new needle.  aMask, if non-NULL, is an icon's AND-mask with the same dimensions
+// as aImage in which any non-zero pixel means "transparent".  Any pixel equal to aTransColor (after
+// masking) is also transparent.  Returns NULL on failure.  Caller must NeedleRelease() the result.
+{
+	if (aImage.width < 1 || aImage.height < 1)
+		return NULL;
+
+	SearchNeedle *needle = (SearchNeedle *)malloc(sizeof(SearchNeedle));
+	if (!needle)
+		return NULL;
+	int pixel_count = aImage.width * aImage.height;
+	if (   !(needle->value = (PIXEL32 *)malloc(2 * pixel_count * sizeof(PIXEL32)))   )
+	{
+		free(needle);
+		return NULL;
+	}
+	needle->care = needle->value + pixel_count;
+	needle->ref_count = 1;
+	needle->width = aImage.width;
+	needle->height = aImage.height;
+	needle->color_mask = aColorMask;
+	needle->spectrum = NULL;
+	needle->pack = NULL;
+
+	// As in the original ImageSearch(), only the 16-bit mask is applied to the trans-color.  A trans-color
+	// with any bits in the high-order byte therefore never matches, since the image itself has none.
+	if (aTransColor != SEARCH_NO_TRANS && aColorMask != SEARCH_COLOR_MASK)
+		aTransColor &= aColorMask;
+
+	const PIXEL32 *src = aImage.pixels, *mask = aMask ? aMask->pixels : NULL;
+	PIXEL32 *value = needle->value, *care = needle->care;
+	for (int y = 0; y < aImage.height; ++y)
+	{
+		for (int x = 0; x < aImage.width; ++x, ++value, ++care)
+		{
+			PIXEL32 pixel = src[x] & aColorMask;
+			*care = ((mask && mask[x]) || pixel == aTransColor) ? 0 : aColorMask;
+			*value = pixel & *care;
+		}
+		src += aImage.stride;
+		if (mask)
+			mask += aMask->stride;
+	}
+	PickSamples(*needle);
+	return needle;
+}
+
+
+
+SearchNeedle *NeedleWithColorMask(const SearchNeedle &aNeedle, PIXEL32 aColorMask)
+// Returns a copy of aNeedle that is compared with aColorMask instead of its own, such as for a needle
+// from a pack (which always has the full mask) on a 16-bit screen.  Returns NULL on failure.
+// Caller must NeedleRelease() the result.
+{
+	SearchNeedle *needle = (SearchNeedle *)malloc(sizeof(SearchNeedle));
+	if (!needle)
+		return NULL;
+	int pixel_count = aNeedle.width * aNeedle.height;
+	if (   !(needle->value = (PIXEL32 *)malloc(2 * pixel_count * sizeof(PIXEL32)))   )
+	{
+		free(needle);
+		return NULL;
+	}
+	needle->care = needle->value + pixel_count;
+	needle->ref_count = 1;
+	needle->width = aNeedle.width;
+	needle->height = aNeedle.height;
+	needle->color_mask = aColorMask;
+	needle->spectrum = NULL;
+	needle->pack = NULL;
+	for (int i = 0; i < pixel_count; ++i)
+	{
+		needle->care[i] = aNeedle.care[i] ? aColorMask : 0;
+		needle->value[i] = aNeedle.value[i] & needle->care[i];
+	}
+	PickSamples(*needle);
+	return needle;
+}
+
+
+
+void NeedleAddRef(SearchNeedle *aNeedle)
+// The count is atomic so that searches running on different threads can share a needle.
+{
+	if (aNeedle->pack)
+		PackAddRef(aNeedle->pack);
+	else
+		AtomicIncrement(&aNeedle->ref_count);
+}
+
+
+
+void NeedleRelease(SearchNeedle *aNeedle)
+// Frees the needle when its last reference is released.  NULL is allowed.
+{
+	if (aNeedle && aNeedle->pack)
+	{
+		PackRelease(aNeedle->pack); // Which frees the needle along with the rest of the pack.
+		return;
+	}
+	if (!aNeedle || AtomicDecrement(&aNeedle->ref_count))
+		return;
+	free(aNeedle->value); // care[] shares this block.
+	SpectrumFree(aNeedle->spectrum);
+	free(aNeedle);
+}
+
+
+
+static bool MatchExactAt(const PIXEL32 *aScreen, ptrdiff_t aStride, const SearchNeedle &aNeedle)
+// aScreen is the upper-left pixel of the candidate region.
+{
+	const PIXEL32 *value = aNeedle.value, *care = aNeedle.care;
+	for (int y = 0; y < aNeedle.height; ++y, aScreen += aStride, value += aNeedle.width, care += aNeedle.width)
+		for (int x = 0; x < aNeedle.width; ++x)
+			if ((aScreen[x] & care[x]) != value[x])
+				return false;
+	return true;
+}
+
+
+
+int RowExact(const SearchContext &aContext, const PIXEL32 *aRow, int aXBegin, int aXEnd)
+// Portable version of the exact-match row kernel.  The check of the first sample pixel costs only an
+// AND and a compare, so it is done before the others and the full comparison.
+{
+	const SearchNeedle &needle = *aContext.needle;
+	PIXEL32 care0 = needle.care[needle.sample[0]], value0 = needle.value[needle.sample[0]];
+	const PIXEL32 *probe = aRow + aContext.sample_offset[0];
+	for (int x = aXBegin; x < aXEnd; ++x)
+		if ((probe[x] & care0) == value0 && SamplesMatchExact(aContext, aRow + x)
+			&& MatchExactAt(aRow + x, aContext.stride, needle))
+			return x;
+	return -1;
+}
+
+
+
+static bool MatchVariationAt(const PIXEL32 *aScreen, ptrdiff_t aStride, const SearchContext &aContext)
+// Each of the three color components of every screen pixel must lie within the needle's bounds for
+// that pixel (see BuildBounds()).
+{
+	const SearchNeedle &needle = *aContext.needle;
+	const PIXEL32 *low = aContext.low, *high = aContext.high;
+	for (int y = 0; y < needle.height; ++y, aScreen += aStride, low += needle.width, high += needle.width)
+		for (int x = 0; x < needle.width; ++x)
+			if (!PixelInBounds(aScreen[x], low[x], high[x]))
+				return false;
+	return true;
+}
+
+
+
+int RowVariation(const SearchContext &aContext, const PIXEL32 *aRow, int aXBegin, int aXEnd)
+// The first-pixel check here used to be commented out "to reduce code size", but with the bounds
+// precomputed it is just the same test MatchVariationAt() does for every pixel.
+{
+	int sample0 = aContext.needle->sample[0];
+	PIXEL32 low0 = aContext.low[sample0], high0 = aContext.high[sample0];
+	const PIXEL32 *probe = aRow + aContext.sample_offset[0];
+	for (int x = aXBegin; x < aXEnd; ++x)
+		if (PixelInBounds(probe[x], low0, high0) && SamplesMatchVariation(aContext, aRow + x)
+			&& MatchVariationAt(aRow + x, aContext.stride, aContext))
+			return x;
+	return -1;
+}
+
+
+
+static PIXEL32 *BuildBounds(const SearchNeedle &aNeedle, int aVariation, PIXEL32 *aBuf, int aBufCount)
+// Builds the low[] and high[] planes used by the variation kernels into aBuf if it is big enough,
+// otherwise into a new block that the caller must free.  Returns NULL on failure.
+// This replaces the old SET_COLOR_RANGE macro, which was evaluated for every needle pixel at every
+// candidate position.  Each byte of low[j]/high[j] is the inclusive range that the corresponding byte
+// of the screen pixel must fall in, so a kernel can test four components with two saturating subtracts.
+{
+	int pixel_count = aNeedle.width * aNeedle.height;
+	PIXEL32 *low = aBuf;
+	if (2 * pixel_count > aBufCount && !(low = (PIXEL32 *)malloc(2 * pixel_count * sizeof(PIXEL32))))
+		return NULL;
+	PIXEL32 *high = low + pixel_count;
+	// In 16-bit mode the screen pixel would have to be ANDed with 0xF8 before being compared.  Instead,
+	// the range is widened to all the screen values that would pass after such masking: a masked value
+	// is >= lo exactly when the unmasked one is >= lo rounded up to a multiple of 8, and <= hi exactly
+	// when the unmasked one is <= (hi & 0xF8) | 7.
+	bool is_16bit = (aNeedle.color_mask == SEARCH_COLOR_MASK_16BIT);
+	for (int j = 0; j < pixel_count; ++j)
+	{
+		if (!aNeedle.care[j]) // Transparent pixel, which matches any color.
+		{
+			low[j] = 0;
+			high[j] = 0xFFFFFFFF;
+			continue;
+		}
+		PIXEL32 lo = 0, hi = 0xFF000000; // The high-order byte of the screen pixel is ignored.
+		for (int shift = 0; shift < 24; shift += 8)
+		{
+			int n = (aNeedle.value[j] >> shift) & 0xFF;
+			int n_low = (aVariation > n) ? 0 : n - aVariation;
+			int n_high = (aVariation > 0xFF - n) ? 0xFF : n + aVariation;
+			if (is_16bit)
+			{
+				n_low = (n_low + 7) & 0xF8;
+				n_high = (n_high & 0xF8) | 7;
+			}
+			lo |= (PIXEL32)n_low << shift;
+			hi |= (PIXEL32)n_high << shift;
+		}
+		low[j] = lo;
+		high[j] = hi;
+	}
+	return low;
+}
+
+
+
+static SearchRowFunc SelectRowFunc(const SearchContext &aContext)
+// Picks the fastest kernel the CPU supports for this kind of search.
+{
+#ifdef SEARCH_X86
+	int features = CpuFeatures();
+#ifdef SEARCH_AVX2
+	if (features & CPU_AVX2)
+		return aContext.variation ? RowVariationAVX2 : RowExactAVX2;
+#endif
+	if (features & CPU_SSE2)
+		return aContext.variation ? RowVariationSSE2 : RowExactSSE2;
+#endif
+	return aContext.variation ? RowVariation : RowExact;
+}
+
+
+
+bool SearchBegin(SearchContext &aContext, const SearchNeedle &aNeedle, ptrdiff_t aStride, int aVariation)
+// Prepares aContext for searching a haystack with the given stride.  Returns false on failure (out of memory).
+// Each successful call must be balanced by SearchEnd().
+{
+	aContext.needle = &aNeedle;
+	aContext.stride = aStride;
+	aContext.variation = aVariation < 0 ? 0 : (aVariation > 255 ? 255 : aVariation);
+	aContext.low = aContext.high = NULL;
+	if (aContext.variation)
+	{
+		if (   !(aContext.low = BuildBounds(aNeedle, aContext.variation, aContext.bounds_buf, SEARCH_BOUNDS_BUF))   )
+			return false;
+		aContext.high = aContext.low + aNeedle.width * aNeedle.height;
+	}
+	for (int i = 0; i < aNeedle.sample_count; ++i)
+		aContext.sample_offset[i] = (aNeedle.sample[i] / aNeedle.width) * aStride + aNeedle.sample[i] % aNeedle.width;
+	aContext.row_func = SelectRowFunc(aContext);
+	return true;
+}
+
+
+
+void SearchEnd(SearchContext &aContext)
+{
+	if (aContext.low != aContext.bounds_buf)
+		free((void *)aContext.low);
+}
+
+
+
+#define SEARCH_MAX_BANDS 256
+#define SEARCH_MIN_BAND_ROWS 8              // Fewer rows per band would waste too much on overlap and overhead.
+#define SEARCH_MIN_PARALLEL_POSITIONS 65536 // Smaller searches take less time than waking the pool.
+
+struct BandSearch
+// Shared by the threads of a parallel SearchFirst().  Band b consists of the candidate rows from
+// b * band_rows to (b + 1) * band_rows - 1.  Since each band reads needle.height - 1 more haystack rows than
+// it has candidate rows, consecutive bands overlap by that much.
+{
+	const SearchContext *context;
+	const PIXEL32 *pixels;
+	int last_x, last_y, band_rows;
+	volatile int found_band; // Lowest band known to contain a match, or INT_MAX.
+	int x[SEARCH_MAX_BANDS], y[SEARCH_MAX_BANDS];
+};
+
+
+
+static void SearchBand(void *aParam, int aBand)
+// The first match in band b is the serial search's result if no earlier band has a match, so a band can
+// stop as soon as an earlier one is known to have one.  Bands are started in order, so the bands that are
+// still needed are always the ones that get searched first.
+{
+	BandSearch &search = *(BandSearch *)aParam;
+	const SearchContext &context = *search.context;
+	int y = aBand * search.band_rows;
+	int y_end = y + search.band_rows;
+	if (y_end > search.last_y + 1)
+		y_end = search.last_y + 1;
+	const PIXEL32 *row = search.pixels + y * context.stride;
+	for (; y < y_end && search.found_band > aBand; ++y, row += context.stride)
+	{
+		int x = context.row_func(context, row, 0, search.last_x + 1);
+		if (x < 0)
+			continue;
+		search.x[aBand] = x;
+		search.y[aBand] = y;
+		// Lower found_band to aBand unless another thread has already lowered it further:
+		for (int found_band; (found_band = search.found_band) > aBand; )
+			if (AtomicCompareExchange(&search.found_band, aBand, found_band) == found_band)
+				break;
+		break;
+	}
+}
+
+
+
+bool SearchFirst(const SearchImage &aHaystack, const SearchNeedle &aNeedle, int aVariation, int &aX, int &aY)
+// Finds the first position, in left-to-right then top-to-bottom order, at which aNeedle appears inside
+// aHaystack.  Only positions at which the needle lies entirely within the haystack are considered.
+// aVariation is 0 for an exact match, or 1-255 to allow each color component to differ by that many shades.
+// Returns true and sets aX/aY (relative to the haystack's upper-left corner) if found.
+// If SearchSetThreads() has enabled it, a large haystack is split into bands that are searched on the
+// thread pool.  The result is always the same as that of the serial search.
+{
+	int last_x = aHaystack.width - aNeedle.width;
+	int last_y = aHaystack.height - aNeedle.height;
+	if (last_x < 0 || last_y < 0) // Needle is larger than the haystack.
+		return false;
+
+	SearchContext context;
+	if (!SearchBegin(context, aNeedle, aHaystack.stride, aVariation))
+		return false;
+	bool found = false;
+	int threads = PoolGetThreads();
+	if (threads > 1 && (last_x + 1) * (last_y + 1) >= SEARCH_MIN_PARALLEL_POSITIONS
+		&& last_y + 1 >= 2 * SEARCH_MIN_BAND_ROWS)
+	{
+		// Several bands per thread so that the threads stay busy even if some bands end early.
+		int band_count = 4 * threads;
+		if (band_count > SEARCH_MAX_BANDS)
+			band_count = SEARCH_MAX_BANDS;
+		if (band_count > (last_y + 1) / SEARCH_MIN_BAND_ROWS)
+			band_count = (last_y + 1) / SEARCH_MIN_BAND_ROWS;
+		BandSearch *search = (BandSearch *)malloc(sizeof(BandSearch));
+		if (search)
+		{
+			search->context = &context;
+			search->pixels = aHaystack.pixels;
+			search->last_x = last_x;
+			search->last_y = last_y;
+			search->band_rows = (last_y + band_count) / band_count; // Rounded up so that the bands cover every row.
+			search->found_band = INT_MAX;
+			PoolRun(SearchBand, search, (last_y + search->band_rows) / search->band_rows);
+			if (search->found_band != INT_MAX)
+			{
+				aX = search->x[search->found_band];
+				aY = search->y[search->found_band];
+				found = true;
+			}
+			free(search);
+			goto end;
+		}
+		// Otherwise, fall back to the serial search.
+	}
+	const PIXEL32 *row;
+	row = aHaystack.pixels;
+	for (int y = 0; y <= last_y; ++y, row += aHaystack.stride)
+	{
+		int x = context.row_func(context, row, 0, last_x + 1);
+		if (x >= 0)
+		{
+			aX = x;
+			aY = y;
+			found = true;
+			break;
+		}
+	}
+end:
+	SearchEnd(context);
+	return found;
+}
+
+
+
+void SearchSetThreads(int aCount)
+// aCount is the number of threads SearchFirst() may use, including the caller's: 1 to always search
+// serially (the default) or 0 for one per CPU.
+{
+	PoolSetThreads(aCount);
+}
+
+
+
+bool OverlapsEarlierMatch(const SearchMatch *aMatch, int aMatchCount, int aX, int aY, const SearchNeedle &aNeedle)
+// Matches are found in scan order, so only those from the last needle.height rows can overlap (aX, aY).
+{
+	for (int i = aMatchCount - 1; i >= 0 && aMatch[i].y > aY - aNeedle.height; --i)
+		if (aMatch[i].x > aX - aNeedle.width && aMatch[i].x < aX + aNeedle.width)
+			return true;
+	return false;
+}
+
+
+
+static int SearchAllIn(const SearchImage &aHaystack, const SearchRegion *aRegion, int aLeft, int aTop
+	, const SearchNeedle &aNeedle, int aVariation, int aFlags, SearchMatch *aMatch, int aMaxMatches)
+// Does the work of SearchAll() and SearchAllRegion().  aRegion is NULL to search every position.
+{
+	int last_x = aHaystack.width - aNeedle.width;
+	int last_y = aHaystack.height - aNeedle.height;
+	if (last_x < 0 || last_y < 0 || aMaxMatches < 1)
+		return 0;
+
+	SearchContext context;
+	if (!SearchBegin(context, aNeedle, aHaystack.stride, aVariation))
+		return -1;
+	int match_count = 0;
+	SearchSpan whole = {aLeft, aLeft + last_x + 1};
+	const PIXEL32 *row = aHaystack.pixels;
+	for (int y = 0; y <= last_y; ++y, row += aHaystack.stride)
+	{
+		const SearchSpan *span = &whole;
+		int span_count = aRegion ? RegionRow(*aRegion, aTop + y, span) : 1;
+		for (int s = 0; s < span_count; ++s)
+		{
+			int x_begin, x_end;
+			if (!ClipSpan(span[s], aLeft, last_x, x_begin, x_end))
+				continue;
+			for (int x = x_begin; (x = context.row_func(context, row, x, x_end)) >= 0; )
+			{
+				if (aFlags & SEARCH_NO_OVERLAP)
+				{
+					if (OverlapsEarlierMatch(aMatch, match_count, x, y, aNeedle))
+					{
+						++x;
+						continue;
+					}
+				}
+				aMatch[match_count].x = x;
+				aMatch[match_count].y = y;
+				if (++match_count == aMaxMatches)
+					goto end;
+				// Nothing closer than one needle-width to the right can be reported when overlaps are skipped.
+				x += (aFlags & SEARCH_NO_OVERLAP) ? aNeedle.width : 1;
+			}
+		}
+	}
+end:
+	SearchEnd(context);
+	return match_count;
+}
+
+
+
+int SearchAll(const SearchImage &aHaystack, const SearchNeedle &aNeedle, int aVariation, int aFlags
+	, SearchMatch *aMatch, int aMaxMatches)
+// Same as SearchFirst() but keeps scanning after a match, storing up to aMaxMatches positions into aMatch
+// in scan order.  If aFlags contains SEARCH_NO_OVERLAP, a match that overlaps one already stored is
+// skipped, so that e.g. a solid-colored needle isn't reported at every pixel of a larger solid area.
+// Returns the number of matches stored, or -1 on failure.
+{
+	return SearchAllIn(aHaystack, NULL, 0, 0, aNeedle, aVariation, aFlags, aMatch, aMaxMatches);
+}
+
+
+
+int SearchAllRegion(const SearchImage &aHaystack, const SearchRegion &aRegion, int aLeft, int aTop
+	, const SearchNeedle &aNeedle, int aVariation, int aFlags, SearchMatch *aMatch, int aMaxMatches)
+{
+	return SearchAllIn(aHaystack, &aRegion, aLeft, aTop, aNeedle, aVariation, aFlags, aMatch, aMaxMatches);
+}
+
+
+
+bool SearchFirstRegion(const SearchImage &aHaystack, const SearchRegion &aRegion, int aLeft, int aTop
+	, const SearchNeedle &aNeedle, int aVariation, int &aX, int &aY)
+// Same as SearchFirst(), but only the positions in aRegion are tested: the row kernels are run over
+// each of its spans, so positions outside it cost nothing.  Always serial, since a region is normally
+// used to search much less than the whole haystack.
+{
+	SearchMatch match;
+	if (SearchAllIn(aHaystack, &aRegion, aLeft, aTop, aNeedle, aVariation, 0, &match, 1) < 1)
+		return false;
+	aX = match.x;
+	aY = match.y;
+	return true;
+}
+
+
+
+#define BATCH_EMPTY_KEY 0xFFFFFFFF // Can't be a real key because both color masks clear the high byte.
+
+struct BatchSlot
+{
+	PIXEL32 key;
+	int first; // Index of the first pending item whose probe pixel has this key, or -1.
+};
+
+#define BATCH_FILTER_BITS 16
+
+struct BatchTable
+// Open-addressing hash table of the exact-match items that share one color mask, keyed on the masked
+// color of each needle's probe pixel.
+{
+	PIXEL32 mask;
+	int shift; // 32 minus log2 of the slot count.
+	BatchSlot *slot;
+	// One bit per value of the top BATCH_FILTER_BITS bits of a key's hash, set if any key has that
+	// hash.  Nearly every screen pixel is rejected by this one test, which avoids probing the table and
+	// the mispredicted branches that would come with it.
+	unsigned char *filter;
+};
+
+struct BatchProbe
+{
+	int dx, dy; // Offset of the probe pixel (the needle's first sample pixel) within the needle.
+	int next;   // Next pending item in the same chain, or -1.
+};
+
+
+
+static inline unsigned int BatchHash(PIXEL32 aKey)
+{
+	return aKey * 2654435761U; // Knuth's multiplicative hash: the high-order bits are the best mixed.
+}
+
+
+
+static inline BatchSlot &BatchFind(BatchTable &aTable, PIXEL32 aKey)
+// Returns the slot holding aKey, or the empty slot where it would be added.
+{
+	int slot_mask = (1 << (32 - aTable.shift)) - 1;
+	int i = (int)(BatchHash(aKey) >> aTable.shift);
+	while (aTable.slot[i].key != aKey && aTable.slot[i].key != BATCH_EMPTY_KEY)
+		i = (i + 1) & slot_mask;
+	return aTable.slot[i];
+}
+
+
+
+int SearchBatch(const SearchImage &aHaystack, SearchBatchItem *aItem, int aItemCount)
+// Same as calling SearchFirst() for each item, but in one pass over the haystack: each row is visited
+// once for all the needles rather than once per needle.  For exact-match needles, each haystack pixel is
+// looked up once in a hash table of every pending needle's first sample pixel, so the cost of the scan
+// barely depends on how many needles there are.  Needles with a variation can't be found by hashing, so
+// their own row kernel is run over each row while it is still in the cache.
+// Sets each item's found/x/y.  Returns the number of items found, or -1 on failure (out of memory).
+{
+	if (aItemCount < 1)
+		return 0;
+	int found_count = 0, pending_count = 0, i;
+	for (i = 0; i < aItemCount; ++i)
+		aItem[i].found = false;
+
+	BatchProbe *probe = (BatchProbe *)malloc(aItemCount * sizeof(BatchProbe));
+	SearchContext **context = (SearchContext **)calloc(aItemCount, sizeof(SearchContext *)); // Variation items only.
+	BatchTable table[2] = {{SEARCH_COLOR_MASK, 32, NULL, NULL}, {SEARCH_COLOR_MASK_16BIT, 32, NULL, NULL}};
+	int t, table_count = 0;
+	int hashed_count[2] = {0, 0}; // Number of exact-match items for each table.
+	const PIXEL32 *row;
+	if (!probe || !context)
+	{
+		found_count = -1;
+		goto end;
+	}
+
+	// Sort the items into the hash tables and the variation list:
+	for (i = 0; i < aItemCount; ++i)
+	{
+		const SearchNeedle &needle = *aItem[i].needle;
+		probe[i].next = -1;
+		if (needle.width > aHaystack.width || needle.height > aHaystack.height)
+		{
+			probe[i].dx = -1; // Can never be found.
+			continue;
+		}
+		++pending_count;
+		if (aItem[i].variation > 0)
+		{
+			if (   !(context[i] = (SearchContext *)malloc(sizeof(SearchContext)))   )
+			{
+				found_count = -1;
+				goto end;
+			}
+			if (!SearchBegin(*context[i], needle, aHaystack.stride, aItem[i].variation))
+			{
+				free(context[i]);
+				context[i] = NULL;
+				found_count = -1;
+				goto end;
+			}
+			probe[i].dx = -1;
+			continue;
+		}
+		int j = needle.sample[0];
+		if (!needle.care[j]) // Entirely transparent, so it matches at the first position.
+		{
+			aItem[i].found = true;
+			aItem[i].x = aItem[i].y = 0;
+			++found_count;
+			--pending_count;
+			probe[i].dx = -1;
+			continue;
+		}
+		probe[i].dx = j % needle.width;
+		probe[i].dy = j / needle.width;
+		++hashed_count[needle.color_mask == SEARCH_COLOR_MASK_16BIT];
+	}
+	for (t = 0; t < 2; ++t)
+	{
+		if (!hashed_count[t])
+			continue;
+		int bits = 4;
+		while ((1 << bits) < 2 * hashed_count[t]) // Keep the load factor at or below one half.
+			++bits;
+		BatchTable &tab = table[table_count++];
+		tab.mask = t ? SEARCH_COLOR_MASK_16BIT : SEARCH_COLOR_MASK;
+		tab.shift = 32 - bits;
+		if (   !(tab.slot = (BatchSlot *)malloc(((size_t)1 << bits) * sizeof(BatchSlot)))
+			|| !(tab.filter = (unsigned char *)calloc(1 << (BATCH_FILTER_BITS - 3), 1))   )
+		{
+			found_count = -1;
+			goto end;
+		}
+		for (int s = 0; s < (1 << bits); ++s)
+		{
+			tab.slot[s].key = BATCH_EMPTY_KEY;
+			tab.slot[s].first = -1;
+		}
+		// Add the items in reverse so that each chain lists them in their original order:
+		for (i = aItemCount - 1; i >= 0; --i)
+		{
+			const SearchNeedle &needle = *aItem[i].needle;
+			if (probe[i].dx < 0 || context[i] || aItem[i].found || needle.color_mask != tab.mask)
+				continue;
+			int j = probe[i].dy * needle.width + probe[i].dx;
+			BatchSlot &slot = BatchFind(tab, needle.value[j]);
+			slot.key = needle.value[j];
+			probe[i].next = slot.first;
+			slot.first = i;
+			unsigned int h = BatchHash(slot.key) >> (32 - BATCH_FILTER_BITS);
+			tab.filter[h >> 3] |= 1 << (h & 7);
+		}
+	}
+
+	row = aHaystack.pixels;
+	for (int y = 0; y < aHaystack.height && pending_count; ++y, row += aHaystack.stride)
+	{
+		for (t = 0; t < table_count; ++t)
+		{
+			BatchTable &tab = table[t];
+			for (int x = 0; x < aHaystack.width; ++x)
+			{
+				PIXEL32 key = row[x] & tab.mask;
+				unsigned int h = BatchHash(key) >> (32 - BATCH_FILTER_BITS);
+				if (!(tab.filter[h >> 3] & (1 << (h & 7))))
+					continue;
+				BatchSlot &slot = BatchFind(tab, key);
+				// Walk the chain of needles whose probe pixel has this color, unlinking any that are found.
+				for (int *link = &slot.first; *link >= 0; )
+				{
+					i = *link;
+					const SearchNeedle &needle = *aItem[i].needle;
+					int cx = x - probe[i].dx, cy = y - probe[i].dy;
+					if (cx >= 0 && cy >= 0 && cx <= aHaystack.width - needle.width && cy <= aHaystack.height - needle.height
+						&& MatchExactAt(aHaystack.pixels + cy * (ptrdiff_t)aHaystack.stride + cx, aHaystack.stride, needle))
+					{
+						aItem[i].found = true;
+						aItem[i].x = cx;
+						aItem[i].y = cy;
+						++found_count;
+						--pending_count;
+						*link = probe[i].next;
+					}
+					else
+						link = &probe[i].next;
+				}
+			}
+		}
+		for (i = 0; i < aItemCount; ++i)
+		{
+			if (!context[i] || aItem[i].found || y > aHaystack.height - aItem[i].needle->height)
+				continue;
+			int x = context[i]->row_func(*context[i], row, 0, aHaystack.width - aItem[i].needle->width + 1);
+			if (x >= 0)
+			{
+				aItem[i].found = true;
+				aItem[i].x = x;
+				aItem[i].y = y;
+				++found_count;
+				--pending_count;
+			}
+		}
+	}
+
+end:
+	for (t = 0; t < 2; ++t)
+	{
+		free(table[t].slot);
+		free(table[t].filter);
+	}
+	if (context)
+	{
+		for (i = 0; i < aItemCount; ++i)
+			if (context[i])
+			{
+				SearchEnd(*context[i]);
+				free(context[i]);
+			}
+		free(context);
+	}
+	free(probe);
+	return found_count;
+}
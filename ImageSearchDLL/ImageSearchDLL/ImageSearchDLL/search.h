@@ -0,0 +1,182 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// The pixel-matching engine behind ImageSearch().  Everything declared here works on pixels that are
+// already in memory, so this header and search.cpp must not include <windows.h> or stdafx.h: they are
+// built as-is by g++/clang so that the search loops can be benchmarked against recorded screenshots.
+
+#ifndef search_h
+#define search_h
+
+#include <stddef.h>
+
+typedef unsigned int PIXEL32; // Same layout as the COLORREFs produced by getbits(): 0x00RRGGBB.  The high byte is ignored.
+
+#define SEARCH_COLOR_MASK 0x00FFFFFF       // Normal mask applied to both images before comparing.
+#define SEARCH_COLOR_MASK_16BIT 0x00F8F8F8 // Used when either image came from a 16-bit source.
+#define SEARCH_NO_TRANS 0xFFFFFFFF         // Same value as CLR_NONE: no color of the needle is transparent.
+#define SEARCH_SAMPLES 8                   // Maximum number of sample pixels a needle is prefiltered with.
+
+struct SearchImage
+// A read-only view of 32-bit pixels owned by someone else.  stride is in pixels (not bytes) and may be
+// larger than width for padded rows, or negative for bottom-up bitmaps (pixels then points to the top row).
+{
+	const PIXEL32 *pixels;
+	int width, height, stride;
+};
+
+#define SEARCH_ALIGN 64 // Bytes: a cache line, or two AVX2 vectors.
+
+inline int AlignedStride(int aWidth, int aPixelSize)
+// Returns the stride, in pixels, of the images the engine allocates itself (planes, pyramid levels, a watch's
+// copy of the haystack), and of the frames the DLL captures: aWidth padded to a multiple of SEARCH_ALIGN
+// bytes.  Their pixels start on a multiple of SEARCH_ALIGN too, so every row starts on a cache line, and
+// no line holds the end of one row and the start of the next.
+{
+	int per_block = SEARCH_ALIGN / aPixelSize;
+	return (aWidth + per_block - 1) / per_block * per_block;
+}
+
+struct NeedleSpectrum; // Defined in search_kernels.h.
+struct NeedlePack;     // Defined in needlepack.cpp.
+
+struct SearchNeedle
+// An image prepared for being searched for.  Created by NeedleCreate(); the caller's pixels are no
+// longer needed afterward.  Needles are reference counted so that a cached one can be evicted while a
+// search is still using it.
+{
+	volatile int ref_count;
+	int width, height;
+	PIXEL32 color_mask; // SEARCH_COLOR_MASK or SEARCH_COLOR_MASK_16BIT.
+	PIXEL32 *value;     // width*height pixels, each already ANDed with its care[] entry.
+	PIXEL32 *care;      // Per-pixel AND-mask: color_mask for opaque pixels, zero for transparent ones.
+	                    // This folds both the high-byte masking and the transparency checks into one AND.
+	// A few of the needle's most distinctive pixels, as indexes into value[] and care[] (see PickSamples()).
+	// The row kernels test sample[0] at every candidate position, and the rest only where it matches,
+	// so that only positions that pass all of them get the full comparison.
+	int sample_count;   // At least 1.  sample[0] is transparent only if the whole needle is.
+	int sample[SEARCH_SAMPLES];
+	NeedleSpectrum *volatile spectrum; // Built by SearchScored() when it first correlates this needle by FFT, or NULL.
+	NeedlePack *pack;   // The mapped pack file that value[] and care[] point into, or NULL if they are the needle's
+	                    // own.  A packed needle belongs to its pack, which its references are counted against.
+};
+
+SearchNeedle *NeedleCreate(const SearchImage &aImage, const SearchImage *aMask, PIXEL32 aTransColor
+	, PIXEL32 aColorMask);
+void NeedleAddRef(SearchNeedle *aNeedle);
+void NeedleRelease(SearchNeedle *aNeedle);
+SearchNeedle *NeedleWithColorMask(const SearchNeedle &aNeedle, PIXEL32 aColorMask);
+
+struct SearchMatch
+{
+	int x, y; // Upper-left corner of the match, relative to the haystack's.
+};
+
+#define SEARCH_NO_OVERLAP 0x01 // SearchAll(): skip matches that overlap one already reported.
+
+bool SearchFirst(const SearchImage &aHaystack, const SearchNeedle &aNeedle, int aVariation, int &aX, int &aY);
+void SearchSetThreads(int aCount);
+int SearchAll(const SearchImage &aHaystack, const SearchNeedle &aNeedle, int aVariation, int aFlags
+	, SearchMatch *aMatch, int aMaxMatches);
+
+// Channels that an image can be reduced to, for SearchScored() and the SearchPlane functions.
+#define SEARCH_CHANNEL_LUMA 0  // Rec. 601 luminance.
+#define SEARCH_CHANNEL_RED 1
+#define SEARCH_CHANNEL_GREEN 2
+#define SEARCH_CHANNEL_BLUE 3
+
+// Methods for SearchScored().  Both compare luminance only (unless given a channel), and score 1 for a perfect match.
+#define SEARCH_SCORE_NCC 0 // Normalized cross-correlation (-1 to 1): unaffected by uniform changes of brightness and contrast.
+#define SEARCH_SCORE_SSD 1 // 1 minus the sum of squared differences, as a fraction of the largest possible one (0 to 1).
+#define SEARCH_SCORE_CHANNEL(c) ((c) << 4) // Added to a method: compare SEARCH_CHANNEL_c instead of luminance.
+
+struct SearchScoredMatch
+{
+	int x, y; // Upper-left corner of the match, relative to the haystack's.
+	float score;
+};
+
+int SearchScored(const SearchImage &aHaystack, const SearchNeedle &aNeedle, int aMethod, float aMinScore
+	, SearchScoredMatch *aMatch, int aMaxMatches, int aFFT = -1);
+
+struct SearchRegion; // Defined in search_kernels.h.
+
+SearchRegion *RegionCreatePolygon(const int *aPoint, int aPointCount);
+SearchRegion *RegionCreateMask(const SearchImage &aMask, int aLeft, int aTop);
+void RegionAddRef(SearchRegion *aRegion);
+void RegionRelease(SearchRegion *aRegion);
+
+// Same as the functions above, but only positions inside aRegion are considered.  aLeft and aTop are the
+// coordinates of the haystack's upper-left pixel in the region's coordinates (usually the screen's).
+bool SearchFirstRegion(const SearchImage &aHaystack, const SearchRegion &aRegion, int aLeft, int aTop
+	, const SearchNeedle &aNeedle, int aVariation, int &aX, int &aY);
+int SearchAllRegion(const SearchImage &aHaystack, const SearchRegion &aRegion, int aLeft, int aTop
+	, const SearchNeedle &aNeedle, int aVariation, int aFlags, SearchMatch *aMatch, int aMaxMatches);
+int SearchScoredRegion(const SearchImage &aHaystack, const SearchRegion &aRegion, int aLeft, int aTop
+	, const SearchNeedle &aNeedle, int aMethod, float aMinScore, SearchScoredMatch *aMatch, int aMaxMatches
+	, int aFFT = -1);
+
+struct SearchPyramid; // Defined in search_pyramid.cpp.
+
+SearchPyramid *PyramidCreate(const SearchImage &aHaystack, PIXEL32 aColorMask);
+void PyramidFree(SearchPyramid *aPyramid);
+bool SearchFirstPyramid(const SearchPyramid &aPyramid, int aLeft, int aTop, int aWidth, int aHeight
+	, const SearchNeedle &aNeedle, int aVariation, int &aX, int &aY);
+
+typedef unsigned char PIXEL8;
+
+struct SearchPlane
+// One channel of an image, or its luminance, as 8-bit pixels: a quarter of the memory the image takes, so
+// searching it reads a quarter as much and each vector compare tests four times as many positions.
+// PlaneCreate() allocates the pixels, with rows padded to AlignedStride(); a copy with pixels advanced
+// and a smaller width/height is a view of part of it, the same as for a SearchImage.
+{
+	const PIXEL8 *pixels;
+	int width, height, stride; // stride is in pixels (bytes), as for SearchImage.
+	int channel;               // SEARCH_CHANNEL_*.  Needles are reduced the same way when searched for.
+	PIXEL32 color_mask;        // Applied to each pixel before it was reduced.
+};
+
+bool PlaneCreate(const SearchImage &aImage, int aChannel, PIXEL32 aColorMask, SearchPlane &aPlane);
+void PlaneFree(SearchPlane &aPlane);
+bool SearchFirstPlane(const SearchPlane &aHaystack, const SearchNeedle &aNeedle, int aVariation, int &aX, int &aY);
+int SearchAllPlane(const SearchPlane &aHaystack, const SearchNeedle &aNeedle, int aVariation, int aFlags
+	, SearchMatch *aMatch, int aMaxMatches);
+bool SearchFirstPlaneRegion(const SearchPlane &aHaystack, const SearchRegion &aRegion, int aLeft, int aTop
+	, const SearchNeedle &aNeedle, int aVariation, int &aX, int &aY);
+int SearchAllPlaneRegion(const SearchPlane &aHaystack, const SearchRegion &aRegion, int aLeft, int aTop
+	, const SearchNeedle &aNeedle, int aVariation, int aFlags, SearchMatch *aMatch, int aMaxMatches);
+
+struct SearchBatchItem
+// One of the needles given to SearchBatch(), and its result.
+{
+	const SearchNeedle *needle;
+	int variation;
+	bool found; // Set by SearchBatch(), along with x and y if true.
+	int x, y;
+};
+
+int SearchBatch(const SearchImage &aHaystack, SearchBatchItem *aItem, int aItemCount);
+
+struct SearchWatch; // Defined in search_watch.cpp.
+
+SearchWatch *WatchCreate();
+void WatchFree(SearchWatch *aWatch);
+bool WatchSearchFirst(SearchWatch &aWatch, const SearchImage &aHaystack, const SearchNeedle &aNeedle, int aVariation
+	, int &aX, int &aY);
+int WatchSearchBatch(SearchWatch &aWatch, const SearchImage &aHaystack, SearchBatchItem *aItem, int aItemCount);
+
+#endif
@@ -0,0 +1,126 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// A small radix-2 FFT, just enough for SearchScored() to correlate large needles in the frequency domain
+// (see search_score.cpp) without depending on an outside library.  Everything is in doubles: the
+// correlations it computes are sums of products of whole numbers, and double precision keeps the error
+// far enough below 0.5 that rounding the results gives exactly what the spatial sums would.
+
+#include "search_kernels.h"
+#include <stdlib.h>
+#include <math.h>
+
+
+
+bool FftPlanInit(FftPlan &aPlan, int aSize)
+// aSize must be a power of two.  Returns false on failure (out of memory), in which case FftPlanFree()
+// may still be called.
+{
+	aPlan.size = aSize;
+	for (aPlan.bits = 0; (1 << aPlan.bits) < aSize; ++aPlan.bits);
+	aPlan.cos = (double *)malloc((aSize / 2 + 1) * 2 * sizeof(double));
+	aPlan.reverse = (int *)malloc(aSize * sizeof(int));
+	if (!aPlan.cos || !aPlan.reverse)
+		return false;
+	aPlan.sin = aPlan.cos + aSize / 2 + 1;
+	const double pi = 3.14159265358979323846;
+	for (int i = 0; i <= aSize / 2; ++i)
+	{
+		aPlan.cos[i] = cos(2 * pi * i / aSize);
+		aPlan.sin[i] = sin(2 * pi * i / aSize);
+	}
+	for (int i = 0; i < aSize; ++i)
+	{
+		int r = 0;
+		for (int b = 0; b < aPlan.bits; ++b)
+			if (i & (1 << b))
+				r |= 1 << (aPlan.bits - 1 - b);
+		aPlan.reverse[i] = r;
+	}
+	return true;
+}
+
+
+
+void FftPlanFree(FftPlan &aPlan)
+{
+	free(aPlan.cos); // sin shares this block.
+	free(aPlan.reverse);
+	aPlan.cos = aPlan.sin = NULL;
+	aPlan.reverse = NULL;
+}
+
+
+
+static void Fft(const FftPlan &aPlan, double *aRe, double *aIm, bool aInverse)
+// In-place transform of aPlan.size complex values.  The inverse is not scaled by 1/size.
+{
+	int n = aPlan.size, i;
+	for (i = 0; i < n; ++i)
+	{
+		int r = aPlan.reverse[i];
+		if (r > i)
+		{
+			double t = aRe[i]; aRe[i] = aRe[r]; aRe[r] = t;
+			t = aIm[i]; aIm[i] = aIm[r]; aIm[r] = t;
+		}
+	}
+	double sign = aInverse ? 1 : -1;
+	for (int half = 1; half < n; half *= 2)
+	{
+		int step = n / (2 * half); // Twiddle k of this pass is entry k*step of the table.
+		for (int start = 0; start < n; start += 2 * half)
+		{
+			for (int k = 0; k < half; ++k)
+			{
+				double wr = aPlan.cos[k * step], wi = sign * aPlan.sin[k * step];
+				int a = start + k, b = a + half;
+				double tr = aRe[b] * wr - aIm[b] * wi;
+				double ti = aRe[b] * wi + aIm[b] * wr;
+				aRe[b] = aRe[a] - tr;
+				aIm[b] = aIm[a] - ti;
+				aRe[a] += tr;
+				aIm[a] += ti;
+			}
+		}
+	}
+}
+
+
+
+void Fft2D(const FftPlan &aPlanX, const FftPlan &aPlanY, double *aRe, double *aIm, double *aColumn, bool aInverse)
+// In-place transform of aPlanY.size rows of aPlanX.size complex values.  aColumn must have room for
+// 2*aPlanY.size doubles: each column is copied there so that its transform works on adjacent memory.
+{
+	int width = aPlanX.size, height = aPlanY.size, x, y;
+	for (y = 0; y < height; ++y)
+		Fft(aPlanX, aRe + y * width, aIm + y * width, aInverse);
+	double *column_im = aColumn + height;
+	for (x = 0; x < width; ++x)
+	{
+		for (y = 0; y < height; ++y)
+		{
+			aColumn[y] = aRe[y * width + x];
+			column_im[y] = aIm[y * width + x];
+		}
+		Fft(aPlanY, aColumn, column_im, aInverse);
+		for (y = 0; y < height; ++y)
+		{
+			aRe[y * width + x] = aColumn[y];
+			aIm[y * width + x] = column_im[y];
+		}
+	}
+}
@@ -0,0 +1,242 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// Internal to the search engine: the per-row matching kernels and what they need to share.  Like
+// search.h, this must not include <windows.h>.
+
+#ifndef search_kernels_h
+#define search_kernels_h
+
+#include "search.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define SEARCH_X86 // SSE2 kernels (and AVX2 ones, if SEARCH_AVX2) are compiled in and chosen at runtime.
+#if !defined(_MSC_VER) || _MSC_VER >= 1700
+#define SEARCH_AVX2 // Visual C++ has the integer AVX2 intrinsics only from version 2012 on.
+#endif
+#endif
+
+struct SearchContext;
+
+// A row kernel tests the candidate positions aRow[aXBegin] through aRow[aXEnd - 1] from left to right,
+// where aRow points to the haystack row in which the needle's top row would lie.  It returns the first
+// x at which the whole needle matches, or -1 if none.  The caller guarantees that the needle fits
+// inside the haystack at every one of those positions.
+typedef int (*SearchRowFunc)(const SearchContext &aContext, const PIXEL32 *aRow, int aXBegin, int aXEnd);
+
+#define SEARCH_BOUNDS_BUF 2048 // Needles of up to half this many pixels need no allocation for their bounds.
+
+struct SearchContext
+// Everything a row kernel needs to test candidate positions, set up once per search by SearchBegin().
+{
+	const SearchNeedle *needle;
+	ptrdiff_t stride; // The haystack's stride, in pixels.
+	int variation;
+	SearchRowFunc row_func;
+	const PIXEL32 *low, *high; // Variation mode only: per-pixel inclusive bounds for each byte of a screen pixel.
+	ptrdiff_t sample_offset[SEARCH_SAMPLES]; // Offset of each of the needle's sample pixels from a candidate position.
+	PIXEL32 bounds_buf[SEARCH_BOUNDS_BUF];
+};
+
+bool SearchBegin(SearchContext &aContext, const SearchNeedle &aNeedle, ptrdiff_t aStride, int aVariation);
+void SearchEnd(SearchContext &aContext);
+
+inline bool PixelInBounds(PIXEL32 aScreen, PIXEL32 aLow, PIXEL32 aHigh)
+// Scalar version of the variation test: each color component of aScreen must lie within the
+// corresponding bytes of aLow and aHigh.
+{
+	return (aScreen & 0xFF) >= (aLow & 0xFF) && (aScreen & 0xFF) <= (aHigh & 0xFF)
+		&& (aScreen & 0xFF00) >= (aLow & 0xFF00) && (aScreen & 0xFF00) <= (aHigh & 0xFF00)
+		&& (aScreen & 0xFF0000) >= (aLow & 0xFF0000) && (aScreen & 0xFF0000) <= (aHigh & 0xFF0000);
+}
+
+inline PIXEL32 PixelMin(PIXEL32 a, PIXEL32 b)
+// The smaller of each of the three color components.  The high byte of the result is zero.
+{
+	return ((a & 0xFF) < (b & 0xFF) ? a & 0xFF : b & 0xFF)
+		| ((a & 0xFF00) < (b & 0xFF00) ? a & 0xFF00 : b & 0xFF00)
+		| ((a & 0xFF0000) < (b & 0xFF0000) ? a & 0xFF0000 : b & 0xFF0000);
+}
+
+inline PIXEL32 PixelMax(PIXEL32 a, PIXEL32 b)
+{
+	return ((a & 0xFF) > (b & 0xFF) ? a & 0xFF : b & 0xFF)
+		| ((a & 0xFF00) > (b & 0xFF00) ? a & 0xFF00 : b & 0xFF00)
+		| ((a & 0xFF0000) > (b & 0xFF0000) ? a & 0xFF0000 : b & 0xFF0000);
+}
+
+inline bool SamplesMatchExact(const SearchContext &aContext, const PIXEL32 *aScreen)
+// Tests the needle's sample pixels other than the first (which the row kernels test themselves) at the
+// candidate position aScreen.  Done before the full comparison because it rejects most positions that
+// the first sample lets through, at the cost of a few loads.
+{
+	const SearchNeedle &needle = *aContext.needle;
+	for (int i = 1; i < needle.sample_count; ++i)
+		if ((aScreen[aContext.sample_offset[i]] & needle.care[needle.sample[i]]) != needle.value[needle.sample[i]])
+			return false;
+	return true;
+}
+
+inline bool SamplesMatchVariation(const SearchContext &aContext, const PIXEL32 *aScreen)
+{
+	const SearchNeedle &needle = *aContext.needle;
+	for (int i = 1; i < needle.sample_count; ++i)
+		if (!PixelInBounds(aScreen[aContext.sample_offset[i]], aContext.low[needle.sample[i]], aContext.high[needle.sample[i]]))
+			return false;
+	return true;
+}
+
+inline PIXEL8 Luminance(PIXEL32 aPixel)
+// Rec. 601 weights in 8-bit fixed point.  They add up to 256, so white stays 255.
+{
+	return (PIXEL8)((((aPixel >> 16) & 0xFF) * 77 + ((aPixel >> 8) & 0xFF) * 150 + (aPixel & 0xFF) * 29 + 128) >> 8);
+}
+
+inline PIXEL8 PixelChannel(PIXEL32 aPixel, int aChannel)
+{
+	switch (aChannel)
+	{
+	case SEARCH_CHANNEL_RED: return (PIXEL8)(aPixel >> 16);
+	case SEARCH_CHANNEL_GREEN: return (PIXEL8)(aPixel >> 8);
+	case SEARCH_CHANNEL_BLUE: return (PIXEL8)aPixel;
+	default: return Luminance(aPixel);
+	}
+}
+
+struct PlaneContext;
+
+// Same as SearchRowFunc, for a SearchPlane.
+typedef int (*PlaneRowFunc)(const PlaneContext &aContext, const PIXEL8 *aRow, int aXBegin, int aXEnd);
+
+struct PlaneContext
+// Everything a plane row kernel needs, set up once per search by PlaneSearchBegin().  Exact and variation
+// searches are the same here: a screen pixel matches when it lies within the needle pixel's bounds, which
+// are equal for an exact search (and 0 to 255 for a transparent pixel).
+{
+	int width, height; // Of the needle.
+	ptrdiff_t stride;  // The haystack's stride, in pixels.
+	PlaneRowFunc row_func;
+	const PIXEL8 *low, *high; // Per-pixel inclusive bounds of the needle, reduced to the plane's channel.
+	int sample_count;
+	ptrdiff_t sample_offset[SEARCH_SAMPLES]; // As in SearchContext: the needle's sample pixels.
+	PIXEL8 sample_low[SEARCH_SAMPLES], sample_high[SEARCH_SAMPLES];
+	PIXEL8 bounds_buf[2 * SEARCH_BOUNDS_BUF];
+};
+
+inline bool PlaneSamplesMatch(const PlaneContext &aContext, const PIXEL8 *aScreen)
+// Same as SamplesMatchExact(), for a plane.  The unsigned subtraction tests both bounds at once.
+{
+	for (int i = 1; i < aContext.sample_count; ++i)
+		if ((unsigned)(aScreen[aContext.sample_offset[i]] - aContext.sample_low[i])
+			> (unsigned)(aContext.sample_high[i] - aContext.sample_low[i]))
+			return false;
+	return true;
+}
+
+// Pyramid reducers (see search_pyramid.cpp): each of the aCount pixels of aOut becomes the per-component
+// minimum (or maximum) of a 2x2 block, made of pixels 2i and 2i+1 of aRow0 and aRow1, after ANDing them
+// with aMask.
+typedef void (*PyramidReduceFunc)(const PIXEL32 *aRow0, const PIXEL32 *aRow1, int aCount, PIXEL32 aMask, PIXEL32 *aOut);
+
+// Dot product of two rows of luminance values (see search_score.cpp).
+typedef int (*DotRowFunc)(const short *aA, const short *aB, int aCount);
+
+// Radix-2 FFT (see search_fft.cpp).
+struct FftPlan
+{
+	int size, bits;    // size is 2 to the power bits.
+	double *cos, *sin; // size/2 + 1 entries each: the twiddle factors.
+	int *reverse;      // The bit-reversed index of each element.
+};
+
+bool FftPlanInit(FftPlan &aPlan, int aSize);
+void FftPlanFree(FftPlan &aPlan);
+void Fft2D(const FftPlan &aPlanX, const FftPlan &aPlanY, double *aRe, double *aIm, double *aColumn, bool aInverse);
+
+struct NeedleSpectrum
+// The transform of a needle's luminance (or one channel), zero-padded to width x height (see search_score.cpp).
+{
+	int width, height;
+	int channel; // SEARCH_CHANNEL_*.
+	double *re, *im;
+};
+
+void SpectrumFree(NeedleSpectrum *aSpectrum);
+
+struct SearchSpan
+{
+	int x_begin, x_end; // Positions x_begin through x_end - 1 of a row.
+};
+
+struct SearchRegion
+// The positions of a region of interest, as the spans of each row, left to right (see search_region.cpp).
+{
+	volatile int ref_count;
+	int top, height; // Only rows top through top + height - 1 have any spans.
+	int *row_first;  // height + 1 entries: the spans of row top + i are span[row_first[i]] up to span[row_first[i + 1]].
+	SearchSpan *span;
+};
+
+inline int RegionRow(const SearchRegion &aRegion, int aY, const SearchSpan *&aSpan)
+// Returns the number of spans in row aY of aRegion and sets aSpan to the first of them.
+{
+	aY -= aRegion.top;
+	if (aY < 0 || aY >= aRegion.height)
+		return 0;
+	aSpan = aRegion.span + aRegion.row_first[aY];
+	return aRegion.row_first[aY + 1] - aRegion.row_first[aY];
+}
+
+inline bool ClipSpan(const SearchSpan &aSpan, int aLeft, int aLastX, int &aXBegin, int &aXEnd)
+// Converts aSpan to positions in a haystack whose upper-left pixel is at aLeft in the region's coordinates,
+// limited to the positions 0 through aLastX.  Returns false if none are left.
+{
+	aXBegin = aSpan.x_begin - aLeft;
+	aXEnd = aSpan.x_end - aLeft;
+	if (aXBegin < 0)
+		aXBegin = 0;
+	if (aXEnd > aLastX + 1)
+		aXEnd = aLastX + 1;
+	return aXBegin < aXEnd;
+}
+
+bool OverlapsEarlierMatch(const SearchMatch *aMatch, int aMatchCount, int aX, int aY, const SearchNeedle &aNeedle);
+int RowExact(const SearchContext &aContext, const PIXEL32 *aRow, int aXBegin, int aXEnd);
+int RowVariation(const SearchContext &aContext, const PIXEL32 *aRow, int aXBegin, int aXEnd);
+int RowPlane(const PlaneContext &aContext, const PIXEL8 *aRow, int aXBegin, int aXEnd);
+int DotRow(const short *aA, const short *aB, int aCount);
+
+#ifdef SEARCH_X86
+#define CPU_SSE2 0x01
+#define CPU_AVX2 0x02
+int CpuFeatures(); // Combination of the CPU_* flags supported by the processor, the OS and this build.
+
+int RowExactSSE2(const SearchContext &aContext, const PIXEL32 *aRow, int aXBegin, int aXEnd);
+int RowVariationSSE2(const SearchContext &aContext, const PIXEL32 *aRow, int aXBegin, int aXEnd);
+int RowPlaneSSE2(const PlaneContext &aContext, const PIXEL8 *aRow, int aXBegin, int aXEnd);
+void PyramidMinSSE2(const PIXEL32 *aRow0, const PIXEL32 *aRow1, int aCount, PIXEL32 aMask, PIXEL32 *aOut);
+void PyramidMaxSSE2(const PIXEL32 *aRow0, const PIXEL32 *aRow1, int aCount, PIXEL32 aMask, PIXEL32 *aOut);
+int DotRowSSE2(const short *aA, const short *aB, int aCount);
+
+#ifdef SEARCH_AVX2
+int RowExactAVX2(const SearchContext &aContext, const PIXEL32 *aRow, int aXBegin, int aXEnd);
+int RowVariationAVX2(const SearchContext &aContext, const PIXEL32 *aRow, int aXBegin, int aXEnd);
+int RowPlaneAVX2(const PlaneContext &aContext, const PIXEL8 *aRow, int aXBegin, int aXEnd);
+int DotRowAVX2(const short *aA, const short *aB, int aCount);
+#endif
+#endif
+
+#endif
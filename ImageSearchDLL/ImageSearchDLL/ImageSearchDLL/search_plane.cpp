@@ -0,0 +1,257 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// Searching one channel of the screen, or its luminance, rather than whole pixels: for needles such as
+// text whose color is all that matters in one channel, or whose background varies in the others.  The
+// haystack is reduced to 8-bit pixels once (by PlaneCreate(), which a frame keeps for all the searches
+// run on it), and each needle is reduced when a search begins.  A needle pixel is compared with the
+// screen pixel's reduced value alone, exactly or within the variation.
+
+// No stdafx.h here: see search.h.
+#include "search_kernels.h"
+#include "platform.h"
+#include <stdlib.h>
+
+
+
+bool PlaneCreate(const SearchImage &aImage, int aChannel, PIXEL32 aColorMask, SearchPlane &aPlane)
+// Reduces aImage to aChannel (one of the SEARCH_CHANNEL_* values) after ANDing each pixel with aColorMask,
+// which must be the color mask of the needles that will be searched for.  Returns false on failure.
+// Caller must PlaneFree(aPlane) when done.
+{
+	if (aImage.width < 1 || aImage.height < 1 || aChannel < SEARCH_CHANNEL_LUMA || aChannel > SEARCH_CHANNEL_BLUE)
+		return false;
+	int stride = AlignedStride(aImage.width, sizeof(PIXEL8));
+	PIXEL8 *pixels = (PIXEL8 *)AlignedAlloc((size_t)stride * aImage.height, SEARCH_ALIGN);
+	if (!pixels)
+		return false;
+	aPlane.pixels = pixels;
+	aPlane.width = aImage.width;
+	aPlane.height = aImage.height;
+	aPlane.stride = stride;
+	aPlane.channel = aChannel;
+	aPlane.color_mask = aColorMask;
+	const PIXEL32 *row = aImage.pixels;
+	for (int y = 0; y < aImage.height; ++y, row += aImage.stride, pixels += stride)
+	{
+		// One loop per channel, so that the compiler can vectorize the simple ones:
+		int x;
+		switch (aChannel)
+		{
+		case SEARCH_CHANNEL_RED:
+			for (x = 0; x < aImage.width; ++x)
+				pixels[x] = (PIXEL8)((row[x] & aColorMask) >> 16);
+			break;
+		case SEARCH_CHANNEL_GREEN:
+			for (x = 0; x < aImage.width; ++x)
+				pixels[x] = (PIXEL8)((row[x] & aColorMask) >> 8);
+			break;
+		case SEARCH_CHANNEL_BLUE:
+			for (x = 0; x < aImage.width; ++x)
+				pixels[x] = (PIXEL8)(row[x] & aColorMask);
+			break;
+		default:
+			for (x = 0; x < aImage.width; ++x)
+				pixels[x] = Luminance(row[x] & aColorMask);
+		}
+	}
+	return true;
+}
+
+
+
+void PlaneFree(SearchPlane &aPlane)
+// aPlane must be the one PlaneCreate() set, not a view of part of it.
+{
+	AlignedFree((void *)aPlane.pixels);
+	aPlane.pixels = NULL;
+}
+
+
+
+static bool MatchPlaneAt(const PIXEL8 *aScreen, const PlaneContext &aContext)
+{
+	const PIXEL8 *low = aContext.low, *high = aContext.high;
+	for (int y = 0; y < aContext.height; ++y, aScreen += aContext.stride, low += aContext.width, high += aContext.width)
+		for (int x = 0; x < aContext.width; ++x)
+			if (aScreen[x] < low[x] || aScreen[x] > high[x])
+				return false;
+	return true;
+}
+
+
+
+int RowPlane(const PlaneContext &aContext, const PIXEL8 *aRow, int aXBegin, int aXEnd)
+// Portable version of the plane row kernel.
+{
+	unsigned int low0 = aContext.sample_low[0], range0 = aContext.sample_high[0] - low0;
+	const PIXEL8 *probe = aRow + aContext.sample_offset[0];
+	for (int x = aXBegin; x < aXEnd; ++x)
+		if ((unsigned int)(probe[x] - low0) <= range0 && PlaneSamplesMatch(aContext, aRow + x)
+			&& MatchPlaneAt(aRow + x, aContext))
+			return x;
+	return -1;
+}
+
+
+
+static bool PlaneSearchBegin(PlaneContext &aContext, const SearchPlane &aHaystack, const SearchNeedle &aNeedle
+	, int aVariation)
+// Reduces aNeedle to the haystack's channel, as the bounds each screen pixel must lie within.
+// Returns false on failure (out of memory).  Each successful call must be balanced by PlaneSearchEnd().
+{
+	int pixel_count = aNeedle.width * aNeedle.height, i;
+	PIXEL8 *low = aContext.bounds_buf;
+	if (pixel_count > SEARCH_BOUNDS_BUF && !(low = (PIXEL8 *)malloc(2 * pixel_count)))
+		return false;
+	PIXEL8 *high = low + pixel_count;
+	int variation = aVariation < 0 ? 0 : (aVariation > 255 ? 255 : aVariation);
+	for (i = 0; i < pixel_count; ++i)
+	{
+		if (!aNeedle.care[i]) // Transparent pixel, which matches any value.
+		{
+			low[i] = 0;
+			high[i] = 255;
+			continue;
+		}
+		// value[] is already ANDed with the color mask, as the haystack was before it was reduced.
+		int n = PixelChannel(aNeedle.value[i], aHaystack.channel);
+		low[i] = (PIXEL8)(n < variation ? 0 : n - variation);
+		high[i] = (PIXEL8)(n > 255 - variation ? 255 : n + variation);
+	}
+	aContext.width = aNeedle.width;
+	aContext.height = aNeedle.height;
+	aContext.stride = aHaystack.stride;
+	aContext.low = low;
+	aContext.high = high;
+	aContext.sample_count = aNeedle.sample_count;
+	for (i = 0; i < aNeedle.sample_count; ++i)
+	{
+		int j = aNeedle.sample[i];
+		aContext.sample_offset[i] = (j / aNeedle.width) * aContext.stride + j % aNeedle.width;
+		aContext.sample_low[i] = low[j];
+		aContext.sample_high[i] = high[j];
+	}
+#ifdef SEARCH_X86
+	int features = CpuFeatures();
+	aContext.row_func = (features & CPU_SSE2) ? RowPlaneSSE2 : RowPlane;
+#ifdef SEARCH_AVX2
+	if (features & CPU_AVX2)
+		aContext.row_func = RowPlaneAVX2;
+#endif
+#else
+	aContext.row_func = RowPlane;
+#endif
+	return true;
+}
+
+
+
+static void PlaneSearchEnd(PlaneContext &aContext)
+{
+	if (aContext.low != aContext.bounds_buf)
+		free((void *)aContext.low);
+}
+
+
+
+static int SearchPlaneIn(const SearchPlane &aHaystack, const SearchRegion *aRegion, int aLeft, int aTop
+	, const SearchNeedle &aNeedle, int aVariation, int aFlags, SearchMatch *aMatch, int aMaxMatches)
+// Does the work of all four of the functions below, the same way SearchAllIn() does for whole pixels.
+{
+	int last_x = aHaystack.width - aNeedle.width;
+	int last_y = aHaystack.height - aNeedle.height;
+	if (last_x < 0 || last_y < 0 || aMaxMatches < 1)
+		return 0;
+
+	PlaneContext context;
+	if (!PlaneSearchBegin(context, aHaystack, aNeedle, aVariation))
+		return -1;
+	int match_count = 0;
+	SearchSpan whole = {aLeft, aLeft + last_x + 1};
+	const PIXEL8 *row = aHaystack.pixels;
+	for (int y = 0; y <= last_y; ++y, row += aHaystack.stride)
+	{
+		const SearchSpan *span = &whole;
+		int span_count = aRegion ? RegionRow(*aRegion, aTop + y, span) : 1;
+		for (int s = 0; s < span_count; ++s)
+		{
+			int x_begin, x_end;
+			if (!ClipSpan(span[s], aLeft, last_x, x_begin, x_end))
+				continue;
+			for (int x = x_begin; (x = context.row_func(context, row, x, x_end)) >= 0; )
+			{
+				if ((aFlags & SEARCH_NO_OVERLAP) && OverlapsEarlierMatch(aMatch, match_count, x, y, aNeedle))
+				{
+					++x;
+					continue;
+				}
+				aMatch[match_count].x = x;
+				aMatch[match_count].y = y;
+				if (++match_count == aMaxMatches)
+					goto end;
+				x += (aFlags & SEARCH_NO_OVERLAP) ? aNeedle.width : 1;
+			}
+		}
+	}
+end:
+	PlaneSearchEnd(context);
+	return match_count;
+}
+
+
+
+bool SearchFirstPlane(const SearchPlane &aHaystack, const SearchNeedle &aNeedle, int aVariation, int &aX, int &aY)
+// Same as SearchFirst(), but each needle pixel is reduced to the haystack's channel and compared with
+// the screen's value for that channel alone, exactly or within aVariation.  Always serial.
+{
+	SearchMatch match;
+	if (SearchPlaneIn(aHaystack, NULL, 0, 0, aNeedle, aVariation, 0, &match, 1) < 1)
+		return false;
+	aX = match.x;
+	aY = match.y;
+	return true;
+}
+
+
+
+int SearchAllPlane(const SearchPlane &aHaystack, const SearchNeedle &aNeedle, int aVariation, int aFlags
+	, SearchMatch *aMatch, int aMaxMatches)
+// Same as SearchAll(), compared the way SearchFirstPlane() does.
+{
+	return SearchPlaneIn(aHaystack, NULL, 0, 0, aNeedle, aVariation, aFlags, aMatch, aMaxMatches);
+}
+
+
+
+bool SearchFirstPlaneRegion(const SearchPlane &aHaystack, const SearchRegion &aRegion, int aLeft, int aTop
+	, const SearchNeedle &aNeedle, int aVariation, int &aX, int &aY)
+{
+	SearchMatch match;
+	if (SearchPlaneIn(aHaystack, &aRegion, aLeft, aTop, aNeedle, aVariation, 0, &match, 1) < 1)
+		return false;
+	aX = match.x;
+	aY = match.y;
+	return true;
+}
+
+
+
+int SearchAllPlaneRegion(const SearchPlane &aHaystack, const SearchRegion &aRegion, int aLeft, int aTop
+	, const SearchNeedle &aNeedle, int aVariation, int aFlags, SearchMatch *aMatch, int aMaxMatches)
+{
+	return SearchPlaneIn(aHaystack, &aRegion, aLeft, aTop, aNeedle, aVariation, aFlags, aMatch, aMaxMatches);
+}
@@ -0,0 +1,370 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// Coarse-to-fine search.  Level L of a pyramid (L >= 1) has one pixel for each aligned 2^L x 2^L block of
+// the haystack, holding the minimum and maximum of each color component over that block.  A position at
+// level L stands for all 2^L x 2^L full-resolution positions whose needle would cover that block and the
+// blocks after it in the same way, so rejecting it at level L rejects all of them with a single test.
+//
+// Since those positions are at different offsets (phases) relative to the block grid, each block is
+// compared against the union of the needle pixels that could lie over it in any phase, which is a
+// (2f-1) x (2f-1) region for f = 2^L.  If every screen pixel in the block is within the needle's
+// bounds for the pixel over it, the block's min and max must be within the union's lowest and highest
+// bounds.  This is therefore only a necessary condition: it never rejects a true match, so the positions
+// that survive down to full resolution are confirmed by the same row kernels SearchFirst() uses, and
+// the result is always identical to SearchFirst()'s.  The filter works best on needles with areas of
+// flat or similar colors (typical of UI elements); on noisy needles it rejects little at the coarsest level.
+
+#include "search_kernels.h"
+#include "platform.h"
+#include <stdlib.h>
+
+#define PYRAMID_LEVELS 2 // Levels above full resolution (2x and 4x).
+
+struct PyramidLevel
+{
+	int width, height;   // Number of whole blocks that fit in the haystack.
+	int stride;          // Of min and max: AlignedStride(width).
+	PIXEL32 *min, *max;  // Per-component minimum and maximum over each block.
+};
+
+struct SearchPyramid
+{
+	SearchImage base;
+	PIXEL32 color_mask; // The mask applied to the haystack's pixels before taking min and max.
+	int level_count;
+	PyramidLevel level[PYRAMID_LEVELS + 1]; // level[0] is unused: it is the base image itself.
+};
+
+
+
+static void PyramidMin(const PIXEL32 *aRow0, const PIXEL32 *aRow1, int aCount, PIXEL32 aMask, PIXEL32 *aOut)
+{
+	for (int i = 0; i < aCount; ++i)
+		aOut[i] = PixelMin(PixelMin(aRow0[2*i] & aMask, aRow0[2*i + 1] & aMask), PixelMin(aRow1[2*i] & aMask, aRow1[2*i + 1] & aMask));
+}
+
+
+
+static void PyramidMax(const PIXEL32 *aRow0, const PIXEL32 *aRow1, int aCount, PIXEL32 aMask, PIXEL32 *aOut)
+{
+	for (int i = 0; i < aCount; ++i)
+		aOut[i] = PixelMax(PixelMax(aRow0[2*i] & aMask, aRow0[2*i + 1] & aMask), PixelMax(aRow1[2*i] & aMask, aRow1[2*i + 1] & aMask));
+}
+
+
+
+SearchPyramid *PyramidCreate(const SearchImage &aHaystack, PIXEL32 aColorMask)
+// Builds the coarse levels of aHaystack, whose pixels must stay unchanged for as long as the pyramid is used.
+// aColorMask must be the color_mask of the needles that will be searched for.  Returns NULL on failure.
+{
+	SearchPyramid *pyramid = (SearchPyramid *)malloc(sizeof(SearchPyramid));
+	if (!pyramid)
+		return NULL;
+	pyramid->base = aHaystack;
+	pyramid->color_mask = aColorMask;
+	pyramid->level_count = 0;
+	PyramidReduceFunc reduce_min = PyramidMin, reduce_max = PyramidMax;
+#ifdef SEARCH_X86
+	if (CpuFeatures() & CPU_SSE2)
+	{
+		reduce_min = PyramidMinSSE2;
+		reduce_max = PyramidMaxSSE2;
+	}
+#endif
+	for (int l = 1; l <= PYRAMID_LEVELS; ++l)
+	{
+		PyramidLevel &level = pyramid->level[l];
+		level.width = aHaystack.width >> l;
+		level.height = aHaystack.height >> l;
+		if (level.width < 1 || level.height < 1)
+			break;
+		level.stride = AlignedStride(level.width, sizeof(PIXEL32));
+		if (   !(level.min = (PIXEL32 *)AlignedAlloc(2 * (size_t)level.stride * level.height * sizeof(PIXEL32), SEARCH_ALIGN))   )
+			break;
+		level.max = level.min + level.stride * level.height;
+		for (int y = 0; y < level.height; ++y)
+		{
+			PIXEL32 *min = level.min + y * level.stride, *max = level.max + y * level.stride;
+			if (l == 1) // Built from the haystack's pixels.
+			{
+				const PIXEL32 *row = aHaystack.pixels + 2 * y * (ptrdiff_t)aHaystack.stride;
+				reduce_min(row, row + aHaystack.stride, level.width, aColorMask, min);
+				reduce_max(row, row + aHaystack.stride, level.width, aColorMask, max);
+			}
+			else // Built from the level below, whose blocks are half the size.
+			{
+				const PyramidLevel &below = pyramid->level[l - 1];
+				const PIXEL32 *below_min = below.min + 2 * y * below.stride, *below_max = below.max + 2 * y * below.stride;
+				reduce_min(below_min, below_min + below.stride, level.width, 0xFFFFFFFF, min);
+				reduce_max(below_max, below_max + below.stride, level.width, 0xFFFFFFFF, max);
+			}
+		}
+		pyramid->level_count = l;
+	}
+	return pyramid;
+}
+
+
+
+void PyramidFree(SearchPyramid *aPyramid)
+{
+	if (!aPyramid)
+		return;
+	for (int l = 1; l <= aPyramid->level_count; ++l)
+		AlignedFree(aPyramid->level[l].min); // max shares this block.
+	free(aPyramid);
+}
+
+
+
+struct PyramidCell
+// One block-sized cell of the needle at some level, and the bounds the haystack's block under it must be within.
+{
+	int x, y;
+	PIXEL32 low, high;
+};
+
+struct PyramidSearch
+{
+	const SearchPyramid *pyramid;
+	SearchContext *context; // For confirming matches at full resolution.
+	int min_x, min_y, max_x, max_y; // The range of full-resolution positions to search.
+	PyramidCell *cell[PYRAMID_LEVELS + 1];
+	int cell_count[PYRAMID_LEVELS + 1];
+	int *candidate[PYRAMID_LEVELS + 1]; // Positions to test in the row being searched at each level.
+	int *passed[PYRAMID_LEVELS + 1];    // Those that passed.
+	int found_x, found_y;
+};
+
+
+
+static int BuildCells(const SearchNeedle &aNeedle, int aVariation, int aLevel, PyramidCell *aCell)
+// Stores into aCell the cells of the needle at aLevel whose union region (see top of file) has no
+// transparent pixels, and returns how many there are.
+{
+	int f = 1 << aLevel, span = 2 * f - 1;
+	int cell_count = 0;
+	for (int cy = 0; cy * f + span <= aNeedle.height; ++cy)
+		for (int cx = 0; cx * f + span <= aNeedle.width; ++cx)
+		{
+			PIXEL32 low = 0x00FFFFFF, high = 0;
+			bool usable = true;
+			for (int y = cy * f; y < cy * f + span && usable; ++y)
+				for (int x = cx * f; x < cx * f + span; ++x)
+				{
+					int j = y * aNeedle.width + x;
+					if (!aNeedle.care[j])
+					{
+						usable = false;
+						break;
+					}
+					// The same bounds as BuildBounds() in search.cpp, except that the screen's pixels have already
+					// been masked, so there is no need to widen them in 16-bit mode.
+					PIXEL32 pixel_low = 0, pixel_high = 0;
+					for (int shift = 0; shift < 24; shift += 8)
+					{
+						int n = (aNeedle.value[j] >> shift) & 0xFF;
+						pixel_low |= (PIXEL32)((aVariation > n) ? 0 : n - aVariation) << shift;
+						pixel_high |= (PIXEL32)((aVariation > 0xFF - n) ? 0xFF : n + aVariation) << shift;
+					}
+					low = PixelMin(low, pixel_low);
+					high = PixelMax(high, pixel_high);
+				}
+			if (!usable)
+				continue;
+			aCell[cell_count].x = cx;
+			aCell[cell_count].y = cy;
+			aCell[cell_count].low = low;
+			aCell[cell_count].high = high;
+			++cell_count;
+		}
+	return cell_count;
+}
+
+
+
+static bool PyramidRow(PyramidSearch &aSearch, int aLevel, int aY, int aCount)
+// Tests positions aSearch.candidate[aLevel][0..aCount-1] (in ascending order) of row aY of level aLevel,
+// then searches the rows of the next finer level that the surviving positions stand for.  Returns true
+// once the first match (in the usual order) is found.
+{
+	int *candidate = aSearch.candidate[aLevel];
+	int i;
+	if (!aLevel)
+	{
+		const SearchContext &context = *aSearch.context;
+		if (aY < aSearch.min_y || aY > aSearch.max_y)
+			return false;
+		const PIXEL32 *row = aSearch.pyramid->base.pixels + aY * context.stride;
+		for (i = 0; i < aCount && candidate[i] < aSearch.min_x; ++i);
+		// Runs of consecutive candidates are common, so each run is given to the row kernel in one call:
+		while (i < aCount && candidate[i] <= aSearch.max_x)
+		{
+			int x_begin = candidate[i];
+			for (++i; i < aCount && candidate[i] == candidate[i - 1] + 1 && candidate[i] <= aSearch.max_x; ++i);
+			int x = context.row_func(context, row, x_begin, candidate[i - 1] + 1);
+			if (x >= 0)
+			{
+				aSearch.found_x = x;
+				aSearch.found_y = aY;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Position X at this level stands for full-resolution positions f*X-f+1 through f*X:
+	int f = 1 << aLevel;
+	if (f * aY < aSearch.min_y || f * aY - f + 1 > aSearch.max_y)
+		return false;
+	const PyramidLevel &level = aSearch.pyramid->level[aLevel];
+	PyramidCell *cell = aSearch.cell[aLevel];
+	int cell_count = aSearch.cell_count[aLevel];
+	int *passed = aSearch.passed[aLevel];
+	int pass_count = 0;
+	for (i = 0; i < aCount; ++i)
+	{
+		int x = candidate[i], c;
+		if (f * x < aSearch.min_x)
+			continue;
+		if (f * x - f + 1 > aSearch.max_x)
+			break;
+		for (c = 0; c < cell_count; ++c)
+		{
+			int bx = x + cell[c].x, by = aY + cell[c].y;
+			if (bx >= level.width || by >= level.height) // Can only happen for positions beyond max_x/max_y.
+				continue;
+			int b = by * level.stride + bx;
+			if (!PixelInBounds(level.min[b], cell[c].low, cell[c].high) || !PixelInBounds(level.max[b], cell[c].low, cell[c].high))
+			{
+				// Cells that reject one position tend to reject its neighbors too, so try this one first next time:
+				if (c)
+				{
+					PyramidCell temp = cell[0];
+					cell[0] = cell[c];
+					cell[c] = temp;
+				}
+				break;
+			}
+		}
+		if (c == cell_count)
+			passed[pass_count++] = x;
+	}
+	if (!pass_count)
+		return false;
+
+	// Which is the same as positions 2X-1 and 2X at the next finer level, in both directions:
+	int *finer = aSearch.candidate[aLevel - 1];
+	for (int y = 2 * aY - 1; y <= 2 * aY; ++y)
+	{
+		if (y < 0)
+			continue;
+		int finer_count = 0;
+		for (i = 0; i < pass_count; ++i)
+		{
+			if (passed[i])
+				finer[finer_count++] = 2 * passed[i] - 1;
+			finer[finer_count++] = 2 * passed[i];
+		}
+		if (PyramidRow(aSearch, aLevel - 1, y, finer_count))
+			return true;
+	}
+	return false;
+}
+
+
+
+bool SearchFirstPyramid(const SearchPyramid &aPyramid, int aLeft, int aTop, int aWidth, int aHeight
+	, const SearchNeedle &aNeedle, int aVariation, int &aX, int &aY)
+// Same as SearchFirst() on the aWidth x aHeight part of the pyramid's base image whose upper-left corner is
+// at aLeft, aTop (aX and aY are relative to that corner), and always with the same result, but usually
+// much faster for needles of at least 7x7, especially with a variation.  This way one pyramid can serve
+// searches of any part of the image.  The needle's color_mask should be the pyramid's.
+{
+	const SearchImage &base = aPyramid.base;
+	if (aLeft < 0 || aTop < 0 || aLeft + aWidth > base.width || aTop + aHeight > base.height)
+		return false;
+	if (aWidth < aNeedle.width || aHeight < aNeedle.height)
+		return false;
+
+	// Use the coarsest level at which the needle has any cells:
+	int top = aPyramid.level_count;
+	for (; top > 0; --top)
+		if (aNeedle.width >= (2 << top) - 1 && aNeedle.height >= (2 << top) - 1)
+			break;
+	if (!top || aNeedle.color_mask != aPyramid.color_mask)
+	{
+		SearchImage haystack = {base.pixels + aTop * (ptrdiff_t)base.stride + aLeft, aWidth, aHeight, base.stride};
+		return SearchFirst(haystack, aNeedle, aVariation, aX, aY);
+	}
+
+	PyramidSearch search;
+	SearchContext context;
+	bool found = false;
+	int l, x, y;
+	for (l = 0; l <= PYRAMID_LEVELS; ++l)
+		search.cell[l] = NULL, search.candidate[l] = NULL;
+	if (!SearchBegin(context, aNeedle, base.stride, aVariation))
+		return false;
+	search.pyramid = &aPyramid;
+	search.context = &context;
+	search.min_x = aLeft;
+	search.min_y = aTop;
+	search.max_x = aLeft + aWidth - aNeedle.width;
+	search.max_y = aTop + aHeight - aNeedle.height;
+	search.cell_count[0] = 0;
+	for (l = 0; l <= top; ++l)
+	{
+		// The number of positions in a row at level l is at most the range divided by 2^l, plus those of
+		// the top level's positions that extend past each end:
+		int row_max = ((search.max_x - search.min_x) >> l) + (2 << top) + 2;
+		if (   !(search.candidate[l] = (int *)malloc(2 * row_max * sizeof(int)))   )
+			goto end;
+		search.passed[l] = search.candidate[l] + row_max;
+		if (!l)
+			continue;
+		int f = 1 << l;
+		if (   !(search.cell[l] = (PyramidCell *)malloc((aNeedle.width / f) * (aNeedle.height / f) * sizeof(PyramidCell)))   )
+			goto end;
+		search.cell_count[l] = BuildCells(aNeedle, context.variation, l, search.cell[l]);
+	}
+
+	// Every position at the top level that stands for at least one position in range:
+	int f, x_begin, x_end;
+	f = 1 << top;
+	x_begin = (search.min_x + f - 1) / f;
+	x_end = (search.max_x + f - 1) / f + 1;
+	for (y = (search.min_y + f - 1) / f; y <= (search.max_y + f - 1) / f && !found; ++y)
+	{
+		for (x = x_begin; x < x_end; ++x)
+			search.candidate[top][x - x_begin] = x;
+		found = PyramidRow(search, top, y, x_end - x_begin);
+	}
+	if (found)
+	{
+		aX = search.found_x - aLeft;
+		aY = search.found_y - aTop;
+	}
+end:
+	for (l = 0; l <= PYRAMID_LEVELS; ++l)
+	{
+		free(search.cell[l]);
+		free(search.candidate[l]);
+	}
+	SearchEnd(context);
+	return found;
+}
@@ -0,0 +1,175 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// Regions of interest: the set of positions at which a search may report a match, such as the playable
+// area of a game board.  A position is in the region if the needle's upper-left corner would lie inside
+// it.  Each region is turned into sorted spans of positions once, when it is created, so that searching
+// within it costs nothing for positions outside and the spans can be reused by every search after.
+
+#include "search_kernels.h"
+#include "platform.h"
+#include <stdlib.h>
+#include <math.h>
+
+
+
+static int CompareDouble(const void *a, const void *b)
+{
+	double da = *(const double *)a, db = *(const double *)b;
+	return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+
+
+static SearchRegion *RegionAlloc(int aTop, int aHeight, int aSpanCount)
+// Returns a region whose spans are still to be filled in, or NULL on failure (out of memory).
+{
+	SearchRegion *region = (SearchRegion *)malloc(sizeof(SearchRegion));
+	if (!region)
+		return NULL;
+	region->row_first = (int *)malloc((aHeight + 1) * sizeof(int));
+	region->span = (SearchSpan *)malloc((aSpanCount > 0 ? aSpanCount : 1) * sizeof(SearchSpan));
+	if (!region->row_first || !region->span)
+	{
+		free(region->row_first);
+		free(region->span);
+		free(region);
+		return NULL;
+	}
+	region->ref_count = 1;
+	region->top = aTop;
+	region->height = aHeight;
+	region->row_first[0] = 0;
+	return region;
+}
+
+
+
+SearchRegion *RegionCreatePolygon(const int *aPoint, int aPointCount)
+// aPoint holds the x and y of each of aPointCount corners, in order; the last corner is joined to the
+// first.  A position is inside if a ray from it crosses the edges an odd number of times, which for the
+// usual convex or simple polygon means the same as being enclosed by it.  Positions exactly on a left or
+// top edge are inside, those on a right or bottom edge are not, so that polygons sharing an edge don't
+// both contain it.  Returns NULL on failure.  Caller must RegionRelease() the result.
+{
+	if (aPointCount < 3)
+		return NULL;
+	int top = aPoint[1], bottom = aPoint[1], i, y;
+	for (i = 1; i < aPointCount; ++i)
+	{
+		if (top > aPoint[2*i + 1])
+			top = aPoint[2*i + 1];
+		if (bottom < aPoint[2*i + 1])
+			bottom = aPoint[2*i + 1];
+	}
+	// Each edge crosses a row at most once, so a row has at most aPointCount/2 spans:
+	double *cross = (double *)malloc(aPointCount * sizeof(double));
+	if (!cross)
+		return NULL;
+	int height = bottom - top;
+	SearchRegion *region = RegionAlloc(top, height, height * (aPointCount / 2));
+	if (!region)
+	{
+		free(cross);
+		return NULL;
+	}
+	int span_count = 0;
+	for (y = top; y < bottom; ++y)
+	{
+		// Where the row crosses each edge that spans it, counting an edge's upper end but not its lower one:
+		int cross_count = 0;
+		for (i = 0; i < aPointCount; ++i)
+		{
+			int j = (i + 1) % aPointCount;
+			double x1 = aPoint[2*i], y1 = aPoint[2*i + 1], x2 = aPoint[2*j], y2 = aPoint[2*j + 1];
+			if ((y1 > y) != (y2 > y))
+				cross[cross_count++] = x1 + (x2 - x1) * (y - y1) / (y2 - y1);
+		}
+		qsort(cross, cross_count, sizeof(double), CompareDouble);
+		// A position x is inside if an odd number of the crossings lie to its right, which puts it between
+		// crossings 2k and 2k+1 (counting from the left): ceil(cross[2k]) <= x < ceil(cross[2k+1]).
+		for (i = 0; i + 1 < cross_count; i += 2)
+		{
+			int x_begin = (int)ceil(cross[i]), x_end = (int)ceil(cross[i + 1]);
+			if (x_begin < x_end)
+			{
+				region->span[span_count].x_begin = x_begin;
+				region->span[span_count++].x_end = x_end;
+			}
+		}
+		region->row_first[y - top + 1] = span_count;
+	}
+	free(cross);
+	return region;
+}
+
+
+
+SearchRegion *RegionCreateMask(const SearchImage &aMask, int aLeft, int aTop)
+// Makes a region of the pixels of aMask that are not black, where aLeft and aTop are the coordinates
+// of aMask's upper-left pixel.  The high byte of each pixel is ignored.
+// Returns NULL on failure.  Caller must RegionRelease() the result.
+{
+	int span_count = 0, x, y;
+	for (y = 0; y < aMask.height; ++y) // First just count the spans.
+	{
+		const PIXEL32 *row = aMask.pixels + y * (ptrdiff_t)aMask.stride;
+		for (x = 0; x < aMask.width; ++x)
+			if ((row[x] & 0xFFFFFF) && (!x || !(row[x - 1] & 0xFFFFFF)))
+				++span_count;
+	}
+	SearchRegion *region = RegionAlloc(aTop, aMask.height, span_count);
+	if (!region)
+		return NULL;
+	span_count = 0;
+	for (y = 0; y < aMask.height; ++y)
+	{
+		const PIXEL32 *row = aMask.pixels + y * (ptrdiff_t)aMask.stride;
+		for (x = 0; x < aMask.width; )
+		{
+			if (!(row[x] & 0xFFFFFF))
+			{
+				++x;
+				continue;
+			}
+			region->span[span_count].x_begin = aLeft + x;
+			for (++x; x < aMask.width && (row[x] & 0xFFFFFF); ++x);
+			region->span[span_count++].x_end = aLeft + x;
+		}
+		region->row_first[y + 1] = span_count;
+	}
+	return region;
+}
+
+
+
+void RegionAddRef(SearchRegion *aRegion)
+// The count is atomic so that searches running on different threads can share a region.
+{
+	AtomicIncrement(&aRegion->ref_count);
+}
+
+
+
+void RegionRelease(SearchRegion *aRegion)
+// Frees the region when its last reference is released.  NULL is allowed.
+{
+	if (!aRegion || AtomicDecrement(&aRegion->ref_count))
+		return;
+	free(aRegion->row_first);
+	free(aRegion->span);
+	free(aRegion);
+}
@@ -0,0 +1,625 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// Similarity-scored searching, for images that differ from the screen by more than a per-component
+// variation can describe (lighting, gamma, blending).  Both images are reduced to luminance (or to one color
+// channel) and every position gets a score from 0 to 1 (see SEARCH_SCORE_NCC and SEARCH_SCORE_SSD).
+//
+// Each score needs the sums of the screen's pixels and of their squares under the needle, and the sum
+// of their products with the needle's pixels.  The first two come from integral images (running sums
+// over the rectangle above and to the left of each pixel), so they cost the same for any needle size.
+// The products need a pass over the needle at each position, done by the DotRow kernels, unless the
+// needle is big enough that correlating it in the frequency domain is cheaper.  In that case the
+// haystack is cut into overlapping tiles, two of which are transformed together (one as the real part,
+// one as the imaginary part), multiplied by the conjugate of the needle's spectrum and transformed back.
+// Because the correlations are rounded back to whole numbers, both ways give exactly the same scores.
+
+#include "search_kernels.h"
+#include "threadpool.h"
+#include "platform.h"
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+
+#define SCORE_SUPPRESS_RADIUS 2 // A match is only reported if no position this close scores higher.
+#define SCORE_FFT_MIN_TILE 32    // Smallest tile side worth transforming.
+// Costs for choosing between spatial and FFT correlation, in units of one multiply-add by DotRowAVX2
+// (measured on 1920x1080; slower kernels only make the FFT more worthwhile):
+#define SCORE_COST_ROW 20          // Each DotRow call, on top of its multiply-adds.
+#define SCORE_COST_BUTTERFLY 35    // Each FFT butterfly, while a tile's arrays fit in a typical L2 cache...
+#define SCORE_COST_BUTTERFLY_BIG 70 // ...and once they don't.
+#define SCORE_FFT_BIG_TILE 16384   // Number of elements beyond which a tile is big.
+
+struct ScoreRun
+// A horizontal run of opaque needle pixels.  Only used for needles with transparent pixels.
+{
+	int y, x_begin, x_end;
+};
+
+struct ScoreSearch
+// Shared by the threads of a SearchScored().
+{
+	int method;
+	int width, height;      // Of the haystack.
+	int needle_width, needle_height;
+	int map_width;          // Number of positions in each row (and of scores in each row of score[]).
+	const short *gray;      // The haystack's luminance, width pixels per row.
+	const double *sum, *sum_sq; // Integral images of gray and of its squares, width+1 entries per row.
+	const short *templ;     // The needle's luminance, zero for transparent pixels.
+	const ScoreRun *run;    // NULL if the needle is opaque, in which case its whole rectangle is summed.
+	int run_count;
+	double n;               // Number of opaque needle pixels.
+	double t_sum, t_sum_sq, t_var; // Sums over the needle, and n times the sum of its squared deviations.
+	DotRowFunc dot;
+	int band_rows;
+	float *score;           // map_width scores for each row of positions.
+	const SearchRegion *region; // If not NULL, positions outside it score -FLT_MAX and are never reported.
+	int left, top;          // The haystack's position in the region's coordinates.
+	// Only when correlating by FFT:
+	const FftPlan *plan_x, *plan_y;   // Their sizes are those of each tile.
+	const NeedleSpectrum *spectrum;
+	int tile_cols, tile_count;
+	volatile int failed;              // Set if any tile couldn't get memory.
+};
+
+
+
+int DotRow(const short *aA, const short *aB, int aCount)
+// Portable version of the dot product kernel.  Each operand is 0-255, so a row of up to 33025 pixels
+// fits in an int.
+{
+	int dot = 0;
+	for (int i = 0; i < aCount; ++i)
+		dot += aA[i] * aB[i];
+	return dot;
+}
+
+
+
+static DotRowFunc SelectDotFunc()
+{
+#ifdef SEARCH_X86
+	int features = CpuFeatures();
+#ifdef SEARCH_AVX2
+	if (features & CPU_AVX2)
+		return DotRowAVX2;
+#endif
+	if (features & CPU_SSE2)
+		return DotRowSSE2;
+#endif
+	return DotRow;
+}
+
+
+
+static inline double RectSum(const double *aIntegral, int aStride, int aLeft, int aTop, int aRight, int aBottom)
+// Sum over the pixels from aLeft to aRight - 1 and from aTop to aBottom - 1.
+{
+	return aIntegral[aBottom * aStride + aRight] - aIntegral[aBottom * aStride + aLeft]
+		- aIntegral[aTop * aStride + aRight] + aIntegral[aTop * aStride + aLeft];
+}
+
+
+
+static float ScoreAt(const ScoreSearch &aSearch, int aX, int aY, double aProducts)
+// aProducts is the sum of the products of the needle's pixels and the screen's pixels under them (st).
+{
+	int stride = aSearch.width + 1;
+	double s, s_sq; // Sums of the screen's pixels and their squares under the needle's opaque pixels.
+	if (!aSearch.run)
+	{
+		s = RectSum(aSearch.sum, stride, aX, aY, aX + aSearch.needle_width, aY + aSearch.needle_height);
+		s_sq = RectSum(aSearch.sum_sq, stride, aX, aY, aX + aSearch.needle_width, aY + aSearch.needle_height);
+	}
+	else
+	{
+		s = s_sq = 0;
+		for (int i = 0; i < aSearch.run_count; ++i)
+		{
+			const ScoreRun &run = aSearch.run[i];
+			s += RectSum(aSearch.sum, stride, aX + run.x_begin, aY + run.y, aX + run.x_end, aY + run.y + 1);
+			s_sq += RectSum(aSearch.sum_sq, stride, aX + run.x_begin, aY + run.y, aX + run.x_end, aY + run.y + 1);
+		}
+	}
+	double st = aProducts;
+	if (aSearch.method == SEARCH_SCORE_SSD)
+		return (float)(1.0 - (s_sq - 2 * st + aSearch.t_sum_sq) / (aSearch.n * 255 * 255));
+
+	// Everything is kept as n times the usual (co)variances, which keeps the sums exact integers:
+	double var = aSearch.n * s_sq - s * s;
+	if (var <= 0 || aSearch.t_var <= 0)
+		// A flat area of the screen correlates with nothing but a flat needle (of any brightness).
+		return (var <= 0 && aSearch.t_var <= 0) ? 1.0f : 0.0f;
+	double ncc = (aSearch.n * st - s * aSearch.t_sum) / sqrt(var * aSearch.t_var);
+	return (float)(ncc > 1 ? 1 : (ncc < -1 ? -1 : ncc));
+}
+
+
+
+static void ScoreSpan(const ScoreSearch &aSearch, int aY, int aXBegin, int aXEnd)
+// Scores positions aXBegin through aXEnd - 1 of row aY by spatial correlation.
+{
+	float *score = aSearch.score + aY * aSearch.map_width;
+	for (int x = aXBegin; x < aXEnd; ++x)
+	{
+		// Transparent pixels are zero in templ, so they add nothing to the products:
+		double st = 0;
+		const short *screen = aSearch.gray + aY * aSearch.width + x, *templ = aSearch.templ;
+		for (int row = 0; row < aSearch.needle_height; ++row, screen += aSearch.width, templ += aSearch.needle_width)
+			st += aSearch.dot(screen, templ, aSearch.needle_width);
+		score[x] = ScoreAt(aSearch, x, aY, st);
+	}
+}
+
+
+
+static void ScoreBand(void *aParam, int aBand)
+{
+	ScoreSearch &search = *(ScoreSearch *)aParam;
+	int map_height = search.height - search.needle_height + 1;
+	int y_end = (aBand + 1) * search.band_rows;
+	if (y_end > map_height)
+		y_end = map_height;
+	for (int y = aBand * search.band_rows; y < y_end; ++y)
+	{
+		if (!search.region)
+		{
+			ScoreSpan(search, y, 0, search.map_width);
+			continue;
+		}
+		// Only the positions in the region are worth the products:
+		float *score = search.score + y * search.map_width;
+		for (int x = 0; x < search.map_width; ++x)
+			score[x] = -FLT_MAX;
+		const SearchSpan *span;
+		int span_count = RegionRow(*search.region, search.top + y, span), x_begin, x_end;
+		for (int i = 0; i < span_count; ++i)
+			if (ClipSpan(span[i], search.left, search.map_width - 1, x_begin, x_end))
+				ScoreSpan(search, y, x_begin, x_end);
+	}
+}
+
+
+
+static void MaskScores(ScoreSearch &aSearch, int aMapHeight)
+// Sets the score of every position outside aSearch.region to -FLT_MAX, after correlating by FFT (which
+// scores them all).
+{
+	for (int y = 0; y < aMapHeight; ++y)
+	{
+		float *score = aSearch.score + y * aSearch.map_width;
+		const SearchSpan *span;
+		int span_count = RegionRow(*aSearch.region, aSearch.top + y, span), x_begin, x_end, x = 0;
+		for (int i = 0; i < span_count; ++i)
+		{
+			if (!ClipSpan(span[i], aSearch.left, aSearch.map_width - 1, x_begin, x_end))
+				continue;
+			for (; x < x_begin; ++x)
+				score[x] = -FLT_MAX;
+			x = x_end;
+		}
+		for (; x < aSearch.map_width; ++x)
+			score[x] = -FLT_MAX;
+	}
+}
+
+
+
+void SpectrumFree(NeedleSpectrum *aSpectrum)
+{
+	if (!aSpectrum)
+		return;
+	free(aSpectrum->re); // im shares this block.
+	free(aSpectrum);
+}
+
+
+
+static NeedleSpectrum *SpectrumCreate(const short *aTempl, int aNeedleWidth, int aNeedleHeight, int aChannel
+	, const FftPlan &aPlanX, const FftPlan &aPlanY)
+{
+	NeedleSpectrum *spectrum = (NeedleSpectrum *)malloc(sizeof(NeedleSpectrum));
+	if (!spectrum)
+		return NULL;
+	int size = aPlanX.size * aPlanY.size;
+	double *column = (double *)malloc(2 * aPlanY.size * sizeof(double));
+	if (!column || !(spectrum->re = (double *)calloc(2 * size, sizeof(double))))
+	{
+		free(column);
+		free(spectrum);
+		return NULL;
+	}
+	spectrum->im = spectrum->re + size;
+	spectrum->width = aPlanX.size;
+	spectrum->height = aPlanY.size;
+	spectrum->channel = aChannel;
+	for (int y = 0; y < aNeedleHeight; ++y)
+		for (int x = 0; x < aNeedleWidth; ++x)
+			spectrum->re[y * aPlanX.size + x] = aTempl[y * aNeedleWidth + x];
+	Fft2D(aPlanX, aPlanY, spectrum->re, spectrum->im, column, false);
+	free(column);
+	return spectrum;
+}
+
+
+
+static void ScoreTiles(void *aParam, int aTask)
+// Scores the positions of tiles 2*aTask and 2*aTask + 1.  Each tile is as big as the transform, and its
+// first (tile size - needle size + 1) positions in each direction are the ones it scores, since at those the
+// needle doesn't reach past the tile (so the correlation, which is circular, doesn't wrap around).
+{
+	ScoreSearch &search = *(ScoreSearch *)aParam;
+	int width = search.plan_x->size, height = search.plan_y->size, size = width * height;
+	int step_x = width - search.needle_width + 1, step_y = height - search.needle_height + 1;
+	int map_height = search.height - search.needle_height + 1;
+	double *re = (double *)calloc(2 * size + 2 * height, sizeof(double));
+	if (!re)
+	{
+		search.failed = 1;
+		return;
+	}
+	double *im = re + size, *column = im + size;
+	int tile, x, y;
+	for (tile = 2 * aTask; tile < 2 * aTask + 2 && tile < search.tile_count; ++tile)
+	{
+		double *part = (tile & 1) ? im : re;
+		int left = (tile % search.tile_cols) * step_x, top = (tile / search.tile_cols) * step_y;
+		for (y = 0; y < height && top + y < search.height; ++y)
+			for (x = 0; x < width && left + x < search.width; ++x)
+				part[y * width + x] = search.gray[(top + y) * search.width + left + x];
+	}
+	Fft2D(*search.plan_x, *search.plan_y, re, im, column, false);
+	const double *s_re = search.spectrum->re, *s_im = search.spectrum->im;
+	for (int i = 0; i < size; ++i)
+	{
+		double r = re[i] * s_re[i] + im[i] * s_im[i]; // Times the conjugate of the spectrum.
+		im[i] = im[i] * s_re[i] - re[i] * s_im[i];
+		re[i] = r;
+	}
+	Fft2D(*search.plan_x, *search.plan_y, re, im, column, true);
+	for (tile = 2 * aTask; tile < 2 * aTask + 2 && tile < search.tile_count; ++tile)
+	{
+		const double *part = (tile & 1) ? im : re;
+		int left = (tile % search.tile_cols) * step_x, top = (tile / search.tile_cols) * step_y;
+		for (y = 0; y < step_y && top + y < map_height; ++y)
+		{
+			float *score = search.score + (top + y) * search.map_width + left;
+			for (x = 0; x < step_x && left + x < search.map_width; ++x)
+				score[x] = ScoreAt(search, left + x, top + y, floor(part[y * width + x] / size + 0.5));
+		}
+	}
+	free(re);
+}
+
+
+
+static int NextPowerOf2(int aValue)
+{
+	int n = 1;
+	while (n < aValue)
+		n *= 2;
+	return n;
+}
+
+
+
+static bool ChooseTiles(int aMapWidth, int aMapHeight, int aNeedleWidth, int aNeedleHeight, int &aTileWidth
+	, int &aTileHeight)
+// Picks the tile size for which correlating by FFT would take the least time, and returns true if that
+// is less than the time spatial correlation would take.
+{
+	double best = (double)aMapWidth * aMapHeight * aNeedleHeight * (aNeedleWidth + SCORE_COST_ROW); // Spatial.
+	bool use_fft = false;
+	int max_width = NextPowerOf2(aMapWidth + aNeedleWidth - 1), max_height = NextPowerOf2(aMapHeight + aNeedleHeight - 1);
+	for (int w = NextPowerOf2(aNeedleWidth < SCORE_FFT_MIN_TILE ? SCORE_FFT_MIN_TILE : aNeedleWidth); w <= max_width; w *= 2)
+	{
+		if (w == aNeedleWidth && w < max_width) // No whole tile of positions.
+			continue;
+		for (int h = NextPowerOf2(aNeedleHeight < SCORE_FFT_MIN_TILE ? SCORE_FFT_MIN_TILE : aNeedleHeight); h <= max_height; h *= 2)
+		{
+			if (h == aNeedleHeight && h < max_height)
+				continue;
+			int tiles = ((aMapWidth + w - aNeedleWidth) / (w - aNeedleWidth + 1))
+				* ((aMapHeight + h - aNeedleHeight) / (h - aNeedleHeight + 1));
+			// Two tiles per transform, each forward and back; an n-point transform has n/2*log2(n) butterflies.
+			double cost = (tiles + 1) / 2 * 2 * (double)w * h / 2 * log((double)w * h) / log(2.0)
+				* (w * h > SCORE_FFT_BIG_TILE ? SCORE_COST_BUTTERFLY_BIG : SCORE_COST_BUTTERFLY);
+			if (cost < best)
+			{
+				best = cost;
+				aTileWidth = w;
+				aTileHeight = h;
+				use_fft = true;
+			}
+		}
+	}
+	return use_fft;
+}
+
+
+
+static bool IsLocalMax(const float *aScore, int aMapWidth, int aMapHeight, int aX, int aY)
+// A position that scores the same as one before it (in scan order) within the radius loses to that one,
+// so a plateau yields a single match.
+{
+	float score = aScore[aY * aMapWidth + aX];
+	for (int y = aY - SCORE_SUPPRESS_RADIUS; y <= aY + SCORE_SUPPRESS_RADIUS; ++y)
+	{
+		if (y < 0 || y >= aMapHeight)
+			continue;
+		for (int x = aX - SCORE_SUPPRESS_RADIUS; x <= aX + SCORE_SUPPRESS_RADIUS; ++x)
+		{
+			if (x < 0 || x >= aMapWidth)
+				continue;
+			float other = aScore[y * aMapWidth + x];
+			if (other > score || (other == score && (y < aY || (y == aY && x < aX))))
+				return false;
+		}
+	}
+	return true;
+}
+
+
+
+static int CompareScoredMatch(const void *a, const void *b)
+// Highest score first, then in scan order.
+{
+	const SearchScoredMatch &ma = *(const SearchScoredMatch *)a, &mb = *(const SearchScoredMatch *)b;
+	if (ma.score != mb.score)
+		return ma.score > mb.score ? -1 : 1;
+	if (ma.y != mb.y)
+		return ma.y - mb.y;
+	return ma.x - mb.x;
+}
+
+
+
+static int ScoreAll(const SearchImage &aHaystack, const SearchRegion *aRegion, int aLeft, int aTop
+	, const SearchNeedle &aNeedle, int aMethod, float aMinScore, SearchScoredMatch *aMatch, int aMaxMatches, int aFFT)
+// Does the work of SearchScored() and SearchScoredRegion().  aRegion is NULL to score every position.
+{
+	int map_width = aHaystack.width - aNeedle.width + 1;
+	int map_height = aHaystack.height - aNeedle.height + 1;
+	int channel = aMethod >> 4;
+	aMethod &= 0xF;
+	if ((aMethod != SEARCH_SCORE_NCC && aMethod != SEARCH_SCORE_SSD) || channel > SEARCH_CHANNEL_BLUE)
+		return -1;
+	if (map_width < 1 || map_height < 1 || aMaxMatches < 1)
+		return 0;
+
+	ScoreSearch search;
+	int pixel_count = aHaystack.width * aHaystack.height, needle_count = aNeedle.width * aNeedle.height;
+	int integral_count = (aHaystack.width + 1) * (aHaystack.height + 1);
+	short *gray = (short *)malloc(pixel_count * sizeof(short));
+	short *templ = (short *)malloc(needle_count * sizeof(short));
+	double *sum = (double *)malloc(2 * integral_count * sizeof(double));
+	float *score = (float *)malloc(map_width * map_height * sizeof(float));
+	ScoreRun *run = NULL;
+	FftPlan plan_x = {0, 0, NULL, NULL, NULL}, plan_y = {0, 0, NULL, NULL, NULL};
+	NeedleSpectrum *spectrum = NULL;
+	bool spectrum_is_cached = false;
+	int match_count = -1, run_count = 0, x, y, i;
+	if (!gray || !templ || !sum || !score)
+		goto end;
+
+	// The needle's luminance (or channel), sums and opaque runs:
+	search.n = search.t_sum = search.t_sum_sq = 0;
+	for (y = 0, i = 0; y < aNeedle.height; ++y)
+		for (x = 0; x < aNeedle.width; ++x, ++i)
+		{
+			if (!aNeedle.care[i])
+			{
+				templ[i] = 0;
+				if (x && aNeedle.care[i - 1]) // End of a run.
+					++run_count;
+				continue;
+			}
+			templ[i] = PixelChannel(aNeedle.value[i], channel);
+			search.n += 1;
+			search.t_sum += templ[i];
+			search.t_sum_sq += templ[i] * templ[i];
+			if (x == aNeedle.width - 1) // A run ending at the edge.
+				++run_count;
+		}
+	if (!search.n) // Entirely transparent: it matches everywhere equally, so report the first position.
+	{
+		aMatch[0].x = aMatch[0].y = 0;
+		aMatch[0].score = 1;
+		match_count = 1;
+		goto end;
+	}
+	search.t_var = search.n * search.t_sum_sq - search.t_sum * search.t_sum;
+	if (search.n < needle_count)
+	{
+		if (   !(run = (ScoreRun *)malloc(run_count * sizeof(ScoreRun)))   )
+			goto end;
+		run_count = 0;
+		for (y = 0; y < aNeedle.height; ++y)
+		{
+			const PIXEL32 *care = aNeedle.care + y * aNeedle.width;
+			for (x = 0; x < aNeedle.width; )
+			{
+				if (!care[x])
+				{
+					++x;
+					continue;
+				}
+				run[run_count].y = y;
+				run[run_count].x_begin = x;
+				for (++x; x < aNeedle.width && care[x]; ++x);
+				run[run_count++].x_end = x;
+			}
+		}
+	}
+
+	// The haystack's luminance and its integral images.  Each sum is of whole numbers well below 2^53,
+	// so the doubles hold them exactly and differences of them are exact too.
+	double *sum_sq;
+	sum_sq = sum + integral_count;
+	for (x = 0; x <= aHaystack.width; ++x)
+		sum[x] = sum_sq[x] = 0;
+	for (y = 0; y < aHaystack.height; ++y)
+	{
+		const PIXEL32 *pixel = aHaystack.pixels + y * (ptrdiff_t)aHaystack.stride;
+		short *g = gray + y * aHaystack.width;
+		double *s = sum + (y + 1) * (aHaystack.width + 1), *s_sq = sum_sq + (y + 1) * (aHaystack.width + 1);
+		double row_sum = 0, row_sum_sq = 0;
+		s[0] = s_sq[0] = 0;
+		for (x = 0; x < aHaystack.width; ++x)
+		{
+			g[x] = PixelChannel(pixel[x] & aNeedle.color_mask, channel);
+			row_sum += g[x];
+			row_sum_sq += g[x] * g[x];
+			s[x + 1] = s[x + 1 - (aHaystack.width + 1)] + row_sum;
+			s_sq[x + 1] = s_sq[x + 1 - (aHaystack.width + 1)] + row_sum_sq;
+		}
+	}
+
+	search.method = aMethod;
+	search.width = aHaystack.width;
+	search.height = aHaystack.height;
+	search.needle_width = aNeedle.width;
+	search.needle_height = aNeedle.height;
+	search.map_width = map_width;
+	search.gray = gray;
+	search.sum = sum;
+	search.sum_sq = sum_sq;
+	search.templ = templ;
+	search.run = run;
+	search.run_count = run_count;
+	search.dot = SelectDotFunc();
+	search.score = score;
+	search.region = aRegion;
+	search.left = aLeft;
+	search.top = aTop;
+	int tile_width, tile_height;
+	if (aFFT < 0 ? ChooseTiles(map_width, map_height, aNeedle.width, aNeedle.height, tile_width, tile_height) : aFFT > 0)
+	{
+		if (aFFT > 0 && !ChooseTiles(map_width, map_height, aNeedle.width, aNeedle.height, tile_width, tile_height))
+		{
+			tile_width = NextPowerOf2(map_width + aNeedle.width - 1); // A single tile.
+			tile_height = NextPowerOf2(map_height + aNeedle.height - 1);
+		}
+		if (!FftPlanInit(plan_x, tile_width) || !FftPlanInit(plan_y, tile_height))
+			goto end;
+		// Use the needle's cached spectrum if it has one of this size.  Otherwise make one and cache it, unless
+		// one of another size is already cached (which could be in use by another search).
+		void *volatile *cache;
+		cache = (void *volatile *)&const_cast<SearchNeedle &>(aNeedle).spectrum; // The cache is not part of the needle's value.
+		spectrum = (NeedleSpectrum *)AtomicCompareExchangePointer(cache, NULL, NULL); // Read with a barrier.
+		if (!spectrum || spectrum->width != tile_width || spectrum->height != tile_height || spectrum->channel != channel)
+		{
+			if (   !(spectrum = SpectrumCreate(templ, aNeedle.width, aNeedle.height, channel, plan_x, plan_y))   )
+				goto end;
+			if (!AtomicCompareExchangePointer(cache, spectrum, NULL))
+				spectrum_is_cached = true;
+		}
+		else
+			spectrum_is_cached = true;
+		search.plan_x = &plan_x;
+		search.plan_y = &plan_y;
+		search.spectrum = spectrum;
+		search.tile_cols = (map_width + tile_width - aNeedle.width) / (tile_width - aNeedle.width + 1);
+		search.tile_count = search.tile_cols * ((map_height + tile_height - aNeedle.height) / (tile_height - aNeedle.height + 1));
+		search.failed = 0;
+		PoolRun(ScoreTiles, &search, (search.tile_count + 1) / 2);
+		if (search.failed)
+			goto end;
+		if (aRegion)
+			MaskScores(search, map_height);
+	}
+	else
+	{
+		// Several bands per thread so that the threads stay busy even if some bands are slower.
+		search.band_rows = map_height / (4 * PoolGetThreads());
+		if (search.band_rows < 1)
+			search.band_rows = 1;
+		PoolRun(ScoreBand, &search, (map_height + search.band_rows - 1) / search.band_rows);
+	}
+
+	match_count = 0;
+	SearchSpan whole;
+	whole.x_begin = aLeft;
+	whole.x_end = aLeft + map_width;
+	for (y = 0; y < map_height; ++y)
+	{
+		const SearchSpan *span = &whole;
+		int span_count = aRegion ? RegionRow(*aRegion, aTop + y, span) : 1, x_begin, x_end;
+		for (int s = 0; s < span_count; ++s)
+		{
+			if (!ClipSpan(span[s], aLeft, map_width - 1, x_begin, x_end))
+				continue;
+			for (x = x_begin; x < x_end; ++x)
+			{
+				if (score[y * map_width + x] < aMinScore || !IsLocalMax(score, map_width, map_height, x, y))
+					continue;
+				// Once aMatch is full, a new match replaces the worst one if it is better:
+				SearchScoredMatch match = {x, y, score[y * map_width + x]};
+				if (match_count < aMaxMatches)
+				{
+					aMatch[match_count++] = match;
+					continue;
+				}
+				int worst = 0;
+				for (i = 1; i < match_count; ++i)
+					if (CompareScoredMatch(&aMatch[i], &aMatch[worst]) > 0)
+						worst = i;
+				if (CompareScoredMatch(&match, &aMatch[worst]) < 0)
+					aMatch[worst] = match;
+			}
+		}
+	}
+	qsort(aMatch, match_count, sizeof(SearchScoredMatch), CompareScoredMatch);
+
+end:
+	free(gray);
+	free(templ);
+	free(sum);
+	free(score);
+	free(run);
+	FftPlanFree(plan_x);
+	FftPlanFree(plan_y);
+	if (!spectrum_is_cached)
+		SpectrumFree(spectrum);
+	return match_count;
+}
+
+
+
+int SearchScored(const SearchImage &aHaystack, const SearchNeedle &aNeedle, int aMethod, float aMinScore
+	, SearchScoredMatch *aMatch, int aMaxMatches, int aFFT)
+// Scores every position at which aNeedle lies entirely within aHaystack, and stores into aMatch the
+// positions that score at least aMinScore and higher than any other position within two pixels, up to
+// aMaxMatches of them, best first.  Transparent needle pixels are left out of the score altogether.
+// Uses the thread pool if SearchSetThreads() has enabled it.  aFFT is -1 to correlate by FFT only if
+// that would be faster, which it is for needles of more than about 12x12 on a large haystack, or 0 or 1
+// to force spatial or FFT correlation.  The scores are the same either way.
+// aMethod may have a SEARCH_SCORE_CHANNEL() added to compare one color channel instead of luminance.
+// Returns the number of matches stored, or -1 on failure (out of memory or an unknown aMethod).
+{
+	return ScoreAll(aHaystack, NULL, 0, 0, aNeedle, aMethod, aMinScore, aMatch, aMaxMatches, aFFT);
+}
+
+
+
+int SearchScoredRegion(const SearchImage &aHaystack, const SearchRegion &aRegion, int aLeft, int aTop
+	, const SearchNeedle &aNeedle, int aMethod, float aMinScore, SearchScoredMatch *aMatch, int aMaxMatches
+	, int aFFT)
+// Same as SearchScored(), but positions outside aRegion are neither scored (unless correlating by FFT,
+// which scores every position at once) nor reported, and they can't suppress a match inside it.
+{
+	return ScoreAll(aHaystack, &aRegion, aLeft, aTop, aNeedle, aMethod, aMinScore, aMatch, aMaxMatches, aFFT);
+}
@@ -0,0 +1,532 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// SSE2 and AVX2 versions of the row kernels in search.cpp and search_plane.cpp.  Both are compiled (with
+// per-function target attributes under g++/clang, so no special compiler switches are needed) and
+// SearchFirst() picks one at runtime according to CpuFeatures().  The AVX2 ones are left out when the
+// compiler is too old for them (SEARCH_AVX2 isn't defined), in which case the SSE2 ones are used instead.
+// They must produce exactly the same results as RowExact() (or RowPlane()).
+
+#include "search_kernels.h"
+
+#ifdef SEARCH_X86
+
+#include <emmintrin.h>
+#ifdef SEARCH_AVX2
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE2
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+
+static inline int LowestBit(unsigned int aBits)
+// Caller must ensure aBits is non-zero.
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, aBits);
+	return (int)index;
+#else
+	return __builtin_ctz(aBits);
+#endif
+}
+
+
+
+int CpuFeatures()
+{
+	static int sFeatures = -1; // Benign race: every thread computes the same value.
+	if (sFeatures != -1)
+		return sFeatures;
+
+	int features = 0;
+	unsigned int ecx, edx;
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	ecx = info[2], edx = info[3];
+#else
+	unsigned int eax, ebx;
+	__cpuid(1, eax, ebx, ecx, edx);
+#endif
+	if (edx & (1 << 26))
+		features |= CPU_SSE2;
+#ifdef SEARCH_AVX2
+#ifdef _MSC_VER
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+#else
+	unsigned int max_leaf = __get_cpuid_max(0, NULL);
+#endif
+	// AVX2 also requires that the OS saves the YMM registers on context switches (OSXSAVE + XCR0).
+	if (max_leaf >= 7 && (ecx & (1 << 27)))
+	{
+#ifdef _MSC_VER
+		unsigned __int64 xcr0 = _xgetbv(0);
+		__cpuidex(info, 7, 0);
+		unsigned int ebx = info[1];
+#else
+		unsigned int xcr0_low, xcr0_high;
+		__asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+		unsigned long long xcr0 = xcr0_low;
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+#endif
+		if ((xcr0 & 6) == 6 && (ebx & (1 << 5)))
+			features |= CPU_AVX2;
+	}
+#endif
+	return sFeatures = features;
+}
+
+
+
+///////////////
+// SSE2 (4 pixels per compare)
+///////////////
+
+TARGET_SSE2 static bool MatchExactSSE2(const PIXEL32 *aScreen, ptrdiff_t aStride, const SearchNeedle &aNeedle)
+{
+	const PIXEL32 *value = aNeedle.value, *care = aNeedle.care;
+	int wide_width = aNeedle.width & ~3;
+	for (int y = 0; y < aNeedle.height; ++y, aScreen += aStride, value += aNeedle.width, care += aNeedle.width)
+	{
+		int x;
+		for (x = 0; x < wide_width; x += 4)
+		{
+			__m128i screen = _mm_loadu_si128((const __m128i *)(aScreen + x));
+			screen = _mm_and_si128(screen, _mm_loadu_si128((const __m128i *)(care + x)));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(screen, _mm_loadu_si128((const __m128i *)(value + x)))) != 0xFFFF)
+				return false;
+		}
+		for (; x < aNeedle.width; ++x)
+			if ((aScreen[x] & care[x]) != value[x])
+				return false;
+	}
+	return true;
+}
+
+
+
+TARGET_SSE2 int RowExactSSE2(const SearchContext &aContext, const PIXEL32 *aRow, int aXBegin, int aXEnd)
+{
+	const SearchNeedle &needle = *aContext.needle;
+	__m128i care0 = _mm_set1_epi32((int)needle.care[needle.sample[0]]);
+	__m128i value0 = _mm_set1_epi32((int)needle.value[needle.sample[0]]);
+	const PIXEL32 *probe = aRow + aContext.sample_offset[0];
+	int x = aXBegin;
+	for (; x + 4 <= aXEnd; x += 4)
+	{
+		// Find which of the next 4 positions match the needle's first pixel, then check only those.
+		__m128i screen = _mm_and_si128(_mm_loadu_si128((const __m128i *)(probe + x)), care0);
+		unsigned int candidates = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(screen, value0)));
+		for (; candidates; candidates &= candidates - 1)
+		{
+			int candidate = x + LowestBit(candidates);
+			if (SamplesMatchExact(aContext, aRow + candidate) && MatchExactSSE2(aRow + candidate, aContext.stride, needle))
+				return candidate;
+		}
+	}
+	for (; x < aXEnd; ++x)
+		if ((probe[x] & needle.care[needle.sample[0]]) == needle.value[needle.sample[0]]
+			&& SamplesMatchExact(aContext, aRow + x) && MatchExactSSE2(aRow + x, aContext.stride, needle))
+			return x;
+	return -1;
+}
+
+
+
+TARGET_SSE2 static inline __m128i OutOfBoundsSSE2(__m128i aScreen, __m128i aLow, __m128i aHigh)
+// Returns non-zero bytes wherever a byte of aScreen is below aLow or above aHigh.
+{
+	return _mm_or_si128(_mm_subs_epu8(aLow, aScreen), _mm_subs_epu8(aScreen, aHigh));
+}
+
+
+
+TARGET_SSE2 static bool MatchVariationSSE2(const PIXEL32 *aScreen, const SearchContext &aContext)
+{
+	const SearchNeedle &needle = *aContext.needle;
+	const PIXEL32 *low = aContext.low, *high = aContext.high;
+	int wide_width = needle.width & ~3;
+	__m128i zero = _mm_setzero_si128();
+	for (int y = 0; y < needle.height; ++y, aScreen += aContext.stride, low += needle.width, high += needle.width)
+	{
+		int x;
+		for (x = 0; x < wide_width; x += 4)
+		{
+			__m128i out = OutOfBoundsSSE2(_mm_loadu_si128((const __m128i *)(aScreen + x))
+				, _mm_loadu_si128((const __m128i *)(low + x)), _mm_loadu_si128((const __m128i *)(high + x)));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(out, zero)) != 0xFFFF)
+				return false;
+		}
+		for (; x < needle.width; ++x)
+			if (!PixelInBounds(aScreen[x], low[x], high[x]))
+				return false;
+	}
+	return true;
+}
+
+
+
+TARGET_SSE2 int RowVariationSSE2(const SearchContext &aContext, const PIXEL32 *aRow, int aXBegin, int aXEnd)
+{
+	int sample0 = aContext.needle->sample[0];
+	__m128i low0 = _mm_set1_epi32((int)aContext.low[sample0]);
+	__m128i high0 = _mm_set1_epi32((int)aContext.high[sample0]);
+	const PIXEL32 *probe = aRow + aContext.sample_offset[0];
+	__m128i zero = _mm_setzero_si128();
+	int x = aXBegin;
+	for (; x + 4 <= aXEnd; x += 4)
+	{
+		__m128i out = OutOfBoundsSSE2(_mm_loadu_si128((const __m128i *)(probe + x)), low0, high0);
+		unsigned int candidates = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(out, zero)));
+		for (; candidates; candidates &= candidates - 1)
+		{
+			int candidate = x + LowestBit(candidates);
+			if (SamplesMatchVariation(aContext, aRow + candidate) && MatchVariationSSE2(aRow + candidate, aContext))
+				return candidate;
+		}
+	}
+	for (; x < aXEnd; ++x)
+		if (PixelInBounds(probe[x], aContext.low[sample0], aContext.high[sample0])
+			&& SamplesMatchVariation(aContext, aRow + x) && MatchVariationSSE2(aRow + x, aContext))
+			return x;
+	return -1;
+}
+
+
+
+
+TARGET_SSE2 static bool MatchPlaneSSE2(const PIXEL8 *aScreen, const PlaneContext &aContext)
+{
+	const PIXEL8 *low = aContext.low, *high = aContext.high;
+	int wide_width = aContext.width & ~15;
+	__m128i zero = _mm_setzero_si128();
+	for (int y = 0; y < aContext.height; ++y, aScreen += aContext.stride, low += aContext.width, high += aContext.width)
+	{
+		int x;
+		for (x = 0; x < wide_width; x += 16)
+		{
+			__m128i out = OutOfBoundsSSE2(_mm_loadu_si128((const __m128i *)(aScreen + x))
+				, _mm_loadu_si128((const __m128i *)(low + x)), _mm_loadu_si128((const __m128i *)(high + x)));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(out, zero)) != 0xFFFF)
+				return false;
+		}
+		for (; x < aContext.width; ++x)
+			if (aScreen[x] < low[x] || aScreen[x] > high[x])
+				return false;
+	}
+	return true;
+}
+
+
+
+TARGET_SSE2 int RowPlaneSSE2(const PlaneContext &aContext, const PIXEL8 *aRow, int aXBegin, int aXEnd)
+// 16 positions per compare, four times as many as for whole pixels.
+{
+	__m128i low0 = _mm_set1_epi8((char)aContext.sample_low[0]);
+	__m128i high0 = _mm_set1_epi8((char)aContext.sample_high[0]);
+	const PIXEL8 *probe = aRow + aContext.sample_offset[0];
+	__m128i zero = _mm_setzero_si128();
+	int x = aXBegin;
+	for (; x + 16 <= aXEnd; x += 16)
+	{
+		__m128i out = OutOfBoundsSSE2(_mm_loadu_si128((const __m128i *)(probe + x)), low0, high0);
+		unsigned int candidates = _mm_movemask_epi8(_mm_cmpeq_epi8(out, zero));
+		for (; candidates; candidates &= candidates - 1)
+		{
+			int candidate = x + LowestBit(candidates);
+			if (PlaneSamplesMatch(aContext, aRow + candidate) && MatchPlaneSSE2(aRow + candidate, aContext))
+				return candidate;
+		}
+	}
+	for (; x < aXEnd; ++x)
+		if (probe[x] >= aContext.sample_low[0] && probe[x] <= aContext.sample_high[0]
+			&& PlaneSamplesMatch(aContext, aRow + x) && MatchPlaneSSE2(aRow + x, aContext))
+			return x;
+	return -1;
+}
+
+
+// The pyramid reducers process 4 output pixels (8 input pixels from each row) per iteration: the two rows
+// are combined first, then the even and odd pixels of the result.
+#define PYRAMID_REDUCE_SSE2(op) \
+	__m128i mask = _mm_set1_epi32((int)aMask); \
+	int i = 0; \
+	for (; i + 4 <= aCount; i += 4) \
+	{ \
+		__m128i lo = op(_mm_and_si128(_mm_loadu_si128((const __m128i *)(aRow0 + 2*i)), mask) \
+			, _mm_and_si128(_mm_loadu_si128((const __m128i *)(aRow1 + 2*i)), mask)); \
+		__m128i hi = op(_mm_and_si128(_mm_loadu_si128((const __m128i *)(aRow0 + 2*i + 4)), mask) \
+			, _mm_and_si128(_mm_loadu_si128((const __m128i *)(aRow1 + 2*i + 4)), mask)); \
+		__m128 even = _mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)); \
+		__m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)); \
+		_mm_storeu_si128((__m128i *)(aOut + i), op(_mm_castps_si128(even), _mm_castps_si128(odd))); \
+	}
+
+TARGET_SSE2 void PyramidMinSSE2(const PIXEL32 *aRow0, const PIXEL32 *aRow1, int aCount, PIXEL32 aMask, PIXEL32 *aOut)
+{
+	PYRAMID_REDUCE_SSE2(_mm_min_epu8)
+	for (; i < aCount; ++i)
+		aOut[i] = PixelMin(PixelMin(aRow0[2*i] & aMask, aRow0[2*i + 1] & aMask), PixelMin(aRow1[2*i] & aMask, aRow1[2*i + 1] & aMask));
+}
+
+
+
+TARGET_SSE2 void PyramidMaxSSE2(const PIXEL32 *aRow0, const PIXEL32 *aRow1, int aCount, PIXEL32 aMask, PIXEL32 *aOut)
+{
+	PYRAMID_REDUCE_SSE2(_mm_max_epu8)
+	for (; i < aCount; ++i)
+		aOut[i] = PixelMax(PixelMax(aRow0[2*i] & aMask, aRow0[2*i + 1] & aMask), PixelMax(aRow1[2*i] & aMask, aRow1[2*i + 1] & aMask));
+}
+
+
+
+TARGET_SSE2 int DotRowSSE2(const short *aA, const short *aB, int aCount)
+// Each 32-bit lane of the madd accumulates pairs of products, which fits for any plausible row.
+{
+	__m128i sum = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 8 <= aCount; i += 8)
+		sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(aA + i)), _mm_loadu_si128((const __m128i *)(aB + i))));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+	int dot = _mm_cvtsi128_si32(sum);
+	for (; i < aCount; ++i)
+		dot += aA[i] * aB[i];
+	return dot;
+}
+
+
+
+#ifdef SEARCH_AVX2
+///////////////
+// AVX2 (8 pixels per compare)
+///////////////
+
+TARGET_AVX2 static bool MatchExactAVX2(const PIXEL32 *aScreen, ptrdiff_t aStride, const SearchNeedle &aNeedle)
+{
+	const PIXEL32 *value = aNeedle.value, *care = aNeedle.care;
+	int wide_width = aNeedle.width & ~7;
+	for (int y = 0; y < aNeedle.height; ++y, aScreen += aStride, value += aNeedle.width, care += aNeedle.width)
+	{
+		int x;
+		for (x = 0; x < wide_width; x += 8)
+		{
+			__m256i screen = _mm256_loadu_si256((const __m256i *)(aScreen + x));
+			screen = _mm256_and_si256(screen, _mm256_loadu_si256((const __m256i *)(care + x)));
+			if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(screen, _mm256_loadu_si256((const __m256i *)(value + x)))) != -1)
+				return false;
+		}
+		if (x + 4 <= aNeedle.width)
+		{
+			__m128i screen = _mm_loadu_si128((const __m128i *)(aScreen + x));
+			screen = _mm_and_si128(screen, _mm_loadu_si128((const __m128i *)(care + x)));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(screen, _mm_loadu_si128((const __m128i *)(value + x)))) != 0xFFFF)
+				return false;
+			x += 4;
+		}
+		for (; x < aNeedle.width; ++x)
+			if ((aScreen[x] & care[x]) != value[x])
+				return false;
+	}
+	return true;
+}
+
+
+
+TARGET_AVX2 int RowExactAVX2(const SearchContext &aContext, const PIXEL32 *aRow, int aXBegin, int aXEnd)
+{
+	const SearchNeedle &needle = *aContext.needle;
+	__m256i care0 = _mm256_set1_epi32((int)needle.care[needle.sample[0]]);
+	__m256i value0 = _mm256_set1_epi32((int)needle.value[needle.sample[0]]);
+	const PIXEL32 *probe = aRow + aContext.sample_offset[0];
+	int x = aXBegin;
+	for (; x + 8 <= aXEnd; x += 8)
+	{
+		__m256i screen = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(probe + x)), care0);
+		unsigned int candidates = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(screen, value0)));
+		for (; candidates; candidates &= candidates - 1)
+		{
+			int candidate = x + LowestBit(candidates);
+			if (SamplesMatchExact(aContext, aRow + candidate) && MatchExactAVX2(aRow + candidate, aContext.stride, needle))
+				return candidate;
+		}
+	}
+	for (; x < aXEnd; ++x)
+		if ((probe[x] & needle.care[needle.sample[0]]) == needle.value[needle.sample[0]]
+			&& SamplesMatchExact(aContext, aRow + x) && MatchExactAVX2(aRow + x, aContext.stride, needle))
+			return x;
+	return -1;
+}
+
+
+
+TARGET_AVX2 static inline __m256i OutOfBoundsAVX2(__m256i aScreen, __m256i aLow, __m256i aHigh)
+{
+	return _mm256_or_si256(_mm256_subs_epu8(aLow, aScreen), _mm256_subs_epu8(aScreen, aHigh));
+}
+
+
+
+TARGET_AVX2 static bool MatchVariationAVX2(const PIXEL32 *aScreen, const SearchContext &aContext)
+{
+	const SearchNeedle &needle = *aContext.needle;
+	const PIXEL32 *low = aContext.low, *high = aContext.high;
+	int wide_width = needle.width & ~7;
+	for (int y = 0; y < needle.height; ++y, aScreen += aContext.stride, low += needle.width, high += needle.width)
+	{
+		int x;
+		for (x = 0; x < wide_width; x += 8)
+		{
+			__m256i out = OutOfBoundsAVX2(_mm256_loadu_si256((const __m256i *)(aScreen + x))
+				, _mm256_loadu_si256((const __m256i *)(low + x)), _mm256_loadu_si256((const __m256i *)(high + x)));
+			if (!_mm256_testz_si256(out, out))
+				return false;
+		}
+		if (x + 4 <= needle.width)
+		{
+			__m128i out = OutOfBoundsSSE2(_mm_loadu_si128((const __m128i *)(aScreen + x))
+				, _mm_loadu_si128((const __m128i *)(low + x)), _mm_loadu_si128((const __m128i *)(high + x)));
+			if (!_mm_testz_si128(out, out))
+				return false;
+			x += 4;
+		}
+		for (; x < needle.width; ++x)
+			if (!PixelInBounds(aScreen[x], low[x], high[x]))
+				return false;
+	}
+	return true;
+}
+
+
+
+TARGET_AVX2 int RowVariationAVX2(const SearchContext &aContext, const PIXEL32 *aRow, int aXBegin, int aXEnd)
+{
+	int sample0 = aContext.needle->sample[0];
+	__m256i low0 = _mm256_set1_epi32((int)aContext.low[sample0]);
+	__m256i high0 = _mm256_set1_epi32((int)aContext.high[sample0]);
+	const PIXEL32 *probe = aRow + aContext.sample_offset[0];
+	__m256i zero = _mm256_setzero_si256();
+	int x = aXBegin;
+	for (; x + 8 <= aXEnd; x += 8)
+	{
+		__m256i out = OutOfBoundsAVX2(_mm256_loadu_si256((const __m256i *)(probe + x)), low0, high0);
+		unsigned int candidates = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(out, zero)));
+		for (; candidates; candidates &= candidates - 1)
+		{
+			int candidate = x + LowestBit(candidates);
+			if (SamplesMatchVariation(aContext, aRow + candidate) && MatchVariationAVX2(aRow + candidate, aContext))
+				return candidate;
+		}
+	}
+	for (; x < aXEnd; ++x)
+		if (PixelInBounds(probe[x], aContext.low[sample0], aContext.high[sample0])
+			&& SamplesMatchVariation(aContext, aRow + x) && MatchVariationAVX2(aRow + x, aContext))
+			return x;
+	return -1;
+}
+
+
+
+
+TARGET_AVX2 static bool MatchPlaneAVX2(const PIXEL8 *aScreen, const PlaneContext &aContext)
+{
+	const PIXEL8 *low = aContext.low, *high = aContext.high;
+	int wide_width = aContext.width & ~31;
+	for (int y = 0; y < aContext.height; ++y, aScreen += aContext.stride, low += aContext.width, high += aContext.width)
+	{
+		int x;
+		for (x = 0; x < wide_width; x += 32)
+		{
+			__m256i out = OutOfBoundsAVX2(_mm256_loadu_si256((const __m256i *)(aScreen + x))
+				, _mm256_loadu_si256((const __m256i *)(low + x)), _mm256_loadu_si256((const __m256i *)(high + x)));
+			if (!_mm256_testz_si256(out, out))
+				return false;
+		}
+		if (x + 16 <= aContext.width)
+		{
+			__m128i out = OutOfBoundsSSE2(_mm_loadu_si128((const __m128i *)(aScreen + x))
+				, _mm_loadu_si128((const __m128i *)(low + x)), _mm_loadu_si128((const __m128i *)(high + x)));
+			if (!_mm_testz_si128(out, out))
+				return false;
+			x += 16;
+		}
+		for (; x < aContext.width; ++x)
+			if (aScreen[x] < low[x] || aScreen[x] > high[x])
+				return false;
+	}
+	return true;
+}
+
+
+
+TARGET_AVX2 int RowPlaneAVX2(const PlaneContext &aContext, const PIXEL8 *aRow, int aXBegin, int aXEnd)
+{
+	__m256i low0 = _mm256_set1_epi8((char)aContext.sample_low[0]);
+	__m256i high0 = _mm256_set1_epi8((char)aContext.sample_high[0]);
+	const PIXEL8 *probe = aRow + aContext.sample_offset[0];
+	__m256i zero = _mm256_setzero_si256();
+	int x = aXBegin;
+	for (; x + 32 <= aXEnd; x += 32)
+	{
+		__m256i out = OutOfBoundsAVX2(_mm256_loadu_si256((const __m256i *)(probe + x)), low0, high0);
+		unsigned int candidates = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(out, zero));
+		for (; candidates; candidates &= candidates - 1)
+		{
+			int candidate = x + LowestBit(candidates);
+			if (PlaneSamplesMatch(aContext, aRow + candidate) && MatchPlaneAVX2(aRow + candidate, aContext))
+				return candidate;
+		}
+	}
+	for (; x < aXEnd; ++x)
+		if (probe[x] >= aContext.sample_low[0] && probe[x] <= aContext.sample_high[0]
+			&& PlaneSamplesMatch(aContext, aRow + x) && MatchPlaneAVX2(aRow + x, aContext))
+			return x;
+	return -1;
+}
+
+
+
+TARGET_AVX2 int DotRowAVX2(const short *aA, const short *aB, int aCount)
+{
+	__m256i sum = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 16 <= aCount; i += 16)
+		sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(aA + i)), _mm256_loadu_si256((const __m256i *)(aB + i))));
+	__m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+	if (i + 8 <= aCount)
+	{
+		half = _mm_add_epi32(half, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(aA + i)), _mm_loadu_si128((const __m128i *)(aB + i))));
+		i += 8;
+	}
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+	int dot = _mm_cvtsi128_si32(half);
+	for (; i < aCount; ++i)
+		dot += aA[i] * aB[i];
+	return dot;
+}
+#endif // SEARCH_AVX2
+
+#endif // SEARCH_X86
@@ -0,0 +1,292 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// Incremental searching of a haystack that is captured over and over, most often without changing.
+// A watch keeps a copy of the last haystack and the result of searching it.  Each new haystack is
+// compared with the copy in tiles, and only the positions at which the needle would overlap a changed
+// tile are searched again, since every other position must match or not just as it did before.
+//
+// The first match in scan order is then the earlier of the previous match (if it is still there) and the
+// first match among the positions that were searched again.  Positions after the previous match were
+// never searched, so if the previous match itself is gone, the search carries on from it as usual.
+
+#include "search_kernels.h"
+#include "platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define WATCH_TILE 32 // Width and height of the tiles compared between haystacks.
+
+struct SearchWatch
+{
+	PIXEL32 *previous;            // Copy of the last haystack searched, stride pixels per row.
+	int width, height, stride;
+	SearchBatchItem *item;        // The needles last searched for (referenced) and their results.
+	int item_count;
+	int tile_cols, tile_rows;
+	unsigned char *dirty;         // One per tile: non-zero if it changed since the last search.
+	unsigned char *column_dirty;  // One per column of tiles: scratch for WatchUpdate().
+};
+
+
+
+SearchWatch *WatchCreate()
+// Returns NULL on failure.  Caller must WatchFree() the result.
+{
+	return (SearchWatch *)calloc(1, sizeof(SearchWatch));
+}
+
+
+
+static void WatchClear(SearchWatch &aWatch)
+// Frees everything aWatch owns, leaving it as WatchCreate() made it.
+{
+	for (int i = 0; i < aWatch.item_count; ++i)
+		NeedleRelease((SearchNeedle *)aWatch.item[i].needle);
+	free(aWatch.item);
+	AlignedFree(aWatch.previous);
+	free(aWatch.dirty); // column_dirty shares this block.
+	memset(&aWatch, 0, sizeof(SearchWatch));
+}
+
+
+
+void WatchFree(SearchWatch *aWatch)
+{
+	if (!aWatch)
+		return;
+	WatchClear(*aWatch);
+	free(aWatch);
+}
+
+
+
+static bool WatchReset(SearchWatch &aWatch, const SearchImage &aHaystack, SearchBatchItem *aItem, int aItemCount)
+// Sets up aWatch for a haystack of a different size or different needles, by searching all of aHaystack.
+// Returns false on failure (out of memory), in which case aWatch is left cleared.
+{
+	WatchClear(aWatch);
+	aWatch.width = aHaystack.width;
+	aWatch.height = aHaystack.height;
+	aWatch.stride = AlignedStride(aHaystack.width, sizeof(PIXEL32));
+	aWatch.tile_cols = (aHaystack.width + WATCH_TILE - 1) / WATCH_TILE;
+	aWatch.tile_rows = (aHaystack.height + WATCH_TILE - 1) / WATCH_TILE;
+	aWatch.previous = (PIXEL32 *)AlignedAlloc((size_t)aWatch.stride * aHaystack.height * sizeof(PIXEL32), SEARCH_ALIGN);
+	aWatch.dirty = (unsigned char *)malloc(aWatch.tile_cols * (aWatch.tile_rows + 1));
+	aWatch.item = (SearchBatchItem *)malloc(aItemCount * sizeof(SearchBatchItem));
+	if (!aWatch.previous || !aWatch.dirty || !aWatch.item)
+	{
+		WatchClear(aWatch);
+		return false;
+	}
+	aWatch.column_dirty = aWatch.dirty + aWatch.tile_cols * aWatch.tile_rows;
+	for (int y = 0; y < aHaystack.height; ++y)
+		memcpy(aWatch.previous + y * aWatch.stride, aHaystack.pixels + y * (ptrdiff_t)aHaystack.stride
+			, aHaystack.width * sizeof(PIXEL32));
+	memcpy(aWatch.item, aItem, aItemCount * sizeof(SearchBatchItem));
+	if (SearchBatch(aHaystack, aWatch.item, aItemCount) < 0)
+	{
+		WatchClear(aWatch);
+		return false;
+	}
+	for (aWatch.item_count = 0; aWatch.item_count < aItemCount; ++aWatch.item_count)
+		NeedleAddRef((SearchNeedle *)aWatch.item[aWatch.item_count].needle);
+	return true;
+}
+
+
+
+static bool WatchDiff(SearchWatch &aWatch, const SearchImage &aHaystack)
+// Marks the tiles in which aHaystack differs from the previous one, and brings the copy up to date.
+// Returns true if any did.
+{
+	bool any = false;
+	memset(aWatch.dirty, 0, aWatch.tile_cols * aWatch.tile_rows);
+	const PIXEL32 *row = aHaystack.pixels;
+	PIXEL32 *previous = aWatch.previous;
+	unsigned char *dirty = aWatch.dirty;
+	for (int y = 0; y < aHaystack.height; ++y, row += aHaystack.stride, previous += aWatch.stride)
+	{
+		if (y && !(y % WATCH_TILE)) // Into the next row of tiles.
+			dirty += aWatch.tile_cols;
+		if (!memcmp(previous, row, aWatch.width * sizeof(PIXEL32))) // The usual case, so check the whole row first.
+			continue;
+		for (int c = 0; c < aWatch.tile_cols; ++c)
+		{
+			int x = c * WATCH_TILE, count = aWatch.width - x < WATCH_TILE ? aWatch.width - x : WATCH_TILE;
+			if (memcmp(previous + x, row + x, count * sizeof(PIXEL32)))
+			{
+				memcpy(previous + x, row + x, count * sizeof(PIXEL32));
+				dirty[c] = 1;
+				any = true;
+			}
+		}
+	}
+	return any;
+}
+
+
+
+static bool WatchUpdate(SearchWatch &aWatch, const SearchImage &aHaystack, SearchBatchItem &aItem)
+// Brings aItem's result up to date after WatchDiff() has marked the tiles that changed.
+// Returns false on failure (out of memory).
+{
+	const SearchNeedle &needle = *aItem.needle;
+	int last_x = aHaystack.width - needle.width;
+	int last_y = aHaystack.height - needle.height;
+	if (last_x < 0 || last_y < 0) // Needle is larger than the haystack, so the result can't change.
+		return true;
+	SearchContext context;
+	if (!SearchBegin(context, needle, aHaystack.stride, aItem.variation))
+		return false;
+
+	// Search the positions whose needle overlaps a changed tile, as far as the previous match:
+	bool found = false, previous_found = aItem.found;
+	int y_end = previous_found ? aItem.y : last_y, x, y;
+	const PIXEL32 *row = aHaystack.pixels;
+	for (y = 0; y <= y_end && !found; ++y, row += aHaystack.stride)
+	{
+		int r, c, r_end = (y + needle.height - 1) / WATCH_TILE;
+		bool any = false;
+		memset(aWatch.column_dirty, 0, aWatch.tile_cols);
+		for (r = y / WATCH_TILE; r <= r_end; ++r)
+			for (c = 0; c < aWatch.tile_cols; ++c)
+				if (aWatch.dirty[r * aWatch.tile_cols + c])
+					aWatch.column_dirty[c] = any = true;
+		if (!any)
+			continue;
+		int x_last = (previous_found && y == aItem.y) ? aItem.x - 1 : last_x;
+		int x_next = 0; // Positions before this have already been searched in this row.
+		for (c = 0; c < aWatch.tile_cols; )
+		{
+			if (!aWatch.column_dirty[c])
+			{
+				++c;
+				continue;
+			}
+			int c_begin = c;
+			for (++c; c < aWatch.tile_cols && aWatch.column_dirty[c]; ++c);
+			int x_begin = c_begin * WATCH_TILE - (needle.width - 1);
+			int x_end = c * WATCH_TILE - 1; // Inclusive.
+			if (x_begin < x_next)
+				x_begin = x_next;
+			if (x_end > x_last)
+				x_end = x_last;
+			if (x_begin > x_end)
+				continue;
+			if ((x = context.row_func(context, row, x_begin, x_end + 1)) >= 0)
+			{
+				found = true;
+				aItem.x = x;
+				aItem.y = y;
+				break;
+			}
+			x_next = x_end + 1;
+		}
+	}
+	if (!found && previous_found)
+	{
+		// Check that the previous match is still there, unless nothing under it has changed:
+		int r, c;
+		bool changed = false;
+		for (r = aItem.y / WATCH_TILE; r <= (aItem.y + needle.height - 1) / WATCH_TILE && !changed; ++r)
+			for (c = aItem.x / WATCH_TILE; c <= (aItem.x + needle.width - 1) / WATCH_TILE; ++c)
+				if (aWatch.dirty[r * aWatch.tile_cols + c])
+				{
+					changed = true;
+					break;
+				}
+		row = aHaystack.pixels + aItem.y * (ptrdiff_t)aHaystack.stride;
+		if (changed && context.row_func(context, row, aItem.x, aItem.x + 1) < 0)
+		{
+			// Gone, so carry on from it with an ordinary search of the rest of the haystack:
+			x = context.row_func(context, row, aItem.x + 1, last_x + 1);
+			for (y = aItem.y; x < 0 && y < last_y; )
+			{
+				row += aHaystack.stride;
+				x = context.row_func(context, row, 0, last_x + 1);
+				++y;
+			}
+			if (x >= 0)
+			{
+				found = true;
+				aItem.x = x;
+				aItem.y = y;
+			}
+		}
+		else
+			found = true;
+	}
+	aItem.found = found;
+	SearchEnd(context);
+	return true;
+}
+
+
+
+int WatchSearchBatch(SearchWatch &aWatch, const SearchImage &aHaystack, SearchBatchItem *aItem, int aItemCount)
+// Same as SearchBatch(), but only searches again where aHaystack differs from the one given to the
+// previous call.  The first call, and any call with different needles, variations or haystack size,
+// searches all of aHaystack.
+{
+	int i, found_count = 0;
+	bool same = aWatch.previous && aWatch.item_count == aItemCount
+		&& aWatch.width == aHaystack.width && aWatch.height == aHaystack.height;
+	for (i = 0; same && i < aItemCount; ++i)
+		same = aWatch.item[i].needle == aItem[i].needle && aWatch.item[i].variation == aItem[i].variation;
+	if (!same)
+	{
+		if (!WatchReset(aWatch, aHaystack, aItem, aItemCount))
+			return SearchBatch(aHaystack, aItem, aItemCount);
+	}
+	else if (WatchDiff(aWatch, aHaystack))
+	{
+		for (i = 0; i < aItemCount; ++i)
+			if (!WatchUpdate(aWatch, aHaystack, aWatch.item[i]))
+			{
+				WatchClear(aWatch); // Its results are no longer known.
+				return SearchBatch(aHaystack, aItem, aItemCount);
+			}
+	}
+	for (i = 0; i < aItemCount; ++i)
+	{
+		aItem[i].found = aWatch.item[i].found;
+		if (aItem[i].found)
+		{
+			aItem[i].x = aWatch.item[i].x;
+			aItem[i].y = aWatch.item[i].y;
+			++found_count;
+		}
+	}
+	return found_count;
+}
+
+
+
+bool WatchSearchFirst(SearchWatch &aWatch, const SearchImage &aHaystack, const SearchNeedle &aNeedle, int aVariation
+	, int &aX, int &aY)
+// Same as SearchFirst(), but only searches again where aHaystack differs from the one given to the
+// previous call, as WatchSearchBatch() does for a single needle.
+{
+	SearchBatchItem item;
+	item.needle = &aNeedle;
+	item.variation = aVariation;
+	if (WatchSearchBatch(aWatch, aHaystack, &item, 1) < 1)
+		return false;
+	aX = item.x;
+	aY = item.y;
+	return true;
+}
@@ -0,0 +1,221 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// The searchtest tool, which checks SearchFirst() and SearchAll() against a plain pixel-by-pixel search
+// on saved screenshots, so that changes to the row kernels can be regression-tested anywhere (including
+// on Linux).  It is not part of the DLL: build it with the portable engine files as described in
+// "How to compile.txt".
+//
+// Usage: searchtest [*Needles<n>] <image file>...
+//
+// From each image (PNG or BMP), n needles (50 by default) are cut at positions and of sizes that are the
+// same from one run to the next.  Each is searched for exactly, within a variation after its pixels have
+// been changed slightly, with its upper-left pixel's color transparent, and with the 16-bit color mask.
+// Every search is run on one thread and then on one per CPU.  Any result that differs from the plain
+// search's is printed.  The exit code is 0 if there were none, 1 if there were, and 2 for bad arguments.
+
+#include "search.h"
+#include "imagedecode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_MAX_MATCHES 256
+#define TEST_VARIATION 12
+
+static unsigned int sSeed = 1;
+
+
+
+static int Random(int aCount)
+// Returns 0 to aCount-1, the same sequence on every platform.
+{
+	sSeed = sSeed * 1103515245 + 12345;
+	return (int)((sSeed >> 16) % (unsigned int)aCount);
+}
+
+
+
+static bool MatchesAt(const SearchImage &aHaystack, const SearchImage &aNeedle, PIXEL32 aTransColor
+	, PIXEL32 aColorMask, int aVariation, int aX, int aY)
+// The plain comparison, written out from scratch rather than with anything from the engine: every
+// opaque needle pixel must be within aVariation of the screen's, component by component, after both
+// are ANDed with aColorMask.
+{
+	for (int y = 0; y < aNeedle.height; ++y)
+	{
+		const PIXEL32 *screen = aHaystack.pixels + (aY + y) * (ptrdiff_t)aHaystack.stride + aX;
+		const PIXEL32 *needle = aNeedle.pixels + y * (ptrdiff_t)aNeedle.stride;
+		for (int x = 0; x < aNeedle.width; ++x)
+		{
+			if ((needle[x] & 0xFFFFFF) == aTransColor)
+				continue;
+			for (int shift = 0; shift < 24; shift += 8)
+			{
+				int s = (screen[x] & aColorMask) >> shift & 0xFF, n = (needle[x] & aColorMask) >> shift & 0xFF;
+				if (s < n - aVariation || s > n + aVariation)
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+
+static int ReferenceAll(const SearchImage &aHaystack, const SearchImage &aNeedle, PIXEL32 aTransColor
+	, PIXEL32 aColorMask, int aVariation, int aFlags, SearchMatch *aMatch, int aMaxMatches)
+// What SearchAll() should return: every position in scan order, leaving out those that overlap one
+// already reported if aFlags has SEARCH_NO_OVERLAP.
+{
+	int count = 0;
+	for (int y = 0; y + aNeedle.height <= aHaystack.height; ++y)
+		for (int x = 0; x + aNeedle.width <= aHaystack.width; ++x)
+		{
+			if (!MatchesAt(aHaystack, aNeedle, aTransColor, aColorMask, aVariation, x, y))
+				continue;
+			bool overlaps = false;
+			if (aFlags & SEARCH_NO_OVERLAP)
+				for (int i = 0; i < count && !overlaps; ++i)
+					overlaps = aMatch[i].x > x - aNeedle.width && aMatch[i].x < x + aNeedle.width
+						&& aMatch[i].y > y - aNeedle.height;
+			if (overlaps)
+				continue;
+			aMatch[count].x = x;
+			aMatch[count].y = y;
+			if (++count == aMaxMatches)
+				return count;
+		}
+	return count;
+}
+
+
+
+static int CheckNeedle(const char *aFile, const SearchImage &aHaystack, const SearchImage &aNeedle
+	, PIXEL32 aTransColor, PIXEL32 aColorMask, int aVariation, const char *aMode)
+// Searches aHaystack for aNeedle with the engine and with the plain search.  Returns the number of
+// results that differ, having printed them.
+{
+	SearchNeedle *needle = NeedleCreate(aNeedle, NULL, aTransColor, aColorMask);
+	if (!needle)
+	{
+		fprintf(stderr, "searchtest: out of memory\n");
+		exit(1);
+	}
+	static SearchMatch expected[TEST_MAX_MATCHES], found[TEST_MAX_MATCHES];
+	int failures = 0;
+	for (int flags = 0; flags <= SEARCH_NO_OVERLAP; flags += SEARCH_NO_OVERLAP)
+	{
+		int expected_count = ReferenceAll(aHaystack, aNeedle, aTransColor, aColorMask, aVariation, flags
+			, expected, TEST_MAX_MATCHES);
+		for (int threads = 1; threads >= 0; --threads) // One thread, then one per CPU.
+		{
+			SearchSetThreads(threads);
+			int found_count = SearchAll(aHaystack, *needle, aVariation, flags, found, TEST_MAX_MATCHES);
+			if (found_count != expected_count || memcmp(found, expected, found_count * sizeof(SearchMatch)))
+			{
+				printf("%s: %s %dx%d needle, SearchAll(flags %d, %d threads): %d matches, expected %d\n", aFile
+					, aMode, aNeedle.width, aNeedle.height, flags, threads, found_count, expected_count);
+				++failures;
+			}
+			int x, y;
+			if (flags)
+				continue;
+			bool is_found = SearchFirst(aHaystack, *needle, aVariation, x, y);
+			if (is_found != (expected_count > 0) || (is_found && (x != expected[0].x || y != expected[0].y)))
+			{
+				char found_at[32] = "not found", expected_at[32] = "not found";
+				if (is_found)
+					sprintf(found_at, "%d,%d", x, y);
+				if (expected_count)
+					sprintf(expected_at, "%d,%d", expected[0].x, expected[0].y);
+				printf("%s: %s %dx%d needle, SearchFirst(%d threads): %s, expected %s\n", aFile, aMode
+					, aNeedle.width, aNeedle.height, threads, found_at, expected_at);
+				++failures;
+			}
+		}
+	}
+	NeedleRelease(needle);
+	return failures;
+}
+
+
+
+int main(int argc, char **argv)
+{
+	int needle_count = 50, first = 1;
+	if (argc > 1 && (!strncmp(argv[1], "*Needles", 8) || !strncmp(argv[1], "*needles", 8)))
+	{
+		needle_count = atoi(argv[1] + 8);
+		++first;
+	}
+	if (first >= argc || needle_count < 1)
+	{
+		fprintf(stderr, "Usage: searchtest [*Needles<n>] <image file>...\n");
+		return 2;
+	}
+	int failures = 0, check_count = 0;
+	for (int f = first; f < argc; ++f)
+	{
+		DecodedImage image;
+		if (!ImageDecodeFile(argv[f], image))
+		{
+			fprintf(stderr, "searchtest: %s is not a PNG or BMP file that can be decoded\n", argv[f]);
+			return 2;
+		}
+		SearchImage haystack = {image.pixel, image.width, image.height, image.width};
+		PIXEL32 *changed = (PIXEL32 *)malloc(48 * 32 * sizeof(PIXEL32));
+		if (!changed)
+			return 1;
+		sSeed = 1; // The same needles for the same image, whichever order the images are given in.
+		for (int i = 0; i < needle_count; ++i)
+		{
+			int w = 1 + Random(48), h = 1 + Random(32);
+			if (w > image.width)
+				w = image.width;
+			if (h > image.height)
+				h = image.height;
+			int left = Random(image.width - w + 1), top = Random(image.height - h + 1);
+			SearchImage needle = {image.pixel + top * (ptrdiff_t)image.width + left, w, h, image.width};
+			failures += CheckNeedle(argv[f], haystack, needle, SEARCH_NO_TRANS, SEARCH_COLOR_MASK, 0, "exact");
+			failures += CheckNeedle(argv[f], haystack, needle, needle.pixels[0] & 0xFFFFFF, SEARCH_COLOR_MASK, 0
+				, "transparent");
+			failures += CheckNeedle(argv[f], haystack, needle, SEARCH_NO_TRANS, SEARCH_COLOR_MASK_16BIT, 0
+				, "16-bit");
+			// Each component changed by up to the variation, and sometimes by more, so that some searches
+			// find the needle where it was cut and some don't:
+			for (int y = 0; y < h; ++y)
+				for (int x = 0; x < w; ++x)
+				{
+					PIXEL32 pixel = needle.pixels[y * (ptrdiff_t)needle.stride + x] & 0xFFFFFF;
+					int shift = 8 * Random(3), n = (pixel >> shift) & 0xFF;
+					n += Random(2 * TEST_VARIATION + 3) - TEST_VARIATION - 1;
+					n = n < 0 ? 0 : (n > 255 ? 255 : n);
+					changed[y * w + x] = (pixel & ~(0xFFu << shift)) | ((PIXEL32)n << shift);
+				}
+			SearchImage changed_needle = {changed, w, h, w};
+			failures += CheckNeedle(argv[f], haystack, changed_needle, SEARCH_NO_TRANS, SEARCH_COLOR_MASK
+				, TEST_VARIATION, "variation");
+			failures += CheckNeedle(argv[f], haystack, changed_needle, SEARCH_NO_TRANS, SEARCH_COLOR_MASK_16BIT
+				, TEST_VARIATION, "16-bit variation");
+			++check_count;
+		}
+		free(changed);
+		ImageDecodeFree(image);
+	}
+	printf("searchtest: %d needles, each searched for in 5 ways, %d differences\n", check_count, failures);
+	return failures ? 1 : 0;
+}
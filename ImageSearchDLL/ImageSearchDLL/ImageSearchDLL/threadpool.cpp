@@ -0,0 +1,142 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// No stdafx.h here: see threadpool.h.
+#include "threadpool.h"
+#include "platform.h"
+#include <stddef.h>
+
+#define POOL_MAX_THREADS 64
+
+static int sThreads = 1;               // Desired number of threads working on each job, including the caller's.
+static int sWorkerCount = 0;           // Number of worker threads started so far.  They are never ended.
+static PlatformMutex *sJobLock = NULL; // Held by whichever thread is running a job on the pool.
+static PlatformSemaphore *sWake = NULL, *sDone = NULL;
+
+// The current job:
+static PoolTaskFunc sFunc;
+static void *sParam;
+static int sTaskCount;
+static volatile int sNextTask;
+static volatile int sActive; // Number of threads that haven't yet finished with the current job.
+
+
+
+static void RunTasks()
+// Each thread in the job claims the next task until none are left.
+{
+	for (int i; (i = AtomicIncrement(&sNextTask) - 1) < sTaskCount; )
+		sFunc(sParam, i);
+}
+
+
+
+static void WorkerThread(void *)
+{
+	for (;;)
+	{
+		SemaphoreWait(sWake);
+		RunTasks();
+		if (!AtomicDecrement(&sActive)) // Last one out lets PoolRun() return.
+			SemaphorePost(sDone, 1);
+	}
+}
+
+
+
+void PoolSetThreads(int aCount)
+// aCount is the total number of threads a parallel search may use, including the calling thread.
+// 1 (the default) disables parallel searching and 0 means one per CPU.  This should not be called while
+// another thread might be searching.
+{
+	if (aCount < 1)
+		aCount = CpuCount();
+	if (aCount > POOL_MAX_THREADS)
+		aCount = POOL_MAX_THREADS;
+	if (aCount > 1 && !sJobLock)
+	{
+		if (!sWake)
+			sWake = SemaphoreCreate(0);
+		if (!sDone)
+			sDone = SemaphoreCreate(0);
+		if (!sWake || !sDone || !(sJobLock = MutexCreate()))
+			return; // Leave the pool disabled.
+	}
+	sThreads = aCount;
+}
+
+
+
+int PoolGetThreads()
+{
+	return sThreads;
+}
+
+
+
+static bool PoolInit()
+// Must be called with sJobLock held.  Starts any workers needed to bring the
+// pool up to sThreads.  Returns false if the pool can't be used at all.
+{
+	if (!sWorkerCount && sThreads > 1 && !ModulePin()) // The workers run until the process ends.
+		return false;
+	while (sWorkerCount < sThreads - 1)
+	{
+		if (!ThreadStart(WorkerThread, NULL))
+			break;
+		++sWorkerCount;
+	}
+	return sWorkerCount > 0;
+}
+
+
+
+void PoolRun(PoolTaskFunc aFunc, void *aParam, int aTaskCount)
+// Calls aFunc(aParam, i) for each i from 0 to aTaskCount - 1, spread over the calling thread and up to
+// sThreads - 1 workers, and returns once all of them have returned.  Tasks are started in order of i.
+// If the pool is already running another job (for example one started by another thread), or can't be
+// set up, the tasks are all run on the calling thread instead.
+{
+	if (sThreads < 2 || aTaskCount < 2 || !sJobLock || !MutexTryLock(sJobLock))
+	{
+		for (int i = 0; i < aTaskCount; ++i)
+			aFunc(aParam, i);
+		return;
+	}
+	if (!PoolInit())
+	{
+		MutexUnlock(sJobLock);
+		for (int i = 0; i < aTaskCount; ++i)
+			aFunc(aParam, i);
+		return;
+	}
+
+	int worker_count = sThreads - 1;
+	if (worker_count > sWorkerCount)
+		worker_count = sWorkerCount;
+	if (worker_count > aTaskCount - 1)
+		worker_count = aTaskCount - 1;
+	sFunc = aFunc;
+	sParam = aParam;
+	sTaskCount = aTaskCount;
+	sNextTask = 0;
+	sActive = worker_count + 1;
+	SemaphorePost(sWake, worker_count); // Posting also publishes the job's variables to the workers.
+	RunTasks();
+	if (AtomicDecrement(&sActive))
+		SemaphoreWait(sDone);
+	MutexUnlock(sJobLock);
+}
@@ -0,0 +1,29 @@
+/*
+AutoHotkey
+
+Copyright 2003-2007 Chris Mallett (support@autohotkey.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+// A process-wide pool of worker threads that stay alive between searches, so that a parallel search
+// doesn't pay for creating threads.
+
+#ifndef threadpool_h
+#define threadpool_h
+
+typedef void (*PoolTaskFunc)(void *aParam, int aIndex);
+
+void PoolSetThreads(int aCount);
+int PoolGetThreads();
+void PoolRun(PoolTaskFunc aFunc, void *aParam, int aTaskCount);
+
+#endif
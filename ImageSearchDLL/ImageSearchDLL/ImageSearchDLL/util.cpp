@@ -25,6 +25,14 @@ GNU General Public License for more details.
 #include <stdio.h>
 #include <stdlib.h>
 #include <shellapi.h>
+#include "util.h"
+#include "search.h"
+#include "needlecache.h"
+#include "jobqueue.h"
+#include "imagedecode.h"
+#include "needlepack.h"
+#include "framering.h"
+#include "platform.h"
 
 
 #define CLR_DEFAULT 0x808080
@@ -33,7 +41,7 @@ GNU General Public License for more details.
 #define CLR_NONE 0xFFFFFFFF
 #define IS_SPACE_OR_TAB(c) (c == ' ' || c == '\t')
 
-char answer[50];
+char answer[50]; // Returned by the entry points that return a string.  See MatchAnswer().
 
 HINSTANCE g_hInstance;
 
@@ -633,7 +641,7 @@ HBITMAP LoadPicture(char *aFilespec, int aWidth, int aHeight, int &aImageType, i
 		// a cursor to be retained if the specified size happens to match the actual size of the
 		// cursor.  This is because normally, it seems that CopyImage() omits cursor animation
 		// from the new object.  MSDN: "LR_COPYRETURNORG returns the original hImage if it satisfies
-		// the criteria for the copythat is, correct dimensions and color depthin which case the
+		// the criteria for the copy�that is, correct dimensions and color depth�in which case the
 		// LR_COPYDELETEORG flag is ignored. If this flag is not specified, a new object is always created."
 		// KNOWN BUG: Calling CopyImage() when the source image is tiny and the destination width/height
 		// is also small (e.g. 1) causes a divide-by-zero exception.
@@ -730,38 +738,35 @@ int WINAPI ImageTest(int a)
 {
 	return a + a;
 }
-// ResultType Line::ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile)
-char* WINAPI ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile)
-// Author: ImageSearch was created by Aurelian Maga.
+
+
+struct ImageSpec
+// The result of parsing an ImageSearch() image argument such as "*30 *TransBlack c:\button.bmp".
 {
-	// Many of the following sections are similar to those in PixelSearch(), so they should be
-	// maintained together.
-	//Var *output_var_x = ARGVAR1;  // Ok if NULL. RAW wouldn't be safe because load-time validation actually
-	//Var *output_var_y = ARGVAR2;  // requires a minimum of zero parameters so that the output-vars can be optional.
-
-	// Set default results, both ErrorLevel and output variables, in case of early return:
-	//g_ErrorLevel->Assign(ERRORLEVEL_ERROR2);  // 2 means error other than "image not found".
-	//if (output_var_x)
-	//	output_var_x->Assign();  // Init to empty string regardless of whether we succeed here.
-	//if (output_var_y)
-	//	output_var_y->Assign(); // Same.
-	RECT rect = {0}; // Set default (for CoordMode == "screen").
-	//if (!(g.CoordMode & COORD_MODE_PIXEL)) // Using relative vs. screen coordinates.
-	//{
-	//	if (!GetWindowRect(GetForegroundWindow(), &rect))
-	//		return OK; // Let ErrorLevel tell the story.
-	//	aLeft   += rect.left;
-	//	aTop    += rect.top;
-	//	aRight  += rect.left;  // Add left vs. right because we're adjusting based on the position of the window.
-	//	aBottom += rect.top;   // Same.
-	//}
+	char *file;       // Points into the caller's string, just past the last option.
+	int variation;    // 0 for an exact match, otherwise the number of shades each color component may vary by.
+	int icon_number;  // Zero means "load icon or bitmap (doesn't matter)".
+	int width, height;
+	COLORREF trans_color; // The default must be a value that can't occur naturally in an image.
+	bool pyramid;     // Search via the frame's image pyramid (see search_pyramid.cpp).
+	char *region;     // The text of the *Roi option, just past the word (see LoadRegion()), or NULL.
+	int channel;      // SEARCH_CHANNEL_* from the *Gray or *Channel option, or -1 to compare whole pixels.
+};
+
 
+
+bool ParseImageSpec(char *aImageFile, ImageSpec &aSpec)
+// Returns false if the options are malformed.
+{
 	// Options are done as asterisk+option to permit future expansion.
 	// Set defaults to be possibly overridden by any specified options:
-	int aVariation = 0;  // This is named aVariation vs. variation for use with the SET_COLOR_RANGE macro.
-	COLORREF trans_color = CLR_NONE; // The default must be a value that can't occur naturally in an image.
-	int icon_number = 0; // Zero means "load icon or bitmap (doesn't matter)".
-	int width = 0, height = 0;
+	aSpec.variation = 0;
+	aSpec.trans_color = CLR_NONE;
+	aSpec.icon_number = 0;
+	aSpec.width = aSpec.height = 0;
+	aSpec.pyramid = false;
+	aSpec.region = NULL;
+	aSpec.channel = -1;
 	// For icons, override the default to be 16x16 because that is what is sought 99% of the time.
 	// This new default can be overridden by explicitly specifying w0 h0:
 	char *cp = strrchr(aImageFile, '.');
@@ -769,7 +774,7 @@ char* WINAPI ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char *aIm
 	{
 		++cp;
 		if (!(_stricmp(cp, "ico") && _stricmp(cp, "exe") && _stricmp(cp, "dll")))
-			width = GetSystemMetrics(SM_CXSMICON), height = GetSystemMetrics(SM_CYSMICON);
+			aSpec.width = GetSystemMetrics(SM_CXSMICON), aSpec.height = GetSystemMetrics(SM_CYSMICON);
 	}
 
 	char color_name[32], *dp;
@@ -779,13 +784,13 @@ char* WINAPI ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char *aIm
 		++cp;
 		switch (toupper(*cp))
 		{
-		case 'W': width = ATOI(cp + 1); break;
-		case 'H': height = ATOI(cp + 1); break;
+		case 'W': aSpec.width = ATOI(cp + 1); break;
+		case 'H': aSpec.height = ATOI(cp + 1); break;
 		default:
 			if (!_strnicmp(cp, "Icon", 4))
 			{
 				cp += 4;  // Now it's the character after the word.
-				icon_number = ATOI(cp); // LoadPicture() correctly handles any negative value.
+				aSpec.icon_number = ATOI(cp); // LoadPicture() correctly handles any negative value.
 			}
 			else if (!_strnicmp(cp, "Trans", 5))
 			{
@@ -797,31 +802,45 @@ char* WINAPI ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char *aIm
 				// Fix for v1.0.44.10: Treat trans_color as containing an RGB value (not BGR) so that it matches
 				// the documented behavior.  In older versions, a specified color like "TransYellow" was wrong in
 				// every way (inverted) and a specified numeric color like "Trans0xFFFFAA" was treated as BGR vs. RGB.
-				trans_color = ColorNameToBGR(color_name);
-				if (trans_color == CLR_NONE) // A matching color name was not found, so assume it's in hex format.
+				aSpec.trans_color = ColorNameToBGR(color_name);
+				if (aSpec.trans_color == CLR_NONE) // A matching color name was not found, so assume it's in hex format.
 					// It seems strtol() automatically handles the optional leading "0x" if present:
-					trans_color = strtol(color_name, NULL, 16);
+					aSpec.trans_color = strtol(color_name, NULL, 16);
 					// if color_name did not contain something hex-numeric, black (0x00) will be assumed,
 					// which seems okay given how rare such a problem would be.
 				else
-					trans_color = bgr_to_rgb(trans_color); // v1.0.44.10: See fix/comment above.
-
+					aSpec.trans_color = bgr_to_rgb(aSpec.trans_color); // v1.0.44.10: See fix/comment above.
+			}
+			else if (!_strnicmp(cp, "Pyramid", 7))
+				aSpec.pyramid = true;
+			else if (!_strnicmp(cp, "Roi", 3))
+				aSpec.region = cp + 3; // Left as is: it ends at the space or tab found below.
+			else if (!_strnicmp(cp, "Gray", 4))
+				aSpec.channel = SEARCH_CHANNEL_LUMA;
+			else if (!_strnicmp(cp, "Channel", 7))
+			{
+				switch (toupper(cp[7]))
+				{
+				case 'R': aSpec.channel = SEARCH_CHANNEL_RED; break;
+				case 'G': aSpec.channel = SEARCH_CHANNEL_GREEN; break;
+				case 'B': aSpec.channel = SEARCH_CHANNEL_BLUE; break;
+				default: return false;
+				}
 			}
 			else // Assume it's a number since that's the only other asterisk-option.
 			{
-				aVariation = ATOI(cp); // Seems okay to support hex via ATOI because the space after the number is documented as being mandatory.
-				if (aVariation < 0)
-					aVariation = 0;
-				if (aVariation > 255)
-					aVariation = 255;
+				aSpec.variation = ATOI(cp); // Seems okay to support hex via ATOI because the space after the number is documented as being mandatory.
+				if (aSpec.variation < 0)
+					aSpec.variation = 0;
+				if (aSpec.variation > 255)
+					aSpec.variation = 255;
 				// Note: because it's possible for filenames to start with a space (even though Explorer itself
 				// won't let you create them that way), allow exactly one space between end of option and the
 				// filename itself:
 			}
 		} // switch()
 		if (   !(cp = StrChrAny(cp, " \t"))   ) // Find the first space or tab after the option.
-			return "0"; //new
-		//	return OK; // Bad option/format.  Let ErrorLevel tell the story.
+			return false; // Bad option/format.
 		// Now it's the space or tab (if there is one) after the option letter.  Advance by exactly one character
 		// because only one space or tab is considered the delimiter.  Any others are considered to be part of the
 		// filename (though some or all OSes might simply ignore them or tolerate them as first-try match criteria).
@@ -829,21 +848,37 @@ char* WINAPI ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char *aIm
 		// Above also serves to reset the filename to omit the option string whenever at least one asterisk-option is present.
 		cp = omit_leading_whitespace(cp); // This is done to make it more tolerant of having more than one space/tab between options.
 	}
+	aSpec.file = aImageFile;
+	return true;
+}
+
+
 
+SearchNeedle *LoadNeedleFromFile(ImageSpec &aSpec, HDC hdc, bool aScreenIs16Bit)
+// Loads the image described by aSpec and converts it to a needle for the search engine.
+// Returns NULL on failure.  Caller must NeedleRelease() the result.
+{
 	// Update: Transparency is now supported in icons by using the icon's mask.  In addition, an attempt
 	// is made to support transparency in GIF, PNG, and possibly TIF files via the *Trans option, which
 	// assumes that one color in the image is transparent.  In GIFs not loaded via GDIPlus, the transparent
 	// color might always been seen as pure white, but when GDIPlus is used, it's probably always black
 	// like it is in PNG -- however, this will not relied upon, at least not until confirmed.
-	// OLDER/OBSOLETE comment kept for background:
-	// For now, images that can't be loaded as bitmaps (icons and cursors) are not supported because most
-	// icons have a transparent background or color present, which the image search routine here is
-	// probably not equipped to handle (since the transparent color, when shown, typically reveals the
-	// color of whatever is behind it; thus screen pixel color won't match image's pixel color).
-	// So currently, only BMP and GIF seem to work reliably, though some of the other GDIPlus-supported
-	// formats might work too.
+	// PNG and BMP files at their own size are decoded directly (see imagedecode.cpp), which is much faster
+	// than GDI+ and also makes the transparent parts of a PNG transparent to the search.  Anything else,
+	// or any file the built-in decoder rejects, goes through LoadPicture() as before.
+	DecodedImage decoded;
+	if (!aSpec.icon_number && !aSpec.width && !aSpec.height && ImageDecodeFile(aSpec.file, decoded))
+	{
+		SearchImage image = {decoded.pixel, decoded.width, decoded.height, decoded.width};
+		SearchImage mask = {decoded.mask, decoded.width, decoded.height, decoded.width};
+		SearchNeedle *needle = NeedleCreate(image, decoded.mask ? &mask : NULL, aSpec.trans_color
+			, (decoded.is_16bit || aScreenIs16Bit) ? SEARCH_COLOR_MASK_16BIT : SEARCH_COLOR_MASK);
+		ImageDecodeFree(decoded);
+		return needle;
+	}
+
 	int image_type;
-	HBITMAP hbitmap_image = LoadPicture(aImageFile, width, height, image_type, icon_number, false);
+	HBITMAP hbitmap_image = LoadPicture(aSpec.file, aSpec.width, aSpec.height, image_type, aSpec.icon_number, false);
 	// The comment marked OBSOLETE below is no longer true because the elimination of the high-byte via
 	// 0x00FFFFFF seems to have fixed it.  But "true" is still not passed because that should increase
 	// consistency when GIF/BMP/ICO files are used by a script on both Win9x and other OSs (since the
@@ -852,26 +887,10 @@ char* WINAPI ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char *aIm
 	// by the search.  In other words, nothing works.  Obsolete comment: Pass "true" so that an attempt
 	// will be made to load icons as bitmaps if GDIPlus is available.
 	if (!hbitmap_image)
-		return "0"; // new
-	//	return OK; // Let ErrorLevel tell the story.
-
-	HDC hdc = GetDC(NULL);
-	if (!hdc)
-	{
-		DeleteObject(hbitmap_image);
-		return "0"; // new
-		// return OK; // Let ErrorLevel tell the story.
-	}
+		return NULL;
 
-	// From this point on, "goto end" will assume hdc and hbitmap_image are non-NULL, but that the below
-	// might still be NULL.  Therefore, all of the following must be initialized so that the "end"
-	// label can detect them:
-	HDC sdc = NULL;
-	HBITMAP hbitmap_screen = NULL;
-	LPCOLORREF image_pixel = NULL, screen_pixel = NULL, image_mask = NULL;
-	HGDIOBJ sdc_orig_select = NULL;
-	bool found = false; // Must init here for use by "goto end".
-    
+	LPCOLORREF image_pixel = NULL, image_mask = NULL;
+	SearchNeedle *needle = NULL;
 	bool image_is_16bit;
 	LONG image_width, image_height;
 
@@ -886,249 +905,1739 @@ char* WINAPI ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char *aIm
 			// okay to get all the pixels given the rarity of monochrome icons.  This scenario should be
 			// handled properly because: 1) the variables image_height and image_width will be overridden
 			// further below with the correct icon dimensions; 2) Only the first half of the pixels within
-			// the image_mask array will actually be referenced by the transparency checker in the loops,
-			// and that first half is the AND-mask, which is the transparency part that is needed.  The
-			// second half, the XOR part, is not needed and thus ignored.  Also note that if width/height
-			// required the icon to be scaled, LoadPicture() has already done that directly to the icon,
-			// so ii.hbmMask should already be scaled to match the size of the bitmap created later below.
+			// the image_mask array will actually be referenced by NeedleCreate(), and that first half is
+			// the AND-mask, which is the transparency part that is needed.  The second half, the XOR part,
+			// is not needed and thus ignored.  Also note that if width/height required the icon to be scaled,
+			// LoadPicture() has already done that directly to the icon, so ii.hbmMask should already be scaled
+			// to match the size of the bitmap created later below.
 			image_mask = getbits(ii.hbmMask, hdc, image_width, image_height, image_is_16bit, 1);
 			DeleteObject(ii.hbmColor); // DeleteObject() probably handles NULL okay since few MSDN/other examples ever check for NULL.
 			DeleteObject(ii.hbmMask);
 		}
 		if (   !(hbitmap_image = IconToBitmap((HICON)hbitmap_image, true))   )
-			return "0"; //new
-		//	return OK; // Let ErrorLevel tell the story.
+		{
+			free(image_mask);
+			return NULL;
+		}
 	}
 
-	if (   !(image_pixel = getbits(hbitmap_image, hdc, image_width, image_height, image_is_16bit))   )
-		goto end;
+	if (image_pixel = getbits(hbitmap_image, hdc, image_width, image_height, image_is_16bit))
+	{
+		SearchImage image = {(PIXEL32 *)image_pixel, image_width, image_height, image_width};
+		SearchImage mask = {(PIXEL32 *)image_mask, image_width, image_height, image_width};
+		// If either is 16-bit, *both* are compared in the 16-bit-compatible 32-bit format:
+		needle = NeedleCreate(image, image_mask ? &mask : NULL, aSpec.trans_color
+			, (image_is_16bit || aScreenIs16Bit) ? SEARCH_COLOR_MASK_16BIT : SEARCH_COLOR_MASK);
+		free(image_pixel);
+	}
+	if (image_mask)
+		free(image_mask);
+	DeleteObject(hbitmap_image);
+	return needle;
+}
+
+
+
+SearchNeedle *LoadPackedNeedle(const char *aName, bool aScreenIs16Bit)
+// Returns the needle named aName in one of the packs opened by ImagePackOpen(), or if aName is "#" followed
+// by a number, the needle with that id.  Returns NULL if there is none.  Caller must NeedleRelease() the result.
+{
+	SearchNeedle *needle = PackNeedle(*aName == '#' ? ATOI((char *)aName + 1) : PackFind(aName));
+	if (needle && aScreenIs16Bit) // Packed needles have the full color mask, so a 16-bit screen needs a copy.
+	{
+		SearchNeedle *copy = NeedleWithColorMask(*needle, SEARCH_COLOR_MASK_16BIT);
+		NeedleRelease(needle);
+		needle = copy;
+	}
+	return needle;
+}
+
+
+
+SearchNeedle *LoadNeedle(ImageSpec &aSpec, HDC hdc, bool aScreenIs16Bit)
+// Same as LoadNeedleFromFile() except that the needle is reused from the needle cache if the file hasn't
+// changed since it was last loaded with the same options, and that a file name of "pack:" followed by a
+// name or "#id" refers to a needle in an open pack (whose size and transparency were fixed when the pack
+// was made, so the corresponding options are ignored).  Caller must NeedleRelease() the result.
+{
+	if (!_strnicmp(aSpec.file, "pack:", 5))
+		return LoadPackedNeedle(aSpec.file + 5, aScreenIs16Bit);
+	FileStamp stamp;
+	if (!FileStampGet(aSpec.file, stamp)) // Not a plain file (or it doesn't exist), so don't cache it.
+		return LoadNeedleFromFile(aSpec, hdc, aScreenIs16Bit);
+	// Everything besides the file name and variation that affects what LoadNeedleFromFile() produces:
+	char options[64];
+	sprintf_s(options, "%d|%d|%d|%X|%d", aSpec.width, aSpec.height, aSpec.icon_number, aSpec.trans_color, aScreenIs16Bit);
+	SearchNeedle *needle = NeedleCacheLookup(aSpec.file, options, stamp);
+	if (!needle && (needle = LoadNeedleFromFile(aSpec, hdc, aScreenIs16Bit)))
+		NeedleCacheInsert(aSpec.file, options, stamp, needle);
+	return needle;
+}
+
+
+
+#define ROI_MAX_POINTS 64
+
+SearchRegion *LoadRegion(const char *aText)
+// Makes the region of interest described by a *Roi option, which limits a search to the positions whose
+// upper-left corner lies inside it.  aText is either the screen coordinates of the corners of a polygon,
+// separated by commas (such as "430,70,787,335,430,605,67,333" for a diamond), or "Mask" followed by the
+// name of an image whose non-black pixels make up the region, its upper-left pixel being the screen's.
+// Either way it ends at the first space or tab.  Regions are cached, so each is only turned into spans
+// by the search engine the first time it is used.
+// Returns NULL on failure.  Caller must RegionRelease() the result.
+{
+	char key[MAX_PATH + 8];
+	size_t length = strcspn(aText, " \t");
+	if (length >= sizeof(key))
+		return NULL;
+	memcpy(key, aText, length);
+	key[length] = '\0';
+	FileStamp stamp = {0, 0};
+	bool is_mask = !_strnicmp(key, "Mask", 4);
+	if (is_mask && !FileStampGet(key + 4, stamp))
+		return NULL;
+	SearchRegion *region = RegionCacheLookup(key, stamp);
+	if (region)
+		return region;
+
+	DecodedImage decoded;
+	if (is_mask && ImageDecodeFile(key + 4, decoded))
+	{
+		SearchImage mask = {decoded.pixel, decoded.width, decoded.height, decoded.width};
+		region = RegionCreateMask(mask, 0, 0);
+		ImageDecodeFree(decoded);
+	}
+	else if (is_mask)
+	{
+		int image_type;
+		HBITMAP hbitmap = LoadPicture(key + 4, 0, 0, image_type, 0, false);
+		if (hbitmap && image_type == IMAGE_ICON)
+			hbitmap = IconToBitmap((HICON)hbitmap, true);
+		if (!hbitmap)
+			return NULL;
+		HDC hdc = GetDC(NULL);
+		LONG mask_width, mask_height;
+		bool mask_is_16bit;
+		LPCOLORREF mask_pixel = hdc ? getbits(hbitmap, hdc, mask_width, mask_height, mask_is_16bit) : NULL;
+		if (hdc)
+			ReleaseDC(NULL, hdc);
+		DeleteObject(hbitmap);
+		if (!mask_pixel)
+			return NULL;
+		SearchImage mask = {(PIXEL32 *)mask_pixel, mask_width, mask_height, mask_width};
+		region = RegionCreateMask(mask, 0, 0);
+		free(mask_pixel);
+	}
+	else
+	{
+		int point[2 * ROI_MAX_POINTS], count = 0;
+		for (char *cp = key; *cp; ++cp) // Each number must be followed by a comma or the end.
+		{
+			if (count == 2 * ROI_MAX_POINTS)
+				return NULL;
+			char *end;
+			point[count++] = strtol(cp, &end, 10);
+			if (end == cp || (*end && *end != ','))
+				return NULL;
+			if (   !*(cp = end)   )
+				break;
+		}
+		if (count % 2)
+			return NULL;
+		region = RegionCreatePolygon(point, count / 2);
+	}
+	if (region)
+		RegionCacheInsert(key, stamp, region);
+	return region;
+}
+
 
-	// Create an empty bitmap to hold all the pixels currently visible on the screen that lie within the search area:
+
+HBITMAP CaptureScreen(HDC hdc, int aLeft, int aTop, int aRight, int aBottom, SearchImage &aImage, bool &aIs16Bit)
+// Copies the pixels currently visible on the screen within the given region straight into a top-down
+// 32bpp DIB section, whose bits are then searched in place rather than copied out again by getbits().
+// Its rows are padded to AlignedStride() and its bits start on a page boundary, so every row starts on a
+// cache line.  Sets aImage to its pixels and returns it, or returns NULL on failure.  Caller must
+// DeleteObject() the result when done with aImage.
+{
+	int depth = GetDeviceCaps(hdc, BITSPIXEL) * GetDeviceCaps(hdc, PLANES);
 	int search_width = aRight - aLeft + 1;
 	int search_height = aBottom - aTop + 1;
-	if (   !(sdc = CreateCompatibleDC(hdc)) || !(hbitmap_screen = CreateCompatibleBitmap(hdc, search_width, search_height))   )
+	if (depth < 8 || search_width < 1 || search_height < 1) // Same minimum depth as getbits().
+		return NULL;
+	// BitBlt() expands the pixels of a 16-bit screen the same way GetDIBits() does.  Either way, needles
+	// are compared with such a screen using the 16-bit color mask, which ignores the low bits.
+	aIs16Bit = (depth == 16);
+
+	BITMAPINFO bmi;
+	ZeroMemory(&bmi, sizeof(BITMAPINFO));
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = AlignedStride(search_width, sizeof(PIXEL32)); // Only the first search_width are captured.
+	bmi.bmiHeader.biHeight = -search_height; // Negative for top-down, the order the search engine scans in.
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = 32;
+	bmi.bmiHeader.biCompression = BI_RGB;
+
+	// From this point on, "goto end" will assume that the below might still be NULL.  Therefore, all of
+	// the following must be initialized so that the "end" label can detect them:
+	HDC sdc = NULL;
+	HGDIOBJ sdc_orig_select = NULL;
+	void *bits = NULL;
+	HBITMAP hbitmap_screen = CreateDIBSection(hdc, &bmi, DIB_RGB_COLORS, &bits, NULL, 0);
+	bool success = false;
+	if (!hbitmap_screen || !bits)
+		goto end;
+
+	if (   !(sdc = CreateCompatibleDC(hdc))   )
 		goto end;
 
 	if (   !(sdc_orig_select = SelectObject(sdc, hbitmap_screen))   )
 		goto end;
 
-	// Copy the pixels in the search-area of the screen into the DC to be searched:
+	// Copy the pixels in the search-area of the screen into the DIB section to be searched:
 	if (   !(BitBlt(sdc, 0, 0, search_width, search_height, hdc, aLeft, aTop, SRCCOPY))   )
 		goto end;
+	GdiFlush(); // Let the copy finish before the bits are read directly.
 
-	LONG screen_width, screen_height;
-	bool screen_is_16bit;
-	if (   !(screen_pixel = getbits(hbitmap_screen, sdc, screen_width, screen_height, screen_is_16bit))   )
-		goto end;
+	aImage.pixels = (const PIXEL32 *)bits;
+	aImage.width = search_width;
+	aImage.height = search_height;
+	aImage.stride = bmi.bmiHeader.biWidth;
+	success = true;
+
+end:
+	if (sdc)
+	{
+		if (sdc_orig_select) // i.e. the original call to SelectObject() didn't fail.
+			SelectObject(sdc, sdc_orig_select); // Probably necessary to prevent memory leak.
+		DeleteDC(sdc);
+	}
+	if (!success && hbitmap_screen)
+	{
+		DeleteObject(hbitmap_screen);
+		hbitmap_screen = NULL;
+	}
+	return hbitmap_screen;
+}
+
+
+
+struct ScreenFrame
+// A capture of part of the screen, which any number of searches can then be run against.  Returned to
+// callers as an opaque handle by ImageCaptureFrame().
+{
+	LPCOLORREF pixel; // The array image.pixels points into, or NULL if the pixels belong to the caller.
+	HBITMAP dib;      // The DIB section image.pixels points into (see CaptureScreen()), or NULL.
+	SearchImage image;
+	int left, top; // Screen coordinates of the image's upper-left pixel.
+	bool is_16bit;
+	// Built by FramePyramid() and FramePlane() the first time each is needed, unless the pixels are the
+	// caller's own: full and 16-bit color mask, and 4 channels for each color mask.
+	SearchPyramid *volatile pyramid[2];
+	SearchPlane *volatile plane[8];
+	FrameRing *ring; // If the pixels are a frame pinned in a frame ring, that ring and the frame's slot in it.
+	int ring_slot;
+};
+
+
+
+ScreenFrame *FrameCapture(int aLeft, int aTop, int aRight, int aBottom)
+// Returns NULL on failure.  Caller must FrameFree() the result.
+{
+	ScreenFrame *frame = (ScreenFrame *)malloc(sizeof(ScreenFrame));
+	if (!frame)
+		return NULL;
+	HDC hdc = GetDC(NULL);
+	if (!hdc)
+	{
+		free(frame);
+		return NULL;
+	}
+	frame->dib = CaptureScreen(hdc, aLeft, aTop, aRight, aBottom, frame->image, frame->is_16bit);
+	ReleaseDC(NULL, hdc);
+	if (!frame->dib)
+	{
+		free(frame);
+		return NULL;
+	}
+	frame->pixel = NULL;
+	frame->left = aLeft;
+	frame->top = aTop;
+	frame->pyramid[0] = frame->pyramid[1] = NULL;
+	memset((void *)frame->plane, 0, sizeof(frame->plane));
+	frame->ring = NULL;
+	return frame;
+}
 
-	LONG image_pixel_count = image_width * image_height;
-	LONG screen_pixel_count = screen_width * screen_height;
-	int i, j, k, x, y; // Declaring as "register" makes no performance difference with current compiler, so let the compiler choose which should be registers.
 
-	// If either is 16-bit, convert *both* to the 16-bit-compatible 32-bit format:
-	if (image_is_16bit || screen_is_16bit)
+
+bool FrameFromBuffer(ScreenFrame &aFrame, const void *aPixels, int aWidth, int aHeight, int aStride, int aBitsPerPixel)
+// Sets up aFrame to search pixels the caller already has in memory, such as the bits of a DIB section.
+// aStride is the distance in bytes from the start of one row to the next.  It is negative for a bottom-up
+// image, in which case aPixels must point to the top row.  32-bit pixels must be 0x00RRGGBB (the layout
+// of a 32bpp DIB): these are searched in place, so nothing is copied or allocated, and they must not be
+// freed until the caller is done with aFrame.  24-bit (BGR) and 16-bit (5-5-5) pixels are converted into
+// an array that aFrame owns.  Either way, the caller must FrameClear(aFrame) when done.
+// Returns false on failure.
+{
+	aFrame.pixel = NULL;
+	aFrame.dib = NULL;
+	aFrame.pyramid[0] = aFrame.pyramid[1] = NULL;
+	memset((void *)aFrame.plane, 0, sizeof(aFrame.plane));
+	aFrame.ring = NULL;
+	aFrame.left = aFrame.top = 0;
+	aFrame.is_16bit = (aBitsPerPixel == 16);
+	if (!aPixels || aWidth < 1 || aHeight < 1)
+		return false;
+	if (aBitsPerPixel == 32)
+	{
+		if (aStride % 4 || (aStride < 0 ? -aStride : aStride) < aWidth * 4)
+			return false;
+		SearchImage image = {(const PIXEL32 *)aPixels, aWidth, aHeight, aStride / 4};
+		aFrame.image = image;
+		return true;
+	}
+	if (aBitsPerPixel != 24 && aBitsPerPixel != 16)
+		return false;
+	if (   !(aFrame.pixel = (LPCOLORREF)malloc(aWidth * aHeight * sizeof(COLORREF)))   )
+		return false;
+	const BYTE *row = (const BYTE *)aPixels;
+	LPCOLORREF pixel = aFrame.pixel;
+	for (int y = 0; y < aHeight; ++y, row += aStride)
 	{
-		if (trans_color != CLR_NONE)
-			trans_color &= 0x00F8F8F8; // Convert indicated trans-color to be compatible with the conversion below.
-		for (i = 0; i < screen_pixel_count; ++i)
-			screen_pixel[i] &= 0x00F8F8F8; // Highest order byte must be masked to zero for consistency with use of 0x00FFFFFF below.
-		for (i = 0; i < image_pixel_count; ++i)
-			image_pixel[i] &= 0x00F8F8F8;  // Same.
+		if (aBitsPerPixel == 24)
+			for (const BYTE *cp = row, *row_end = row + 3 * aWidth; cp < row_end; cp += 3)
+				*pixel++ = cp[0] | (cp[1] << 8) | (cp[2] << 16);
+		else
+			// Same expansion as GetDIBits(), which leaves the low 3 bits of each component zero:
+			for (const WORD *wp = (const WORD *)row, *row_end = wp + aWidth; wp < row_end; ++wp)
+				*pixel++ = ((*wp & 0x1F) << 3) | ((*wp & 0x3E0) << 6) | ((*wp & 0x7C00) << 9);
 	}
+	SearchImage image = {(PIXEL32 *)aFrame.pixel, aWidth, aHeight, aWidth};
+	aFrame.image = image;
+	return true;
+}
+
 
-	// v1.0.44.03: The below is now done even for variation>0 mode so its results are consistent with those of
-	// non-variation mode.  This is relied upon by variation=0 mode but now also by the following line in the
-	// variation>0 section:
-	//     || image_pixel[j] == trans_color
-	// Without this change, there are cases where variation=0 would find a match but a higher variation
-	// (for the same search) wouldn't. 
-	for (i = 0; i < image_pixel_count; ++i)
-		image_pixel[i] &= 0x00FFFFFF;
-
-	// Search the specified region for the first occurrence of the image:
-	if (aVariation < 1) // Caller wants an exact match.
+
+ScreenFrame *FrameFromBitmap(HBITMAP aBitmap)
+// Same as FrameCapture() but takes the pixels from a bitmap the caller already has, rather than from the
+// screen.  The bitmap must not be selected into any device context.  Returns NULL on failure.
+// If it is a 32bpp DIB section, its bits are searched in place (see FrameFromBuffer()), so the bitmap
+// must not be deleted until the caller is done with the frame.  Otherwise they are copied by getbits().
+{
+	ScreenFrame *frame = (ScreenFrame *)malloc(sizeof(ScreenFrame));
+	if (!frame)
+		return NULL;
+	DIBSECTION ds;
+	if (GetObject(aBitmap, sizeof(DIBSECTION), &ds) == sizeof(DIBSECTION) && ds.dsBm.bmBits
+		&& ds.dsBm.bmBitsPixel == 32 && ds.dsBmih.biCompression == BI_RGB)
 	{
-		// Concerning the following use of 0x00FFFFFF, the use of 0x00F8F8F8 above is related (both have high order byte 00).
-		// The following needs to be done only when shades-of-variation mode isn't in effect because
-		// shades-of-variation mode ignores the high-order byte due to its use of macros such as GetRValue().
-		// This transformation incurs about a 15% performance decrease (percentage is fairly constant since
-		// it is proportional to the search-region size, which tends to be much larger than the search-image and
-		// is therefore the primary determination of how long the loops take). But it definitely helps find images
-		// more successfully in some cases.  For example, if a PNG file is displayed in a GUI window, this
-		// transformation allows certain bitmap search-images to be found via variation==0 when they otherwise
-		// would require variation==1 (possibly the variation==1 success is just a side-effect of it
-		// ignoring the high-order byte -- maybe a much higher variation would be needed if the high
-		// order byte were also subject to the same shades-of-variation analysis as the other three bytes [RGB]).
-		for (i = 0; i < screen_pixel_count; ++i)
-			screen_pixel[i] &= 0x00FFFFFF;
-
-		for (i = 0; i < screen_pixel_count; ++i)
+		GdiFlush(); // Let any pending GDI drawing into the bitmap finish before reading its bits directly.
+		int stride = ds.dsBm.bmWidthBytes;
+		const BYTE *top_row = (const BYTE *)ds.dsBm.bmBits;
+		if (ds.dsBmih.biHeight > 0) // Bottom-up, so the first row in memory is the bottom one.
 		{
-			// Unlike the variation-loop, the following one uses a first-pixel optimization to boost performance
-			// by about 10% because it's only 3 extra comparisons and exact-match mode is probably used more often.
-			// Before even checking whether the other adjacent pixels in the region match the image, ensure
-			// the image does not extend past the right or bottom edges of the current part of the search region.
-			// This is done for performance but more importantly to prevent partial matches at the edges of the
-			// search region from being considered complete matches.
-			// The following check is ordered for short-circuit performance.  In addition, image_mask, if
-			// non-NULL, is used to determine which pixels are transparent within the image and thus should
-			// match any color on the screen.
-			if ((screen_pixel[i] == image_pixel[0] // A screen pixel has been found that matches the image's first pixel.
-				|| image_mask && image_mask[0]     // Or: It's an icon's transparent pixel, which matches any color.
-				|| image_pixel[0] == trans_color)  // This should be okay even if trans_color==CLR_NONE, since CLR_NONE should never occur naturally in the image.
-				&& image_height <= screen_height - i/screen_width // Image is short enough to fit in the remaining rows of the search region.
-				&& image_width <= screen_width - i%screen_width)  // Image is narrow enough not to exceed the right-side boundary of the search region.
-			{
-				// Check if this candidate region -- which is a subset of the search region whose height and width
-				// matches that of the image -- is a pixel-for-pixel match of the image.
-				for (found = true, x = 0, y = 0, j = 0, k = i; j < image_pixel_count; ++j)
-				{
-					if (!(found = (screen_pixel[k] == image_pixel[j] // At least one pixel doesn't match, so this candidate is discarded.
-						|| image_mask && image_mask[j]      // Or: It's an icon's transparent pixel, which matches any color.
-						|| image_pixel[j] == trans_color))) // This should be okay even if trans_color==CLR_NONE, since CLR none should never occur naturally in the image.
-						break;
-					if (++x < image_width) // We're still within the same row of the image, so just move on to the next screen pixel.
-						++k;
-					else // We're starting a new row of the image.
-					{
-						x = 0; // Return to the leftmost column of the image.
-						++y;   // Move one row downward in the image.
-						// Move to the next row within the current-candiate region (not the entire search region).
-						// This is done by moving vertically downward from "i" (which is the upper-left pixel of the
-						// current-candidate region) by "y" rows.
-						k = i + y*screen_width; // Verified correct.
-					}
-				}
-				if (found) // Complete match found.
-					break;
-			}
+			top_row += (ds.dsBm.bmHeight - 1) * stride;
+			stride = -stride;
 		}
+		if (FrameFromBuffer(*frame, top_row, ds.dsBm.bmWidth, ds.dsBm.bmHeight, stride, 32))
+			return frame;
+		free(frame);
+		return NULL;
+	}
+	HDC hdc = GetDC(NULL);
+	if (!hdc)
+	{
+		free(frame);
+		return NULL;
 	}
-	else // Allow colors to vary by aVariation shades; i.e. approximate match is okay.
+	LONG width, height;
+	frame->pixel = getbits(aBitmap, hdc, width, height, frame->is_16bit);
+	ReleaseDC(NULL, hdc);
+	if (!frame->pixel)
 	{
-		// The following section is part of the first-pixel-check optimization that improves performance by
-		// 15% or more depending on where and whether a match is found.  This section and one the follows
-		// later is commented out to reduce code size.
-		// Set high/low range for the first pixel of the image since it is the pixel most often checked
-		// (i.e. for performance).
-		//BYTE search_red1 = GetBValue(image_pixel[0]);  // Because it's RGB vs. BGR, the B value is fetched, not R (though it doesn't matter as long as everything is internally consistent here).
-		//BYTE search_green1 = GetGValue(image_pixel[0]);
-		//BYTE search_blue1 = GetRValue(image_pixel[0]); // Same comment as above.
-		//BYTE red_low1 = (aVariation > search_red1) ? 0 : search_red1 - aVariation;
-		//BYTE green_low1 = (aVariation > search_green1) ? 0 : search_green1 - aVariation;
-		//BYTE blue_low1 = (aVariation > search_blue1) ? 0 : search_blue1 - aVariation;
-		//BYTE red_high1 = (aVariation > 0xFF - search_red1) ? 0xFF : search_red1 + aVariation;
-		//BYTE green_high1 = (aVariation > 0xFF - search_green1) ? 0xFF : search_green1 + aVariation;
-		//BYTE blue_high1 = (aVariation > 0xFF - search_blue1) ? 0xFF : search_blue1 + aVariation;
-		// Above relies on the fact that the 16-bit conversion higher above was already done because like
-		// in PixelSearch, it seems more appropriate to do the 16-bit conversion prior to setting the range
-		// of high and low colors (vs. than applying 0xF8 to each of the high/low values individually).
-
-		BYTE red, green, blue;
-		BYTE search_red, search_green, search_blue;
-		BYTE red_low, green_low, blue_low, red_high, green_high, blue_high;
-
-		// The following loop is very similar to its counterpart above that finds an exact match, so maintain
-		// them together and see above for more detailed comments about it.
-		for (i = 0; i < screen_pixel_count; ++i)
+		free(frame);
+		return NULL;
+	}
+	SearchImage image = {(PIXEL32 *)frame->pixel, width, height, width};
+	frame->image = image;
+	frame->dib = NULL;
+	frame->left = frame->top = 0; // Coordinates are relative to the bitmap.
+	frame->pyramid[0] = frame->pyramid[1] = NULL;
+	memset((void *)frame->plane, 0, sizeof(frame->plane));
+	frame->ring = NULL;
+	return frame;
+}
+
+
+
+void FrameClear(ScreenFrame &aFrame)
+// Frees everything aFrame owns, but not aFrame itself.
+{
+	free(aFrame.pixel);
+	if (aFrame.dib)
+		DeleteObject(aFrame.dib);
+	PyramidFree(aFrame.pyramid[0]);
+	PyramidFree(aFrame.pyramid[1]);
+	for (int i = 0; i < 8; ++i)
+		if (aFrame.plane[i])
 		{
-			// The following is commented out to trade code size reduction for performance (see comment above).
-			//red = GetBValue(screen_pixel[i]);   // Because it's RGB vs. BGR, the B value is fetched, not R (though it doesn't matter as long as everything is internally consistent here).
-			//green = GetGValue(screen_pixel[i]);
-			//blue = GetRValue(screen_pixel[i]);
-			//if ((red >= red_low1 && red <= red_high1
-			//	&& green >= green_low1 && green <= green_high1
-			//	&& blue >= blue_low1 && blue <= blue_high1 // All three color components are a match, so this screen pixel matches the image's first pixel.
-			//		|| image_mask && image_mask[0]         // Or: It's an icon's transparent pixel, which matches any color.
-			//		|| image_pixel[0] == trans_color)      // This should be okay even if trans_color==CLR_NONE, since CLR none should never occur naturally in the image.
-			//	&& image_height <= screen_height - i/screen_width // Image is short enough to fit in the remaining rows of the search region.
-			//	&& image_width <= screen_width - i%screen_width)  // Image is narrow enough not to exceed the right-side boundary of the search region.
-			
-			// Instead of the above, only this abbreviated check is done:
-			if (image_height <= screen_height - i/screen_width    // Image is short enough to fit in the remaining rows of the search region.
-				&& image_width <= screen_width - i%screen_width)  // Image is narrow enough not to exceed the right-side boundary of the search region.
-			{
-				// Since the first pixel is a match, check the other pixels.
-				for (found = true, x = 0, y = 0, j = 0, k = i; j < image_pixel_count; ++j)
-				{
-   					search_red = GetBValue(image_pixel[j]);
-	   				search_green = GetGValue(image_pixel[j]);
-		   			search_blue = GetRValue(image_pixel[j]);
-					SET_COLOR_RANGE
-   					red = GetBValue(screen_pixel[k]);
-	   				green = GetGValue(screen_pixel[k]);
-		   			blue = GetRValue(screen_pixel[k]);
-
-					if (!(found = red >= red_low && red <= red_high
-						&& green >= green_low && green <= green_high
-                        && blue >= blue_low && blue <= blue_high
-							|| image_mask && image_mask[j]     // Or: It's an icon's transparent pixel, which matches any color.
-							|| image_pixel[j] == trans_color)) // This should be okay even if trans_color==CLR_NONE, since CLR_NONE should never occur naturally in the image.
-						break; // At least one pixel doesn't match, so this candidate is discarded.
-					if (++x < image_width) // We're still within the same row of the image, so just move on to the next screen pixel.
-						++k;
-					else // We're starting a new row of the image.
-					{
-						x = 0; // Return to the leftmost column of the image.
-						++y;   // Move one row downward in the image.
-						k = i + y*screen_width; // Verified correct.
-					}
-				}
-				if (found) // Complete match found.
-					break;
-			}
+			PlaneFree(*aFrame.plane[i]);
+			free(aFrame.plane[i]);
+		}
+	if (aFrame.ring)
+		FrameRingUnpin(*aFrame.ring, aFrame.ring_slot);
+}
+
+
+
+void FrameFree(ScreenFrame *aFrame)
+{
+	if (!aFrame)
+		return;
+	FrameClear(*aFrame);
+	free(aFrame);
+}
+
+
+
+static inline bool FrameKeepsDerived(const ScreenFrame &aFrame)
+// Returns true if aFrame's pixels can't change for as long as it exists, so that what is built from them
+// can be kept for later searches.  That isn't so for pixels searched in place in the caller's memory
+// (see FrameFromBuffer()), which the caller may redraw between searches.
+{
+	return aFrame.pixel || aFrame.dib || aFrame.ring; // A pinned ring frame isn't overwritten.
+}
+
+
+
+SearchPyramid *FramePyramid(ScreenFrame &aFrame, PIXEL32 aColorMask)
+// Returns the pyramid of aFrame's whole image for needles with aColorMask, building it if this is the
+// first search of the frame to need it, or NULL if it can't be built or can't be kept (in which case the
+// caller should search the pixels directly, which gives the same result).  Several threads may search
+// one frame at once: if they build the pyramid at the same time, the first one to finish is kept.
+{
+	if (!FrameKeepsDerived(aFrame))
+		return NULL;
+	SearchPyramid *volatile &slot = aFrame.pyramid[aColorMask == SEARCH_COLOR_MASK_16BIT];
+	SearchPyramid *pyramid = (SearchPyramid *)AtomicCompareExchangePointer((void *volatile *)&slot, NULL, NULL);
+	if (!pyramid && (pyramid = PyramidCreate(aFrame.image, aColorMask)))
+	{
+		SearchPyramid *existing = (SearchPyramid *)AtomicCompareExchangePointer((void *volatile *)&slot, pyramid, NULL);
+		if (existing) // Another thread got there first.
+		{
+			PyramidFree(pyramid);
+			pyramid = existing;
 		}
 	}
+	return pyramid;
+}
 
-	//if (!found) // Must override ErrorLevel to its new value prior to the label below.
-	//	g_ErrorLevel->Assign(ERRORLEVEL_ERROR); // "1" indicates search completed okay, but didn't find it.
 
-end:
-	// If found==false when execution reaches here, ErrorLevel is already set to the right value, so just
-	// clean up then return.
+
+const SearchPlane *FramePlane(ScreenFrame &aFrame, int aChannel, PIXEL32 aColorMask, SearchPlane &aTemp)
+// Same as FramePyramid() but for the frame's plane of one channel (see search_plane.cpp).  Converting
+// the frame costs less than searching its whole pixels once, and every search of the plane after that
+// reads a quarter as much.  If the plane can't be kept, it is built into aTemp for this search alone, and
+// the caller must PlaneFree(aTemp) when done; otherwise aTemp.pixels is left NULL.
+{
+	aTemp.pixels = NULL;
+	if (!FrameKeepsDerived(aFrame))
+		return PlaneCreate(aFrame.image, aChannel, aColorMask, aTemp) ? &aTemp : NULL;
+	SearchPlane *volatile &slot = aFrame.plane[aChannel + 4 * (aColorMask == SEARCH_COLOR_MASK_16BIT)];
+	SearchPlane *plane = (SearchPlane *)AtomicCompareExchangePointer((void *volatile *)&slot, NULL, NULL);
+	if (plane)
+		return plane;
+	// Built in full before it is published, so no thread sees a plane whose fields are still being set.
+	if (   !(plane = (SearchPlane *)malloc(sizeof(SearchPlane)))   )
+		return NULL;
+	if (!PlaneCreate(aFrame.image, aChannel, aColorMask, *plane))
+	{
+		free(plane);
+		return NULL;
+	}
+	SearchPlane *existing = (SearchPlane *)AtomicCompareExchangePointer((void *volatile *)&slot, plane, NULL);
+	if (existing) // Another thread got there first.
+	{
+		PlaneFree(*plane);
+		free(plane);
+		plane = existing;
+	}
+	return plane;
+}
+
+
+
+bool FrameView(ScreenFrame &aFrame, int &aLeft, int &aTop, int aRight, int aBottom, SearchImage &aView)
+// Sets aView to the part of aFrame within the given screen rectangle, and aLeft/aTop to the screen
+// coordinates of its upper-left pixel.  Returns false if the rectangle doesn't overlap the frame.
+{
+	if (aLeft < aFrame.left)
+		aLeft = aFrame.left;
+	if (aTop < aFrame.top)
+		aTop = aFrame.top;
+	if (aRight > aFrame.left + aFrame.image.width - 1)
+		aRight = aFrame.left + aFrame.image.width - 1;
+	if (aBottom > aFrame.top + aFrame.image.height - 1)
+		aBottom = aFrame.top + aFrame.image.height - 1;
+	if (aLeft > aRight || aTop > aBottom)
+		return false;
+	SearchImage view = {aFrame.image.pixels + (aTop - aFrame.top) * aFrame.image.stride + (aLeft - aFrame.left)
+		, aRight - aLeft + 1, aBottom - aTop + 1, aFrame.image.stride};
+	aView = view;
+	return true;
+}
+
+
+
+struct ScreenSearch
+// What ImageSearch() and its variants set up before searching: the part of a frame to search and the
+// needle to look for in it.
+{
+	SearchImage screen;
+	int left, top; // Screen coordinates of screen's upper-left pixel.
+	SearchNeedle *needle;
+	int variation;
+	bool pyramid; // The *Pyramid option was given.
+	SearchRegion *region; // From the *Roi option, or NULL to search every position.
+	int channel;       // From the *Gray or *Channel option, or -1.
+	SearchPlane plane; // If channel isn't -1, the part of the frame's plane for it that screen covers.
+	SearchPlane temp_plane; // The plane itself, if it was built for this search alone (see FramePlane()).
+};
+
+
+
+int ScreenSearchBegin(ScreenSearch &aSearch, ScreenFrame &aFrame, int aLeft, int aTop, int aRight, int aBottom
+	, char *aImageFile)
+// Prepares to search the part of aFrame that lies within the given screen rectangle.  Returns 1 if ready,
+// 0 if the rectangle doesn't overlap the frame (so there is nothing to find, though the image was loaded
+// and its options checked), or -1 on failure.  Caller must call ScreenSearchEnd() either way.
+{
+	aSearch.needle = NULL;
+	aSearch.region = NULL;
+	aSearch.temp_plane.pixels = NULL;
+
+	ImageSpec spec;
+	if (!ParseImageSpec(aImageFile, spec))
+		return -1;
+	if (spec.region && !(aSearch.region = LoadRegion(spec.region)))
+		return -1;
+	aSearch.variation = spec.variation;
+	aSearch.pyramid = spec.pyramid;
+
+	HDC hdc = GetDC(NULL);
+	if (!hdc)
+		return -1;
+	aSearch.needle = LoadNeedle(spec, hdc, aFrame.is_16bit);
 	ReleaseDC(NULL, hdc);
-	DeleteObject(hbitmap_image);
-	if (sdc)
+	if (!aSearch.needle)
+		return -1;
+	if (!FrameView(aFrame, aLeft, aTop, aRight, aBottom, aSearch.screen))
+		return 0;
+	aSearch.left = aLeft;
+	aSearch.top = aTop;
+	if (   (aSearch.channel = spec.channel) >= 0   )
 	{
-		if (sdc_orig_select) // i.e. the original call to SelectObject() didn't fail.
-			SelectObject(sdc, sdc_orig_select); // Probably necessary to prevent memory leak.
-		DeleteDC(sdc);
+		const SearchPlane *plane = FramePlane(aFrame, spec.channel, aSearch.needle->color_mask, aSearch.temp_plane);
+		if (!plane)
+			return -1;
+		aSearch.plane = *plane;
+		aSearch.plane.pixels += (aTop - aFrame.top) * plane->stride + (aLeft - aFrame.left);
+		aSearch.plane.width = aSearch.screen.width;
+		aSearch.plane.height = aSearch.screen.height;
 	}
-	if (hbitmap_screen)
-		DeleteObject(hbitmap_screen);
-	if (image_pixel)
-		free(image_pixel);
-	if (image_mask)
-		free(image_mask);
-	if (screen_pixel)
-		free(screen_pixel);
+	return 1;
+}
+
+
+
+void ScreenSearchEnd(ScreenSearch &aSearch)
+{
+	NeedleRelease(aSearch.needle);
+	RegionRelease(aSearch.region);
+	if (aSearch.temp_plane.pixels)
+		PlaneFree(aSearch.temp_plane);
+}
+
+
+
+static bool ScreenSearchFirst(ScreenSearch &aSearch, int &aX, int &aY)
+// SearchFirst() or SearchFirstRegion(), or their plane versions, as the *Roi, *Gray and *Channel options
+// call for.  The same goes for the two below.
+{
+	if (aSearch.channel >= 0)
+		return aSearch.region
+			? SearchFirstPlaneRegion(aSearch.plane, *aSearch.region, aSearch.left, aSearch.top, *aSearch.needle
+				, aSearch.variation, aX, aY)
+			: SearchFirstPlane(aSearch.plane, *aSearch.needle, aSearch.variation, aX, aY);
+	if (aSearch.region)
+		return SearchFirstRegion(aSearch.screen, *aSearch.region, aSearch.left, aSearch.top, *aSearch.needle
+			, aSearch.variation, aX, aY);
+	return SearchFirst(aSearch.screen, *aSearch.needle, aSearch.variation, aX, aY);
+}
+
+
+
+static int ScreenSearchAll(ScreenSearch &aSearch, int aFlags, SearchMatch *aMatch, int aMaxMatches)
+{
+	if (aSearch.channel >= 0)
+		return aSearch.region
+			? SearchAllPlaneRegion(aSearch.plane, *aSearch.region, aSearch.left, aSearch.top, *aSearch.needle
+				, aSearch.variation, aFlags, aMatch, aMaxMatches)
+			: SearchAllPlane(aSearch.plane, *aSearch.needle, aSearch.variation, aFlags, aMatch, aMaxMatches);
+	if (aSearch.region)
+		return SearchAllRegion(aSearch.screen, *aSearch.region, aSearch.left, aSearch.top, *aSearch.needle
+			, aSearch.variation, aFlags, aMatch, aMaxMatches);
+	return SearchAll(aSearch.screen, *aSearch.needle, aSearch.variation, aFlags, aMatch, aMaxMatches);
+}
+
+
+
+static int ScreenSearchScored(ScreenSearch &aSearch, int aMethod, float aMinScore, SearchScoredMatch *aMatch
+	, int aMaxMatches)
+// Scores are always of one channel: luminance unless a *Channel option says otherwise.
+{
+	if (aSearch.channel > SEARCH_CHANNEL_LUMA)
+		aMethod += SEARCH_SCORE_CHANNEL(aSearch.channel);
+	if (aSearch.region)
+		return SearchScoredRegion(aSearch.screen, *aSearch.region, aSearch.left, aSearch.top, *aSearch.needle
+			, aMethod, aMinScore, aMatch, aMaxMatches);
+	return SearchScored(aSearch.screen, *aSearch.needle, aMethod, aMinScore, aMatch, aMaxMatches);
+}
+
+
+
+ScreenFrame* WINAPI ImageCaptureFrame(int aLeft, int aTop, int aRight, int aBottom)
+// Captures the given region of the screen once so that any number of images can be searched for in it by
+// ImageSearchFrame() and ImageSearchAllFrame(), all of which then see the same frame.
+// Returns a handle the caller must pass to ImageReleaseFrame(), or NULL on failure.
+{
+	return FrameCapture(aLeft, aTop, aRight, aBottom);
+}
+
+
 
-	if (!found) // Let ErrorLevel, which is either "1" or "2" as set earlier, tell the story.
-			return "0";
+void WINAPI ImageReleaseFrame(ScreenFrame *aFrame)
+{
+	FrameFree(aFrame);
+}
 
-	// Otherwise, success.  Calculate xpos and ypos of where the match was found and adjust
-	// coords to make them relative to the position of the target window (rect will contain
-	// zeroes if this doesn't need to be done):
-	//if (output_var_x && !output_var_x->Assign((aLeft + i%screen_width) - rect.left))
-	//	return FAIL;
-	//if (output_var_y && !output_var_y->Assign((aTop + i/screen_width) - rect.top))
-	//	return FAIL;
 
-    int locx,locy;
 
-	//return g_ErrorLevel->Assign(ERRORLEVEL_NONE); // Indicate success.
-	if (found)
+ScreenFrame* WINAPI ImageFrameFromBuffer(const void *aPixels, int aWidth, int aHeight, int aStride, int aBitsPerPixel)
+// Same as ImageCaptureFrame() but the frame is made from pixels the caller already has in memory (see
+// FrameFromBuffer()), such as a DIB section or a shared-memory buffer.  32-bit pixels are searched in place,
+// so they must stay valid until ImageReleaseFrame() is called.  Each search sees them as they are when it
+// runs, so the caller may redraw them between searches (but not during one): nothing built from them,
+// such as the pyramid of *Pyramid or the plane of *Gray, is kept from one search to the next.
+{
+	ScreenFrame *frame = (ScreenFrame *)malloc(sizeof(ScreenFrame));
+	if (frame && !FrameFromBuffer(*frame, aPixels, aWidth, aHeight, aStride, aBitsPerPixel))
 	{
-		locx = (aLeft + i%screen_width) - rect.left;
-		locy = (aTop + i/screen_width) - rect.top;
-//		printf("\nFOUND!!!!%d   %d",locx,locy);
-		sprintf_s(answer,"1|%d|%d|%d|%d",locx,locy,image_width,image_height);
-		return answer;
-		//return "ZZ";
+		free(frame);
+		return NULL;
 	}
-	return "0";
+	return frame;
+}
+
+
+
+ScreenFrame* WINAPI ImageFrameFromBitmap(HBITMAP aBitmap)
+// Same as ImageFrameFromBuffer() but for a bitmap.  32bpp DIB sections are searched in place.
+{
+	return FrameFromBitmap(aBitmap);
+}
+
+
+
+FrameRing* WINAPI ImageFrameRingCreate(char *aName, int aSlotCount, int aMaxWidth, int aMaxHeight)
+// For the one process that captures the screen on behalf of others: creates the named frame ring (see
+// framering.h) with room for aSlotCount frames of up to aMaxWidth x aMaxHeight pixels, which it then fills
+// by calling ImageFrameRingCapture().  Returns a handle the caller must pass to ImageFrameRingClose(), or
+// NULL on failure.
+{
+	return aName ? FrameRingCreate(aName, aSlotCount, aMaxWidth, aMaxHeight) : NULL;
+}
+
 
+
+FrameRing* WINAPI ImageFrameRingOpen(char *aName)
+// For the processes that search what another captures: opens the named frame ring, whose frames can then
+// be searched by ImageFrameFromRing().  Returns a handle the caller must pass to ImageFrameRingClose(), or
+// NULL if the ring doesn't exist.
+{
+	return aName ? FrameRingOpen(aName) : NULL;
+}
+
+
+
+void WINAPI ImageFrameRingClose(FrameRing *aRing)
+// Frames from ImageFrameFromRing() stay valid until they are released, even after this.
+{
+	FrameRingClose(aRing);
 }
 
 
 
+int WINAPI ImageFrameRingCapture(FrameRing *aRing, int aLeft, int aTop, int aRight, int aBottom)
+// Captures the given region of the screen into aRing as its newest frame.  Returns the frame's number,
+// or 0 on failure (including when the region is larger than the ring allows, or every frame in the ring
+// is still being searched).
+{
+	if (!aRing)
+		return 0;
+	HDC hdc = GetDC(NULL);
+	if (!hdc)
+		return 0;
+	SearchImage image;
+	bool is_16bit;
+	HBITMAP dib = CaptureScreen(hdc, aLeft, aTop, aRight, aBottom, image, is_16bit);
+	ReleaseDC(NULL, hdc);
+	if (!dib)
+		return 0;
+	int sequence = FrameRingPublish(*aRing, image, aLeft, aTop, is_16bit);
+	DeleteObject(dib);
+	return sequence;
+}
+
+
+
+int WINAPI ImageFrameRingLatest(FrameRing *aRing)
+// Returns the number of aRing's newest frame, or 0 if nothing has been captured into it yet.  A caller
+// can poll this to find out when there is a new frame to search.
+{
+	return aRing ? FrameRingLatest(*aRing) : 0;
+}
+
+
+
+ScreenFrame* WINAPI ImageFrameFromRing(FrameRing *aRing, int aSequence)
+// Same as ImageCaptureFrame() but the frame is frame number aSequence of aRing (or its newest frame, if
+// aSequence is 0), which is searched in place in the shared memory.  The frame can't be overwritten until
+// ImageReleaseFrame() is called, so callers should release it promptly.  Returns NULL if that frame is no
+// longer in the ring.
+{
+	if (!aRing)
+		return NULL;
+	ScreenFrame *frame = (ScreenFrame *)malloc(sizeof(ScreenFrame));
+	if (!frame)
+		return NULL;
+	if (   (frame->ring_slot = FrameRingPin(*aRing, aSequence, frame->image, frame->left, frame->top
+		, frame->is_16bit)) < 0   )
+	{
+		free(frame);
+		return NULL;
+	}
+	frame->pixel = NULL;
+	frame->dib = NULL;
+	frame->pyramid[0] = frame->pyramid[1] = NULL;
+	memset((void *)frame->plane, 0, sizeof(frame->plane));
+	frame->ring = aRing;
+	return frame;
+}
+
+
+
+char *MatchAnswer(int aFound, const ImageMatch &aMatch)
+// Formats the result of one of the entry points that store an ImageMatch the way ImageSearch() returns
+// it.  The string is built in the one global buffer, so unlike those entry points, the ones that return
+// strings (kept for existing scripts) must not be called by more than one thread at a time.
+{
+	if (aFound < 1)
+		return "0";
+	sprintf_s(answer, "1|%d|%d|%d|%d", aMatch.x, aMatch.y, aMatch.width, aMatch.height);
+	return answer;
+}
+
+
+
+static void SetMatch(ImageMatch *aMatch, int aX, int aY, const SearchNeedle &aNeedle)
+{
+	aMatch->x = aX;
+	aMatch->y = aY;
+	aMatch->width = aNeedle.width;
+	aMatch->height = aNeedle.height;
+	aMatch->score = 1000;
+	aMatch->image = 1;
+}
+
+
+
+int WINAPI ImageSearchFrameResult(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom
+	, char *aImageFile, ImageMatch *aMatch)
+// Same as ImageSearchResult() but searches the part of a previously captured frame within the given screen
+// rectangle.  The rectangle is clipped to the frame, and if none of it is in the frame the result is 0
+// (not found), the same as for any other place the image isn't.  With the *Pyramid option, the search is
+// done by SearchFirstPyramid() on a pyramid the frame keeps, which is worth building when several searches
+// will be run on the same frame (or when the tolerance is high); the result is the same either way.  The
+// *Roi option (see LoadRegion()) takes precedence over *Pyramid, as do *Gray and *Channel.
+{
+	if (!aFrame || !aMatch)
+		return -1;
+	ScreenSearch search;
+	SearchPyramid *pyramid;
+	int x, y, found = ScreenSearchBegin(search, *aFrame, aLeft, aTop, aRight, aBottom, aImageFile);
+	if (found > 0)
+	{
+		if (search.pyramid && !search.region && search.channel < 0
+			&& (pyramid = FramePyramid(*aFrame, search.needle->color_mask)))
+			found = SearchFirstPyramid(*pyramid, search.left - aFrame->left, search.top - aFrame->top
+				, search.screen.width, search.screen.height, *search.needle, search.variation, x, y);
+		else
+			found = ScreenSearchFirst(search, x, y);
+		if (found)
+			SetMatch(aMatch, search.left + x, search.top + y, *search.needle);
+	}
+	ScreenSearchEnd(search);
+	return found;
+}
+
+
+
+char* WINAPI ImageSearchFrame(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom, char *aImageFile)
+// Same as ImageSearchFrameResult() but returns the same as ImageSearch().
+{
+	ImageMatch match;
+	return MatchAnswer(ImageSearchFrameResult(aFrame, aLeft, aTop, aRight, aBottom, aImageFile, &match), match);
+}
+
+
+
+int FrameSearchFirst(ScreenFrame &aFrame, int aLeft, int aTop, int aRight, int aBottom, SearchNeedle &aNeedle
+	, int aVariation, ImageMatch *aMatch)
+// Searches the part of aFrame within the given rectangle for a needle the caller already has.
+// Returns the same as ImageSearchResult().
+{
+	SearchImage screen;
+	int x, y;
+	if (!FrameView(aFrame, aLeft, aTop, aRight, aBottom, screen))
+		return 0;
+	if (!SearchFirst(screen, aNeedle, aVariation, x, y))
+		return 0;
+	SetMatch(aMatch, aLeft + x, aTop + y, aNeedle);
+	return 1;
+}
+
+
+
+int WINAPI ImageSearchAllFrame(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom, char *aImageFile
+	, int *aPoints, int aMaxResults, int aFlags)
+// Same as ImageSearchAll() but searches a previously captured frame, like ImageSearchFrame().
+{
+	if (!aFrame || !aPoints || aMaxResults < 1)
+		return -1;
+	SearchMatch *match = NULL;
+	ScreenSearch search;
+	int match_count = ScreenSearchBegin(search, *aFrame, aLeft, aTop, aRight, aBottom, aImageFile);
+	if (match_count > 0 && (match = (SearchMatch *)malloc(aMaxResults * sizeof(SearchMatch))))
+	{
+		match_count = ScreenSearchAll(search, aFlags, match, aMaxResults);
+		for (int i = 0; i < match_count; ++i)
+		{
+			aPoints[2*i] = search.left + match[i].x;
+			aPoints[2*i + 1] = search.top + match[i].y;
+		}
+		free(match);
+	}
+	else if (match_count > 0)
+		match_count = -1; // Out of memory.
+	ScreenSearchEnd(search);
+	return match_count;
+}
+
+
+
+int CountImages(char *aImageFiles)
+// Returns the number of images in a '|'-delimited list.
+{
+	int image_count = 1;
+	for (char *cp = aImageFiles; *cp; ++cp)
+		if (*cp == '|')
+			++image_count;
+	return image_count;
+}
+
+
+
+int LoadNeedles(char *aImageFiles, bool aScreenIs16Bit, SearchBatchItem *aItem, int *aItemImage)
+// Loads each image in the '|'-delimited list aImageFiles into aItem, leaving out any that fail, and stores
+// the index in the list of each item's image into aItemImage.  Both must have room for CountImages() entries.
+// Returns the number of items loaded, or -1 on failure.  Caller must NeedleRelease() each item's needle.
+{
+	int item_count = 0, i;
+	HDC hdc = NULL;
+	char *cp, *file_list = (char *)malloc(strlen(aImageFiles) + 1);
+	if (!file_list || !(hdc = GetDC(NULL)))
+	{
+		free(file_list);
+		return -1;
+	}
+	strcpy(file_list, aImageFiles);
+	for (cp = file_list, i = 0; cp; ++i)
+	{
+		char *image_file = cp;
+		if (cp = strchr(cp, '|'))
+			*cp++ = '\0';
+		ImageSpec spec;
+		if (!ParseImageSpec(image_file, spec))
+			continue;
+		if (aItem[item_count].needle = LoadNeedle(spec, hdc, aScreenIs16Bit))
+		{
+			aItem[item_count].variation = spec.variation;
+			aItemImage[item_count++] = i;
+		}
+	}
+	ReleaseDC(NULL, hdc);
+	free(file_list);
+	return item_count;
+}
+
+
+
+int WINAPI ImageSearchBatchFrame(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom
+	, char *aImageFiles, int *aResults)
+// Searches the part of the frame within the given screen rectangle for several images at once, which is
+// much faster than searching for each in turn because the frame is scanned only once (see SearchBatch()).
+// aImageFiles is a '|'-delimited list of images, each with its own options as in ImageSearch() except *Roi,
+// *Gray and *Channel, which are ignored.
+// For each image, five ints are stored into aResults: 1 if found (otherwise 0, including when the image
+// couldn't be loaded), then the screen x, y, width and height of the first match.
+// Returns the number of images found, or -1 on error.
+{
+	if (!aFrame || !aImageFiles || !aResults)
+		return -1;
+	int image_count = CountImages(aImageFiles), i, found_count = -1;
+	memset(aResults, 0, image_count * 5 * sizeof(int));
+
+	SearchImage screen;
+	if (!FrameView(*aFrame, aLeft, aTop, aRight, aBottom, screen))
+		return 0;
+
+	SearchBatchItem *item = (SearchBatchItem *)malloc(image_count * sizeof(SearchBatchItem));
+	int *item_image = (int *)malloc(image_count * sizeof(int)); // Index of each item's image in aImageFiles.
+	int item_count = 0;
+	if (!item || !item_image
+		|| (item_count = LoadNeedles(aImageFiles, aFrame->is_16bit, item, item_image)) < 0)
+	{
+		item_count = 0;
+		goto end;
+	}
+
+	if ((found_count = SearchBatch(screen, item, item_count)) > 0)
+		for (i = 0; i < item_count; ++i)
+		{
+			if (!item[i].found)
+				continue;
+			int *result = aResults + 5 * item_image[i];
+			result[0] = 1;
+			result[1] = aLeft + item[i].x;
+			result[2] = aTop + item[i].y;
+			result[3] = item[i].needle->width;
+			result[4] = item[i].needle->height;
+		}
+
+end:
+	for (i = 0; i < item_count; ++i)
+		NeedleRelease((SearchNeedle *)item[i].needle);
+	free(item);
+	free(item_image);
+	return found_count;
+}
+
+
+
+int WINAPI ImageSearchBatch(int aLeft, int aTop, int aRight, int aBottom, char *aImageFiles, int *aResults)
+// Same as ImageSearchBatchFrame() but captures the region first.
+{
+	ScreenFrame *frame = FrameCapture(aLeft, aTop, aRight, aBottom);
+	int found_count = ImageSearchBatchFrame(frame, aLeft, aTop, aRight, aBottom, aImageFiles, aResults);
+	FrameFree(frame);
+	return found_count;
+}
+
+
+
+int WINAPI ImageSearchScoredFrame(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom, char *aImageFile
+	, int aMethod, int aMinScore, int *aResults, int aMaxResults)
+// Finds where the image best resembles the part of the frame within the given screen rectangle, for images
+// that an exact or *n match can't find because the screen's lighting, contrast or blending differs.
+// aMethod is 0 for normalized cross-correlation or 1 for sum of squared differences (see SearchScored()).
+// Every position that scores at least aMinScore (in thousandths: 1000 is a perfect match) and is the best
+// within two pixels is a match.  For each of up to aMaxResults matches, best first, three ints are stored
+// into aResults: the screen x and y, and the score in thousandths.  Any *n option is ignored.
+// Returns the number of matches stored, or -1 on error.
+{
+	if (!aFrame || !aResults || aMaxResults < 1)
+		return -1;
+	SearchScoredMatch *match = NULL;
+	ScreenSearch search;
+	int match_count = ScreenSearchBegin(search, *aFrame, aLeft, aTop, aRight, aBottom, aImageFile);
+	if (match_count > 0 && (match = (SearchScoredMatch *)malloc(aMaxResults * sizeof(SearchScoredMatch))))
+	{
+		match_count = ScreenSearchScored(search, aMethod, aMinScore / 1000.0f, match, aMaxResults);
+		for (int i = 0; i < match_count; ++i)
+		{
+			aResults[3*i] = search.left + match[i].x;
+			aResults[3*i + 1] = search.top + match[i].y;
+			aResults[3*i + 2] = (int)(match[i].score * 1000 + (match[i].score < 0 ? -0.5f : 0.5f));
+		}
+		free(match);
+	}
+	else if (match_count > 0)
+		match_count = -1; // Out of memory.
+	ScreenSearchEnd(search);
+	return match_count;
+}
+
+
+
+int WINAPI ImageSearchScored(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, int aMethod, int aMinScore
+	, int *aResults, int aMaxResults)
+// Same as ImageSearchScoredFrame() but captures the region first.
+{
+	ScreenFrame *frame = FrameCapture(aLeft, aTop, aRight, aBottom);
+	int match_count = ImageSearchScoredFrame(frame, aLeft, aTop, aRight, aBottom, aImageFile, aMethod, aMinScore
+		, aResults, aMaxResults);
+	FrameFree(frame);
+	return match_count;
+}
+
+
+
+int WINAPI ImageSearchAllFrameResults(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom
+	, char *aImageFile, int aFlags, ImageResults *aResults)
+// Same as ImageSearchAllFrame() but stores up to aResults->capacity matches into aResults.
+// Returns the number stored (also put into aResults->count), or -1 on error.
+{
+	if (!aFrame || !aResults || aResults->capacity < 1)
+		return -1;
+	aResults->count = 0;
+	SearchMatch *match = NULL;
+	ScreenSearch search;
+	int match_count = ScreenSearchBegin(search, *aFrame, aLeft, aTop, aRight, aBottom, aImageFile);
+	if (match_count > 0 && (match = (SearchMatch *)malloc(aResults->capacity * sizeof(SearchMatch))))
+	{
+		match_count = ScreenSearchAll(search, aFlags, match, aResults->capacity);
+		for (int i = 0; i < match_count; ++i)
+			SetMatch(&aResults->match[i], search.left + match[i].x, search.top + match[i].y, *search.needle);
+		if (match_count > 0)
+			aResults->count = match_count;
+		free(match);
+	}
+	else if (match_count > 0)
+		match_count = -1; // Out of memory.
+	ScreenSearchEnd(search);
+	return match_count;
+}
+
+
+
+int WINAPI ImageSearchAllResults(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, int aFlags
+	, ImageResults *aResults)
+// Same as ImageSearchAllFrameResults() but captures the region first.
+{
+	ScreenFrame *frame = FrameCapture(aLeft, aTop, aRight, aBottom);
+	int match_count = ImageSearchAllFrameResults(frame, aLeft, aTop, aRight, aBottom, aImageFile, aFlags, aResults);
+	FrameFree(frame);
+	return match_count;
+}
+
+
+
+int WINAPI ImageSearchBatchFrameResults(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom
+	, char *aImageFiles, ImageResults *aResults)
+// Same as ImageSearchBatchFrame() but stores one match into aResults for each image that was found, in the
+// order of the list, with its image member set to the image's (1-based) position in the list.  Images
+// beyond aResults->capacity are left out.  Returns the number stored, or -1 on error.
+{
+	if (!aFrame || !aImageFiles || !aResults || aResults->capacity < 1)
+		return -1;
+	aResults->count = 0;
+	int image_count = CountImages(aImageFiles);
+	int *result = (int *)malloc(image_count * 5 * sizeof(int));
+	if (!result)
+		return -1;
+	int found_count = ImageSearchBatchFrame(aFrame, aLeft, aTop, aRight, aBottom, aImageFiles, result);
+	if (found_count > 0)
+	{
+		found_count = 0;
+		for (int i = 0; i < image_count && found_count < aResults->capacity; ++i)
+		{
+			int *r = result + 5 * i;
+			if (!r[0])
+				continue;
+			ImageMatch &match = aResults->match[found_count++];
+			match.x = r[1];
+			match.y = r[2];
+			match.width = r[3];
+			match.height = r[4];
+			match.score = 1000;
+			match.image = i + 1;
+		}
+		aResults->count = found_count;
+	}
+	free(result);
+	return found_count;
+}
+
+
+
+int WINAPI ImageSearchBatchResults(int aLeft, int aTop, int aRight, int aBottom, char *aImageFiles
+	, ImageResults *aResults)
+// Same as ImageSearchBatchFrameResults() but captures the region first.
+{
+	ScreenFrame *frame = FrameCapture(aLeft, aTop, aRight, aBottom);
+	int found_count = ImageSearchBatchFrameResults(frame, aLeft, aTop, aRight, aBottom, aImageFiles, aResults);
+	FrameFree(frame);
+	return found_count;
+}
+
+
+
+int WINAPI ImageSearchScoredFrameResults(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom
+	, char *aImageFile, int aMethod, int aMinScore, ImageResults *aResults)
+// Same as ImageSearchScoredFrame() but stores up to aResults->capacity matches into aResults, best first,
+// each with its score.  Returns the number stored, or -1 on error.
+{
+	if (!aFrame || !aResults || aResults->capacity < 1)
+		return -1;
+	aResults->count = 0;
+	SearchScoredMatch *match = NULL;
+	ScreenSearch search;
+	int match_count = ScreenSearchBegin(search, *aFrame, aLeft, aTop, aRight, aBottom, aImageFile);
+	if (match_count > 0 && (match = (SearchScoredMatch *)malloc(aResults->capacity * sizeof(SearchScoredMatch))))
+	{
+		match_count = ScreenSearchScored(search, aMethod, aMinScore / 1000.0f, match, aResults->capacity);
+		for (int i = 0; i < match_count; ++i)
+		{
+			SetMatch(&aResults->match[i], search.left + match[i].x, search.top + match[i].y, *search.needle);
+			aResults->match[i].score = (int)(match[i].score * 1000 + (match[i].score < 0 ? -0.5f : 0.5f));
+		}
+		if (match_count > 0)
+			aResults->count = match_count;
+		free(match);
+	}
+	else if (match_count > 0)
+		match_count = -1; // Out of memory.
+	ScreenSearchEnd(search);
+	return match_count;
+}
+
+
+
+int WINAPI ImageSearchScoredResults(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, int aMethod
+	, int aMinScore, ImageResults *aResults)
+// Same as ImageSearchScoredFrameResults() but captures the region first.
+{
+	ScreenFrame *frame = FrameCapture(aLeft, aTop, aRight, aBottom);
+	int match_count = ImageSearchScoredFrameResults(frame, aLeft, aTop, aRight, aBottom, aImageFile, aMethod
+		, aMinScore, aResults);
+	FrameFree(frame);
+	return match_count;
+}
+
+
+
+struct ImageWatch
+// What ImageWatchCreate() returns: an image to search for repeatedly, and what is known from the last search.
+{
+	SearchWatch *watch;
+	char *image_file; // A copy of the caller's string, in the same block as this struct.
+};
+
+
+
+ImageWatch* WINAPI ImageWatchCreate(char *aImageFile)
+// Sets up repeated searching for one image, such as while waiting for it to appear, by
+// ImageWatchSearch() or ImageWatchSearchFrame().  Each of those searches only the parts of the region
+// that have changed since the previous search with the same watch, and returns the previous result at
+// once if nothing has.  aImageFile is the same as for ImageSearch().
+// Returns a handle the caller must pass to ImageWatchFree(), or NULL on failure.
+{
+	if (!aImageFile)
+		return NULL;
+	ImageWatch *watch = (ImageWatch *)malloc(sizeof(ImageWatch) + strlen(aImageFile) + 1);
+	if (!watch)
+		return NULL;
+	if (   !(watch->watch = WatchCreate())   )
+	{
+		free(watch);
+		return NULL;
+	}
+	watch->image_file = (char *)(watch + 1);
+	strcpy(watch->image_file, aImageFile);
+	return watch;
+}
+
+
+
+void WINAPI ImageWatchFree(ImageWatch *aWatch)
+{
+	if (!aWatch)
+		return;
+	WatchFree(aWatch->watch);
+	free(aWatch);
+}
+
+
+
+int WINAPI ImageWatchSearchFrameResult(ImageWatch *aWatch, ScreenFrame *aFrame, int aLeft, int aTop, int aRight
+	, int aBottom, ImageMatch *aMatch)
+// Same as ImageSearchFrameResult() for the watch's image, but only searches where the part of the frame
+// within the rectangle differs from what the previous search with aWatch saw.  The rectangle should stay
+// the same size from one search to the next: if it doesn't, the whole of it is searched, as it also is
+// each time if the image has the *Roi option.  A watch must not be used by more than one thread at a time.
+{
+	if (!aWatch || !aFrame || !aMatch)
+		return -1;
+	ScreenSearch search;
+	int x, y, found = ScreenSearchBegin(search, *aFrame, aLeft, aTop, aRight, aBottom, aWatch->image_file);
+	if (found > 0)
+	{
+		// Not incremental: the watch only keeps track of whole-haystack results, compared by whole pixels.
+		if (search.region || search.channel >= 0)
+			found = ScreenSearchFirst(search, x, y);
+		else
+			found = WatchSearchFirst(*aWatch->watch, search.screen, *search.needle, search.variation, x, y);
+		if (found)
+			SetMatch(aMatch, search.left + x, search.top + y, *search.needle);
+	}
+	ScreenSearchEnd(search);
+	return found;
+}
+
+
+
+int WINAPI ImageWatchSearchResult(ImageWatch *aWatch, int aLeft, int aTop, int aRight, int aBottom
+	, ImageMatch *aMatch)
+// Same as ImageWatchSearchFrameResult() but captures the region first.
+{
+	ScreenFrame *frame = FrameCapture(aLeft, aTop, aRight, aBottom);
+	int found = ImageWatchSearchFrameResult(aWatch, frame, aLeft, aTop, aRight, aBottom, aMatch);
+	FrameFree(frame);
+	return found;
+}
+
+
+
+char* WINAPI ImageWatchSearchFrame(ImageWatch *aWatch, ScreenFrame *aFrame, int aLeft, int aTop, int aRight
+	, int aBottom)
+// Same as ImageWatchSearchFrameResult() but returns the same as ImageSearch().
+{
+	ImageMatch match;
+	return MatchAnswer(ImageWatchSearchFrameResult(aWatch, aFrame, aLeft, aTop, aRight, aBottom, &match), match);
+}
+
+
+
+char* WINAPI ImageWatchSearch(ImageWatch *aWatch, int aLeft, int aTop, int aRight, int aBottom)
+// Same as ImageWatchSearchResult() but returns the same as ImageSearch().
+{
+	ImageMatch match;
+	return MatchAnswer(ImageWatchSearchResult(aWatch, aLeft, aTop, aRight, aBottom, &match), match);
+}
+
+
+
+int WaitForAny(int aLeft, int aTop, int aRight, int aBottom, char *aImageFiles, int aTimeout, int aInterval
+	, int *aResult, volatile int *aCancel)
+// Does the work of ImageWaitForAny().  If aCancel isn't NULL, the wait is given up (as if it had timed out)
+// within 50 ms of *aCancel becoming non-zero, or as soon as the capture and search under way then ends.
+{
+	if (!aImageFiles || !aResult)
+		return -1;
+	int image_count = CountImages(aImageFiles), item_count = -1, i, found = -1;
+	SearchBatchItem *item = (SearchBatchItem *)malloc(image_count * sizeof(SearchBatchItem));
+	int *item_image = (int *)malloc(image_count * sizeof(int)); // Index of each item's image in aImageFiles.
+	SearchWatch *watch = WatchCreate();
+	ScreenFrame *frame = NULL;
+	DWORD start_time = GetTickCount();
+	if (!item || !item_image || !watch)
+		goto end;
+
+	for (;;)
+	{
+		if (aCancel && *aCancel)
+		{
+			found = 0;
+			goto end;
+		}
+		DWORD capture_time = GetTickCount();
+		SearchImage screen;
+		int left = aLeft, top = aTop;
+		if (   !(frame = FrameCapture(aLeft, aTop, aRight, aBottom))   )
+			goto end;
+		if (item_count < 0 // Load the images now that the screen's color depth is known.
+			&& (item_count = LoadNeedles(aImageFiles, frame->is_16bit, item, item_image)) < 1)
+			goto end;
+		if (!FrameView(*frame, left, top, aRight, aBottom, screen))
+			goto end;
+		if (WatchSearchBatch(*watch, screen, item, item_count) > 0)
+		{
+			for (i = 0; !item[i].found; ++i); // Items are in the same order as the list.
+			aResult[0] = left + item[i].x;
+			aResult[1] = top + item[i].y;
+			aResult[2] = item[i].needle->width;
+			aResult[3] = item[i].needle->height;
+			found = item_image[i] + 1;
+			goto end;
+		}
+		FrameFree(frame);
+		frame = NULL;
+
+		DWORD now = GetTickCount();
+		if (aTimeout >= 0 && now - start_time >= (DWORD)aTimeout)
+		{
+			found = 0;
+			goto end;
+		}
+		DWORD wait = aInterval > 0 && now - capture_time < (DWORD)aInterval ? aInterval - (now - capture_time) : 0;
+		if (aTimeout >= 0 && wait > aTimeout - (now - start_time))
+			wait = aTimeout - (now - start_time);
+		while (wait && !(aCancel && *aCancel)) // In slices, so that a cancel doesn't wait out a long interval.
+		{
+			DWORD slice = wait < 50 ? wait : 50;
+			Sleep(slice);
+			wait -= slice;
+		}
+	}
+
+end:
+	FrameFree(frame);
+	WatchFree(watch);
+	for (i = 0; i < item_count; ++i)
+		NeedleRelease((SearchNeedle *)item[i].needle);
+	free(item);
+	free(item_image);
+	return found;
+}
+
+
+
+int WINAPI ImageWaitForAny(int aLeft, int aTop, int aRight, int aBottom, char *aImageFiles, int aTimeout
+	, int aInterval, int *aResult)
+// Captures the given region over and over until any of the images appears in it, or until aTimeout
+// milliseconds have passed (a negative aTimeout waits for as long as it takes).  Captures are started at
+// most every aInterval milliseconds, to leave the CPU to other work while waiting.  Each capture after the
+// first is only searched where it differs from the one before (see WatchSearchBatch()), so an unchanging
+// screen costs little more than the capture itself.
+// aImageFiles is a '|'-delimited list of images as for ImageSearchBatch().  When more than one is found in
+// the same capture, the first in the list wins.  Its screen x, y, width and height are stored into aResult.
+// Returns the (1-based) index of the image found, 0 on timeout, or -1 on error.
+{
+	return WaitForAny(aLeft, aTop, aRight, aBottom, aImageFiles, aTimeout, aInterval, aResult, NULL);
+}
+
+
+
+int WINAPI ImageWaitForResult(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, int aTimeout
+	, int aInterval, ImageMatch *aMatch)
+// Same as ImageWaitForAny() for a single image, storing where it was found into aMatch.
+// Returns 1 if it was found, 0 on timeout, or -1 on error.
+{
+	int result[4];
+	if (!aMatch)
+		return -1;
+	int found = ImageWaitForAny(aLeft, aTop, aRight, aBottom, aImageFile, aTimeout, aInterval, result);
+	if (found > 0)
+	{
+		aMatch->x = result[0];
+		aMatch->y = result[1];
+		aMatch->width = result[2];
+		aMatch->height = result[3];
+		aMatch->score = 1000;
+		aMatch->image = 1;
+	}
+	return found;
+}
+
+
+
+char* WINAPI ImageWaitFor(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, int aTimeout
+	, int aInterval)
+// Same as ImageWaitForResult() but returns the same as ImageSearch(): "0" on timeout or error.
+{
+	ImageMatch match;
+	return MatchAnswer(ImageWaitForResult(aLeft, aTop, aRight, aBottom, aImageFile, aTimeout, aInterval, &match)
+		, match);
+}
+
+
+
+struct SearchJob
+// A search run in the background for ImageSearchSubmit() or ImageWaitForSubmit().
+{
+	int left, top, right, bottom;
+	bool wait;             // ImageWaitForSubmit(): wait for any of the images rather than search once.
+	int timeout, interval; // For waits only.
+	int image_count;
+	int *results;          // 5 ints per image, as stored by ImageSearchBatch().  In the same block as this struct.
+	char *image_files;     // A copy of the caller's list, also in the same block.
+};
+
+
+
+static int SearchJobRun(void *aParam, volatile int *aCancel)
+{
+	SearchJob &job = *(SearchJob *)aParam;
+	if (!job.wait)
+		return ImageSearchBatch(job.left, job.top, job.right, job.bottom, job.image_files, job.results);
+	int result[4];
+	int found = WaitForAny(job.left, job.top, job.right, job.bottom, job.image_files, job.timeout, job.interval
+		, result, aCancel);
+	if (found > 0)
+	{
+		int *results = job.results + 5 * (found - 1);
+		results[0] = 1;
+		memcpy(results + 1, result, sizeof(result));
+	}
+	return found;
+}
+
+
+
+static void SearchJobFree(void *aParam)
+{
+	free(aParam);
+}
+
+
+
+int SearchJobSubmit(int aLeft, int aTop, int aRight, int aBottom, char *aImageFiles, bool aWait, int aTimeout
+	, int aInterval)
+// Returns the same as JobSubmit().
+{
+	if (!aImageFiles)
+		return -1;
+	int image_count = CountImages(aImageFiles);
+	SearchJob *job = (SearchJob *)malloc(sizeof(SearchJob) + image_count * 5 * sizeof(int) + strlen(aImageFiles) + 1);
+	if (!job)
+		return -1;
+	job->left = aLeft;
+	job->top = aTop;
+	job->right = aRight;
+	job->bottom = aBottom;
+	job->wait = aWait;
+	job->timeout = aTimeout;
+	job->interval = aInterval;
+	job->image_count = image_count;
+	job->results = (int *)(job + 1);
+	memset(job->results, 0, image_count * 5 * sizeof(int)); // A wait stores only what it finds, and a failed search nothing.
+	job->image_files = (char *)(job->results + image_count * 5);
+	strcpy(job->image_files, aImageFiles);
+	int id = JobSubmit(SearchJobRun, SearchJobFree, job);
+	if (id < 1)
+		free(job);
+	return id;
+}
+
+
+
+int WINAPI ImageSearchSubmit(int aLeft, int aTop, int aRight, int aBottom, char *aImageFiles)
+// Starts ImageSearchBatch() on a background thread and returns at once, so that the caller can carry on
+// while the region is captured and searched.  Poll or wait for the job with ImageJobWait(), then collect
+// its results with ImageJobResults() and free it with ImageJobRelease().  Jobs run one at a time in the
+// order they were submitted unless ImageJobSetThreads() allows more.
+// Returns the job's id (positive), 0 if too many jobs are outstanding (see JOB_MAX), or -1 on error.
+{
+	return SearchJobSubmit(aLeft, aTop, aRight, aBottom, aImageFiles, false, 0, 0);
+}
+
+
+
+int WINAPI ImageWaitForSubmit(int aLeft, int aTop, int aRight, int aBottom, char *aImageFiles, int aTimeout
+	, int aInterval)
+// Same as ImageSearchSubmit() but the job is ImageWaitForAny().  Cancelling it ends the wait early.
+{
+	return SearchJobSubmit(aLeft, aTop, aRight, aBottom, aImageFiles, true, aTimeout, aInterval);
+}
+
+
+
+int WINAPI ImageJobWait(int aJob, int aTimeout)
+// Waits up to aTimeout milliseconds for a job to finish: 0 just checks, and a negative value waits for as
+// long as it takes.  Returns 0 if the job is still queued, 1 if it is running, 2 if it has finished,
+// 3 if it was cancelled, or -1 if there is no such job.
+{
+	return JobWait(aJob, aTimeout);
+}
+
+
+
+int WINAPI ImageJobResults(int aJob, int *aResults)
+// For a finished job, stores five ints per image into aResults as ImageSearchBatch() does (for a wait,
+// only the image found has its first int set), and returns what ImageSearchBatch() or ImageWaitForAny()
+// returned.  Returns -1 without storing anything if the job hasn't finished or was cancelled.
+{
+	int result;
+	SearchJob *job = (SearchJob *)JobResult(aJob, result);
+	if (!job || !aResults)
+		return -1;
+	memcpy(aResults, job->results, job->image_count * 5 * sizeof(int));
+	return result;
+}
+
+
+
+int WINAPI ImageJobCancel(int aJob)
+// Cancels a job that hasn't finished, or all of them if aJob is 0, such as when their results would
+// already be stale.  A queued job is never run and a wait ends early; a search that has already started
+// runs to the end, but its results are discarded.  Returns the number of jobs cancelled.
+{
+	return JobCancel(aJob);
+}
+
+
+
+void WINAPI ImageJobRelease(int aJob)
+// Frees a job.  Every job must be released, whether or not its results were collected.  Releasing a job
+// that hasn't finished cancels it.
+{
+	JobRelease(aJob);
+}
+
+
+
+void WINAPI ImageJobSetThreads(int aCount)
+// Sets how many jobs may run at once, each on its own background thread: 1 (the default) runs them in
+// order, and 0 means one per CPU.
+{
+	JobSetThreads(aCount);
+}
+
+
+
+int WINAPI ImageSearchResult(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, ImageMatch *aMatch)
+// Same as ImageSearch() but stores the first match into aMatch rather than formatting it as a string, so
+// any number of threads may call it at once.  Returns 1 if the image was found, 0 if not, or -1 on error
+// (such as when the image can't be loaded or the region is empty).
+{
+	ScreenFrame *frame = FrameCapture(aLeft, aTop, aRight, aBottom);
+	int found = ImageSearchFrameResult(frame, aLeft, aTop, aRight, aBottom, aImageFile, aMatch);
+	FrameFree(frame);
+	return found;
+}
+
+
+
+// ResultType Line::ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile)
+char* WINAPI ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile)
+// Author: ImageSearch was created by Aurelian Maga.
+// Returns "1|x|y|width|height" for the first match, or "0" if the image wasn't found or on error.
+// The pixel comparisons themselves are done by SearchFirst() in search.cpp.
+{
+	ImageMatch match;
+	return MatchAnswer(ImageSearchResult(aLeft, aTop, aRight, aBottom, aImageFile, &match), match);
+}
+
+
+
+int WINAPI ImageSearchAll(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, int *aPoints
+	, int aMaxResults, int aFlags)
+// Finds up to aMaxResults occurrences of the image in a single scan of the region, rather than the caller
+// having to repeat ImageSearch() on shrinking rectangles.  The screen x,y of each match is stored into
+// aPoints (which must have room for 2*aMaxResults ints) in left-to-right then top-to-bottom order.
+// aFlags: 1 (SEARCH_NO_OVERLAP) to skip matches that overlap one already found.
+// Returns the number of matches stored, or -1 on error.
+{
+	ScreenFrame *frame = FrameCapture(aLeft, aTop, aRight, aBottom);
+	int match_count = ImageSearchAllFrame(frame, aLeft, aTop, aRight, aBottom, aImageFile, aPoints, aMaxResults, aFlags);
+	FrameFree(frame);
+	return match_count;
+}
+
+
+
+int WINAPI ImageSearchBufferResult(const void *aPixels, int aWidth, int aHeight, int aStride, int aBitsPerPixel
+	, int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, ImageMatch *aMatch)
+// Same as ImageSearchResult() but searches the given region of pixels the caller already has in memory,
+// without copying 32-bit pixels or allocating anything (once the image is in the needle cache).  See
+// FrameFromBuffer() for the parameters.  Coordinates are relative to the buffer's upper-left pixel.
+{
+	ScreenFrame frame;
+	if (!FrameFromBuffer(frame, aPixels, aWidth, aHeight, aStride, aBitsPerPixel))
+		return -1;
+	int found = ImageSearchFrameResult(&frame, aLeft, aTop, aRight, aBottom, aImageFile, aMatch);
+	FrameClear(frame);
+	return found;
+}
+
+
+
+char* WINAPI ImageSearchBuffer(const void *aPixels, int aWidth, int aHeight, int aStride, int aBitsPerPixel
+	, int aLeft, int aTop, int aRight, int aBottom, char *aImageFile)
+// Same as ImageSearchBufferResult() but returns the same as ImageSearch().
+{
+	ImageMatch match;
+	return MatchAnswer(ImageSearchBufferResult(aPixels, aWidth, aHeight, aStride, aBitsPerPixel, aLeft, aTop
+		, aRight, aBottom, aImageFile, &match), match);
+}
+
+
+
+int WINAPI ImageSearchAllBuffer(const void *aPixels, int aWidth, int aHeight, int aStride, int aBitsPerPixel
+	, int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, int *aPoints, int aMaxResults, int aFlags)
+// Same as ImageSearchAll() but for pixels in memory, like ImageSearchBuffer().
+{
+	ScreenFrame frame;
+	if (!FrameFromBuffer(frame, aPixels, aWidth, aHeight, aStride, aBitsPerPixel))
+		return -1;
+	int match_count = ImageSearchAllFrame(&frame, aLeft, aTop, aRight, aBottom, aImageFile, aPoints, aMaxResults, aFlags);
+	FrameClear(frame);
+	return match_count;
+}
+
+
+
+int WINAPI ImageSearchExResult(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, HBITMAP aHaystack
+	, ImageMatch *aMatch)
+// Same as ImageSearchResult() but searches the given region of a bitmap the caller already has, in which
+// case the coordinates (both those given and those returned) are relative to the bitmap's upper-left
+// corner.  If aHaystack is NULL, the screen is searched as usual.
+{
+	if (!aHaystack)
+		return ImageSearchResult(aLeft, aTop, aRight, aBottom, aImageFile, aMatch);
+	ScreenFrame *frame = FrameFromBitmap(aHaystack);
+	int found = ImageSearchFrameResult(frame, aLeft, aTop, aRight, aBottom, aImageFile, aMatch);
+	FrameFree(frame);
+	return found;
+}
+
+
+
+char* WINAPI ImageSearchEx(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, HBITMAP aHaystack)
+// Same as ImageSearchExResult() but returns the same as ImageSearch().
+{
+	ImageMatch match;
+	return MatchAnswer(ImageSearchExResult(aLeft, aTop, aRight, aBottom, aImageFile, aHaystack, &match), match);
+}
+
+
+
+int WINAPI ImageSearchExtResult(int aLeft, int aTop, int aRight, int aBottom, int aVariation, HBITMAP aNeedle
+	, HBITMAP aHaystack, ImageMatch *aMatch)
+// Same as ImageSearchExResult() but the image to search for is also a bitmap rather than a file, so
+// neither image is loaded from disk nor copied from the screen.  aVariation is the same as ImageSearch()'s
+// *n option; no color of the needle is treated as transparent.
+{
+	if (!aNeedle || !aMatch)
+		return -1;
+	ScreenFrame *frame = aHaystack ? FrameFromBitmap(aHaystack) : FrameCapture(aLeft, aTop, aRight, aBottom);
+	if (!frame)
+		return -1;
+	int found = -1;
+	LONG needle_width, needle_height;
+	bool needle_is_16bit;
+	HDC hdc = GetDC(NULL);
+	LPCOLORREF needle_pixel = hdc ? getbits(aNeedle, hdc, needle_width, needle_height, needle_is_16bit) : NULL;
+	if (hdc)
+		ReleaseDC(NULL, hdc);
+	if (needle_pixel)
+	{
+		SearchImage image = {(PIXEL32 *)needle_pixel, needle_width, needle_height, needle_width};
+		SearchNeedle *needle = NeedleCreate(image, NULL, SEARCH_NO_TRANS
+			, (needle_is_16bit || frame->is_16bit) ? SEARCH_COLOR_MASK_16BIT : SEARCH_COLOR_MASK);
+		free(needle_pixel);
+		if (needle)
+		{
+			found = FrameSearchFirst(*frame, aLeft, aTop, aRight, aBottom, *needle
+				, aVariation < 0 ? 0 : (aVariation > 255 ? 255 : aVariation), aMatch);
+			NeedleRelease(needle);
+		}
+	}
+	FrameFree(frame);
+	return found;
+}
+
+
+
+char* WINAPI ImageSearchExt(int aLeft, int aTop, int aRight, int aBottom, int aVariation, HBITMAP aNeedle
+	, HBITMAP aHaystack)
+// Same as ImageSearchExtResult() but returns the same as ImageSearch().
+{
+	ImageMatch match;
+	return MatchAnswer(ImageSearchExtResult(aLeft, aTop, aRight, aBottom, aVariation, aNeedle, aHaystack, &match)
+		, match);
+}
+
+
+
+int WINAPI ImageSearchPreload(char *aImageFile)
+// Loads the image into the needle cache ahead of time so that the first search for it is as fast as
+// later ones.  aImageFile accepts the same options as ImageSearch(); the variation is ignored.
+// Returns 1 on success or 0 if the image could not be loaded.
+{
+	ImageSpec spec;
+	if (!ParseImageSpec(aImageFile, spec))
+		return 0;
+	HDC hdc = GetDC(NULL);
+	if (!hdc)
+		return 0;
+	// Same as what getbits() would report for a capture of the screen:
+	SearchNeedle *needle = LoadNeedle(spec, hdc, GetDeviceCaps(hdc, BITSPIXEL) == 16);
+	ReleaseDC(NULL, hdc);
+	if (!needle)
+		return 0;
+	NeedleRelease(needle); // The cache keeps its own reference.
+	return 1;
+}
+
+
+
+int WINAPI ImageSearchEvict(char *aImageFile)
+// Removes every cached version of the given file (without any *options), or the whole cache if
+// aImageFile is blank.  Returns the number of entries removed.
+{
+	return NeedleCacheEvict(aImageFile);
+}
+
+
+
+int WINAPI ImagePackOpen(char *aPackFile)
+// Maps a pack made by the imagepack tool, so that its images can be searched for as "pack:name", where
+// name is an image's file name as given to the tool without its extension, or as "pack:#id" (see
+// ImagePackFind()).  Any of the usual * options may precede either form.  The pack's pages are shared
+// with every other process that has it open.  Returns the pack's number (1 or more), or 0 on failure.
+{
+	return PackOpen(aPackFile);
+}
+
+
+
+int WINAPI ImagePackClose(int aPack)
+// Closes a pack opened by ImagePackOpen().  Searches already using its images are not affected.
+// Returns 1 on success or 0 if it isn't open.
+{
+	return PackClose(aPack) ? 1 : 0;
+}
+
+
+
+int WINAPI ImagePackFind(char *aName)
+// Returns the id of the image with the given name in any open pack, or 0 if there is none.  "pack:#id"
+// skips looking the name up again.  An id is the pack's number times 65536 plus the image's position in
+// the list given to the tool, starting at 0.
+{
+	return PackFind(aName);
+}
+
+
+
+void WINAPI ImageSearchSetCacheSize(int aMaxEntries)
+// Sets how many needles are kept in the cache (512 by default).  0 disables caching.
+{
+	NeedleCacheSetCapacity(aMaxEntries);
+}
+
+
+
+void WINAPI ImageSearchSetThreads(int aCount)
+// Sets how many threads a search for the first match may use, including the calling thread: 1 (the
+// default) to search serially or 0 for one per CPU.  Large regions are then split into bands that are
+// searched in parallel by a pool of threads that is kept for later searches.  The results are always the
+// same as with a serial search.
+{
+	SearchSetThreads(aCount);
+}
@@ -24,6 +24,113 @@ GNU General Public License for more details.
 HBITMAP LoadPicture(char *aFilespec, int aWidth, int aHeight, int &aImageType, int aIconNumber
 	, bool aUseGDIPlusIfAvailable);
 
+struct ScreenFrame; // Opaque to callers.
+struct ImageWatch; // Opaque to callers.
+struct FrameRing; // Opaque to callers.
+
+struct ImageMatch
+// Where an image was found, as stored by the entry points whose names end in Result.  Unlike the ones that
+// return a "1|x|y|width|height" string, those don't share a buffer, so several threads may call them at once.
+// That includes searching the same frame handle: what a frame builds for its searches (see FramePyramid())
+// is published atomically.  But a frame must not be released while any search of it is still running,
+// and a watch must not be used by more than one thread at a time.
+{
+	int x, y;          // Upper-left corner of the match, in the same coordinates as the region searched.
+	int width, height; // Size of the image.
+	int score;         // Similarity in thousandths: 1000 for the exact (or *n) matches of all but the scored searches.
+	int image;         // Position of the image in the list searched for, starting at 1 (always 1 for a single image).
+};
+
+struct ImageResults
+// A caller's buffer for the entry points whose names end in Results, which store every match as an
+// ImageMatch rather than as a string or as separate arrays of ints, so that a script can read them all
+// through a single DllStructCreate() without any parsing.
+{
+	int count;           // Set to the number of matches stored.
+	int capacity;        // Set by the caller to the number of ImageMatch records that follow.
+	ImageMatch match[1]; // Variable length.
+};
+
 char* WINAPI ImageSearch(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile);
+char* WINAPI ImageSearchEx(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, HBITMAP aHaystack);
+char* WINAPI ImageSearchExt(int aLeft, int aTop, int aRight, int aBottom, int aVariation, HBITMAP aNeedle
+	, HBITMAP aHaystack);
+char* WINAPI ImageSearchBuffer(const void *aPixels, int aWidth, int aHeight, int aStride, int aBitsPerPixel
+	, int aLeft, int aTop, int aRight, int aBottom, char *aImageFile);
+int WINAPI ImageSearchAllBuffer(const void *aPixels, int aWidth, int aHeight, int aStride, int aBitsPerPixel
+	, int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, int *aPoints, int aMaxResults, int aFlags);
+int WINAPI ImageSearchAll(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, int *aPoints
+	, int aMaxResults, int aFlags);
+int WINAPI ImageSearchPreload(char *aImageFile);
+int WINAPI ImageSearchEvict(char *aImageFile);
+int WINAPI ImagePackOpen(char *aPackFile);
+int WINAPI ImagePackClose(int aPack);
+int WINAPI ImagePackFind(char *aName);
+void WINAPI ImageSearchSetCacheSize(int aMaxEntries);
+void WINAPI ImageSearchSetThreads(int aCount);
+ScreenFrame* WINAPI ImageCaptureFrame(int aLeft, int aTop, int aRight, int aBottom);
+void WINAPI ImageReleaseFrame(ScreenFrame *aFrame);
+ScreenFrame* WINAPI ImageFrameFromBuffer(const void *aPixels, int aWidth, int aHeight, int aStride, int aBitsPerPixel);
+ScreenFrame* WINAPI ImageFrameFromBitmap(HBITMAP aBitmap);
+FrameRing* WINAPI ImageFrameRingCreate(char *aName, int aSlotCount, int aMaxWidth, int aMaxHeight);
+FrameRing* WINAPI ImageFrameRingOpen(char *aName);
+void WINAPI ImageFrameRingClose(FrameRing *aRing);
+int WINAPI ImageFrameRingCapture(FrameRing *aRing, int aLeft, int aTop, int aRight, int aBottom);
+int WINAPI ImageFrameRingLatest(FrameRing *aRing);
+ScreenFrame* WINAPI ImageFrameFromRing(FrameRing *aRing, int aSequence);
+char* WINAPI ImageSearchFrame(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom, char *aImageFile);
+int WINAPI ImageSearchAllFrame(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom, char *aImageFile
+	, int *aPoints, int aMaxResults, int aFlags);
+int WINAPI ImageSearchBatch(int aLeft, int aTop, int aRight, int aBottom, char *aImageFiles, int *aResults);
+int WINAPI ImageSearchBatchFrame(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom
+	, char *aImageFiles, int *aResults);
+int WINAPI ImageSearchScored(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, int aMethod, int aMinScore
+	, int *aResults, int aMaxResults);
+int WINAPI ImageSearchScoredFrame(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom, char *aImageFile
+	, int aMethod, int aMinScore, int *aResults, int aMaxResults);
+ImageWatch* WINAPI ImageWatchCreate(char *aImageFile);
+void WINAPI ImageWatchFree(ImageWatch *aWatch);
+char* WINAPI ImageWatchSearch(ImageWatch *aWatch, int aLeft, int aTop, int aRight, int aBottom);
+char* WINAPI ImageWatchSearchFrame(ImageWatch *aWatch, ScreenFrame *aFrame, int aLeft, int aTop, int aRight
+	, int aBottom);
+int WINAPI ImageWaitForAny(int aLeft, int aTop, int aRight, int aBottom, char *aImageFiles, int aTimeout
+	, int aInterval, int *aResult);
+char* WINAPI ImageWaitFor(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, int aTimeout
+	, int aInterval);
+int WINAPI ImageSearchResult(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, ImageMatch *aMatch);
+int WINAPI ImageSearchExResult(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, HBITMAP aHaystack
+	, ImageMatch *aMatch);
+int WINAPI ImageSearchExtResult(int aLeft, int aTop, int aRight, int aBottom, int aVariation, HBITMAP aNeedle
+	, HBITMAP aHaystack, ImageMatch *aMatch);
+int WINAPI ImageSearchBufferResult(const void *aPixels, int aWidth, int aHeight, int aStride, int aBitsPerPixel
+	, int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, ImageMatch *aMatch);
+int WINAPI ImageSearchFrameResult(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom
+	, char *aImageFile, ImageMatch *aMatch);
+int WINAPI ImageWatchSearchResult(ImageWatch *aWatch, int aLeft, int aTop, int aRight, int aBottom
+	, ImageMatch *aMatch);
+int WINAPI ImageWatchSearchFrameResult(ImageWatch *aWatch, ScreenFrame *aFrame, int aLeft, int aTop, int aRight
+	, int aBottom, ImageMatch *aMatch);
+int WINAPI ImageWaitForResult(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, int aTimeout
+	, int aInterval, ImageMatch *aMatch);
+int WINAPI ImageSearchAllResults(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, int aFlags
+	, ImageResults *aResults);
+int WINAPI ImageSearchAllFrameResults(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom
+	, char *aImageFile, int aFlags, ImageResults *aResults);
+int WINAPI ImageSearchBatchResults(int aLeft, int aTop, int aRight, int aBottom, char *aImageFiles
+	, ImageResults *aResults);
+int WINAPI ImageSearchBatchFrameResults(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom
+	, char *aImageFiles, ImageResults *aResults);
+int WINAPI ImageSearchScoredResults(int aLeft, int aTop, int aRight, int aBottom, char *aImageFile, int aMethod
+	, int aMinScore, ImageResults *aResults);
+int WINAPI ImageSearchScoredFrameResults(ScreenFrame *aFrame, int aLeft, int aTop, int aRight, int aBottom
+	, char *aImageFile, int aMethod, int aMinScore, ImageResults *aResults);
+int WINAPI ImageSearchSubmit(int aLeft, int aTop, int aRight, int aBottom, char *aImageFiles);
+int WINAPI ImageWaitForSubmit(int aLeft, int aTop, int aRight, int aBottom, char *aImageFiles, int aTimeout
+	, int aInterval);
+int WINAPI ImageJobWait(int aJob, int aTimeout);
+int WINAPI ImageJobResults(int aJob, int *aResults);
+int WINAPI ImageJobCancel(int aJob);
+void WINAPI ImageJobRelease(int aJob);
+void WINAPI ImageJobSetThreads(int aCount);
 
 #endif